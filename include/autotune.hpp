@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "compiler.hpp"
+#include "memory_plan.hpp"
+
+namespace pim {
+
+// Revision of the cost model and search; part of every tuning database key,
+// so choices made by an older tuner are searched again
+constexpr uint32_t TUNER_REVISION = 2;
+
+// Estimated cost of a triple-loop program
+struct CostEstimate {
+    uint64_t cycles = 0; // Slowest lane, with the machine model's latencies
+    uint64_t words = 0;  // Instruction words
+    PlacementMode placement = PlacementMode::PACKED;
+};
+
+// Analytical cost of the triple-loop program options give for shape
+//
+// Lanes run side by side, so the slowest one sets the time. A lane spends
+// one step per MAC of its chains. Without the scheduling pass a step waits
+// for its loads and then issues the MAC, load_latency + 1 cycles; with it,
+// the two latches overlap the loads of one step with the next, halving that.
+// A step also takes at least two issues on one core, and at least
+// bank_cycles for each lane reading the same block in lockstep, which
+// happens when the memory plan could not give every lane its own copies.
+// Between chains the even core stores C and resets the accumulator, which
+// costs whatever of mac_latency + setup_latency + 1 a step does not hide.
+// A chain that starts with an A load (B kept in its latch, or no operand
+// reuse) also waits for the store to leave the bank C shares with A. That
+// bank's accesses, A loads and C stores, bound the lane from below too.
+// Words are three per step and two per chain, less one load per chain
+// boundary the operand-reuse pass removes, plus each lane's first bank selects.
+// Throws when the operands do not fit the memory geometry.
+CostEstimate estimate_cost(const GemmShape& shape, const CompileOptions& options);
+
+// The same model for a tiling already planned, every tile k_rows deep, with
+// its blocks placed as placement; the Strassen lowering costs its leaf
+// products with it
+CostEstimate tiling_cost(const TilePlan& tiling, size_t k_rows, PlacementMode placement,
+                         const CompileOptions& options);
+
+// Cycles of one MAC step of a lane when sharing lanes read its blocks in
+// lockstep; the constants are checked against the simulator. The LUT lowering
+// costs its chains with it too.
+double step_cycles(const MachineModel& machine, bool schedule, uint32_t sharing);
+
+// Configuration the tuner picked for a shape
+struct TuneChoice {
+    uint32_t num_cores = NUM_CORES;
+    size_t tile_rows = 0;
+    size_t tile_cols = 0;
+    bool operand_reuse = true;
+    bool schedule = false;
+    CostEstimate cost;
+};
+
+// Tuner choices by shape and the options that constrain the search
+//
+// The file has one choice per line, "key cores tile_rows tile_cols reuse
+// schedule cycles words", and # comments. New choices are appended, and a
+// later line for the same key wins, so several processes can share a file.
+class TuningDatabase {
+public:
+    // Loads path when it exists; an empty path keeps the choices in memory only
+    explicit TuningDatabase(const std::string& path = "");
+
+    bool find(const std::string& key, TuneChoice& choice) const;
+    void store(const std::string& key, const TuneChoice& choice);
+
+    // Shape, core limit, memory geometry, element type, machine latencies
+    // and the tuner and compiler revisions
+    static std::string key(const GemmShape& shape, const CompileOptions& options);
+
+    const std::string& path() const { return path_; }
+
+private:
+    std::string path_;
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, TuneChoice> choices_;
+};
+
+struct TuneResult {
+    TuneChoice choice;
+    CostEstimate given;       // The options as given, with the triple loop (cycles 0 if they do not fit)
+    size_t candidates = 0;    // Configurations considered; 0 when the database had the shape
+    bool from_database = false;
+};
+
+// Searches core counts up to options.num_cores, tile sizes from the automatic
+// tiling to two tiles per lane, and the operand-reuse and scheduling passes
+// on or off, for the lowest estimated cycles, then words, then tiles. Writes
+// the choice into options, with the triple loop (strassen_levels = 0), which
+// is what the model describes. A database, when given, is consulted first and
+// receives new choices. Throws for the sparse and LUT lowerings, whose cost
+// depends on the values.
+TuneResult autotune(const GemmShape& shape, CompileOptions& options, TuningDatabase* database = nullptr);
+
+// One-line summary of a tuning result for the tools' logs
+std::string tune_summary(const TuneResult& result);
+
+} // namespace pim
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include "compiler.hpp"
+
+namespace pim {
+
+// Parses a compiler option at argv[index] into options, advancing index past any
+// value it consumes. Returns false if argv[index] is not a compiler option.
+//   --cores N       Cores to use (even, 2..64)
+//   --tile RxC      C tile size per lane
+//   --no-reuse      Disable the operand-reuse pass
+//   --banks N       Memory banks available to the planner
+//   --bank-rows N   Rows per bank (at most 512)
+//   --chunk N       IR operations generated per lane at a time
+//   --threads N     Compile threads (0 = all hardware threads)
+//   --no-specialized  Ignore built-in StaticPrograms
+//   --schedule      Run the scheduling pass
+//   --machine SPEC  Machine latencies (load=N,store=N,mac=N,setup=N,bank=N)
+//   --sparse D      Sparse lowering for tiles at or below product density D
+//   --strassen N|auto  Strassen recursion depth
+//   --strassen-cutoff N  Smallest leaf dimension the automatic depth allows
+//   --element T     Operand element type (int32, int16, int8)
+//   --lut N         LUT lowering for tiles whose B has at most N distinct nonzero values
+//   --tune          Pick cores, tile size and passes per shape with the cost model
+//   --tune-db FILE  Keep the tuner's choices in FILE (implies --tune)
+bool parse_compile_option(int argc, char* argv[], int& index, CompileOptions& options);
+
+// Usage text for the options above
+std::string compile_options_usage();
+
+// Parses the value of flag as a decimal integer that fits in T; the tools use
+// it for their own flags too. stoull alone would skip leading blanks and wrap
+// "-1", so the text must start with a digit.
+template <typename T>
+T parse_number(const std::string& text, const std::string& flag) {
+    try {
+        if (text.empty() || text[0] < '0' || text[0] > '9') throw std::invalid_argument(text);
+        size_t consumed = 0;
+        unsigned long long value = std::stoull(text, &consumed);
+        if (consumed != text.size()) throw std::invalid_argument(text);
+        if (value > static_cast<unsigned long long>(std::numeric_limits<T>::max())) throw std::out_of_range(text);
+        return static_cast<T>(value);
+    } catch (const std::exception&) {
+        throw std::runtime_error("Invalid value '" + text + "' for " + flag);
+    }
+}
+
+} // namespace pim
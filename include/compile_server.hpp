@@ -0,0 +1,164 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "autotune.hpp"
+#include "compiler.hpp"
+#include "program_cache.hpp"
+
+namespace pim {
+
+// Most workers a server starts; each is a thread with its own compiler
+constexpr unsigned MAX_SERVER_WORKERS = 1024;
+
+// Settings of a CompileServer
+struct CompileServerOptions {
+    unsigned workers = 0;         // Requests compiled at once (0 = every hardware thread)
+    CompileOptions defaults;      // Options every request starts from
+    std::string cache_directory;  // ProgramCache directory ("" = keep programs in memory only)
+    ProgramCacheLimits cache_limits;
+};
+
+// Request latencies, in seconds, from a request being read to its response
+// being written
+struct LatencySummary {
+    size_t count = 0;
+    double mean = 0;
+    double p50 = 0;
+    double p90 = 0;
+    double p99 = 0;
+    double max = 0;
+};
+
+// Request latencies binned on a fixed log scale, so memory and the cost of a
+// summary stay constant however long the server runs. Percentiles are the
+// upper edge of their bucket, at most 1/16 octave (4.4%) above the exact
+// value, and never above the largest latency seen.
+class LatencyHistogram {
+public:
+    void add(double seconds);
+    LatencySummary summary() const;
+
+private:
+    static constexpr int BUCKETS_PER_OCTAVE = 16;
+    static constexpr int OCTAVES = 32; // 1 us to about 71 minutes; longer ones share the last bucket
+
+    // Bucket 0 holds latencies under 1 us; bucket b > 0 covers
+    // [2^((b-1)/16), 2^(b/16)) us
+    static size_t bucket_of(double seconds);
+    static double upper_edge(size_t bucket);
+
+    std::array<uint64_t, BUCKETS_PER_OCTAVE * OCTAVES + 1> counts_{};
+    size_t count_ = 0;
+    double total_ = 0;
+    double max_ = 0;
+};
+
+// Counters since the server started
+struct CompileServerStats {
+    uint64_t requests = 0; // Compile requests answered, including errors
+    uint64_t errors = 0;
+    uint64_t cache_hits = 0;   // Served from the program cache without compiling
+    uint64_t cache_misses = 0; // Compiled into the program cache
+    LatencySummary latency;
+};
+
+// Long-running compiler fed over a pipe or a Unix domain socket
+//
+// A connection carries one request per line, answered in any order. A
+// request is a verb, an ID echoed in the response, and arguments:
+//
+//   compile ID [compile options] [--format pimb|raw|none] [--stats] INPUT
+//   stats ID
+//   quit                 Close this connection once its requests are answered
+//   shutdown             Stop the server once every request is answered
+//
+// INPUT is one C++ source file or two .npy or .mtx files, as on the command
+// line; --shape MxKxN for a dense compile without values; or --inline MxKxN,
+// in which case A and B follow the line as M*K + K*N little-endian int32,
+// row-major. Options not given keep the server's defaults.
+//
+// A compile is answered with
+//
+//   ok ID words=N cache=hit|miss|off latency_us=T program=P stats=S
+//
+// followed by P bytes of program (a .pimb container by default, or raw
+// little-endian 32-bit words) and S bytes of JSON stats (--stats; see
+// write_stats_json). A cache hit compiles nothing, so it has no stats. A
+// failed request is answered with "error ID message".
+//
+// Requests are compiled on a fixed set of workers. Each worker keeps one
+// Compiler, with its thread pool and IR buffers, for its whole life, and
+// dense programs are kept in a ProgramCache keyed by shape and options, so a
+// repeated layer costs a lookup. Requests with --tune are tuned against one
+// TuningDatabase, the defaults' --tune-db file or memory, before the lookup.
+class CompileServer {
+public:
+    explicit CompileServer(const CompileServerOptions& options);
+    ~CompileServer();
+
+    CompileServer(const CompileServer&) = delete;
+    CompileServer& operator=(const CompileServer&) = delete;
+
+    // Reads requests from in_fd and answers on out_fd (e.g. stdin and stdout)
+    // until end of input, quit or shutdown; returns once all are answered
+    void serve(int in_fd, int out_fd);
+
+    // Accepts connections on a Unix domain socket at path, serving each on a
+    // thread of its own, until a shutdown request. A stale socket file at
+    // path is replaced; the file is removed on return.
+    void listen(const std::string& path);
+
+    CompileServerStats stats() const;
+
+private:
+    struct Connection;
+    struct Job;
+
+    // Serves one connection; used by both serve() and listen()
+    void run_connection(int in_fd, int out_fd);
+
+    // Fills in job from the words of a compile request, whose --inline
+    // payload has already been read
+    static void parse_compile_request(const std::vector<std::string>& words, Job& job);
+
+    // Answers a stats request on connection
+    void send_stats(Connection& connection, const std::string& id);
+
+    void worker_loop();
+    void run_job(Job& job, Compiler& compiler);
+
+    // Stops accepting connections and reading requests
+    void request_shutdown();
+
+    CompileServerOptions options_;
+    ProgramCache cache_;
+    TuningDatabase tuning_; // Choices for requests with --tune, shared by the workers
+
+    std::vector<std::thread> workers_;
+    std::mutex queue_mutex_;
+    std::condition_variable queue_ready_;
+    std::deque<std::unique_ptr<Job>> queue_;
+    bool stop_workers_ = false;
+
+    std::atomic<bool> shutting_down_{false};
+    std::mutex connections_mutex_;
+    std::set<int> open_connections_; // Input descriptors of the live connections
+    int listen_fd_ = -1;
+
+    mutable std::mutex stats_mutex_;
+    CompileServerStats stats_;
+    LatencyHistogram latencies_;
+};
+
+} // namespace pim
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include "instruction.hpp"
+#include "ir.hpp"
+
+namespace pim {
+
+struct CompileReport;
+
+constexpr size_t IR_OP_TYPES = 10; // Entries of IROpType
+const char* ir_op_type_name(IROpType type);
+
+// Instruction kinds counted by the stats: the four opcodes, with the two
+// bank-select forms of COMPUTE_SETUP and the fence form of MEM_STORE counted apart
+constexpr size_t INSTRUCTION_KINDS = 7;
+inline size_t instruction_kind(const instr_format::UnpackedInstr& unpacked) {
+    if (instr_format::is_bank_select(unpacked)) {
+        return unpacked.wr ? 5 : 4;
+    }
+    if (instr_format::is_fence(unpacked)) {
+        return 6;
+    }
+    return static_cast<size_t>(unpacked.opcode);
+}
+const char* instruction_kind_name(size_t kind);
+
+// Time and effect of one IR pass
+struct PassStats {
+    double seconds = 0;
+    size_t ops_in = 0;
+    size_t ops_out = 0;
+};
+
+// Wall time per stage, in seconds. Stages that run per tile on the thread
+// pool are summed over the workers, so they can add up to more than total.
+struct StageTimes {
+    double plan = 0;          // Tiling and memory plan
+    double ir_generation = 0;
+    double translate = 0;     // IR to words, including the round-robin interleave
+    double emit = 0;          // Gathering the program and handing it to the sink
+    double total = 0;         // Whole compile
+};
+
+// Instrumentation of the last compile
+//
+// Counting happens once per chunk or per word the compiler already touches,
+// so it is always on.
+struct CompileStats {
+    StageTimes time;
+    PassStats operand_reuse;
+    PassStats schedule;
+    PassStats bank_select;
+    std::array<size_t, IR_OP_TYPES> ir_ops_by_type{};              // Operations translated, after the passes
+    std::array<size_t, INSTRUCTION_KINDS> instructions_by_kind{};
+    size_t buffer_bytes = 0; // Peak bytes in the compiler's IR and word buffers
+};
+
+// Measures the wall time of a scope into a counter
+class StageTimer {
+public:
+    explicit StageTimer(double& seconds) : seconds_(seconds), start_(std::chrono::steady_clock::now()) {}
+    ~StageTimer() { seconds_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count(); }
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+private:
+    double& seconds_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// Writes report (shape, stages, passes, counts and memory regions) as one
+// JSON object. parse_seconds is the caller's input parsing time, if any.
+void write_stats_json(std::ostream& out, const CompileReport& report, double parse_seconds);
+
+// Human-readable breakdown of the same data
+void write_stats_text(std::ostream& out, const CompileReport& report, double parse_seconds);
+
+} // namespace pim
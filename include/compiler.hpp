@@ -1,52 +1,237 @@
 #pragma once
 
+#include <chrono>
+#include <functional>
+#include <memory>
 #include <vector>
 #include <string>
+#include "compile_stats.hpp"
 #include "instruction.hpp"
 #include "ir.hpp"
+#include "machine_model.hpp"
+#include "matrix_io.hpp"
+#include "memory_plan.hpp"
+#include "passes.hpp"
+#include "scheduler.hpp"
+#include "sink.hpp"
+#include "sparse.hpp"
+#include "static_program.hpp"
+#include "thread_pool.hpp"
 #include <cstdint>
 
 namespace pim {
 
-// Base addresses for matrices in simulated PIM memory
-constexpr uint32_t MATRIX_A_BASE = 0;
-constexpr uint32_t MATRIX_B_BASE = 100; // Example: Allocate space after A
-constexpr uint32_t MATRIX_C_BASE = 200; // Example: Allocate space after B
+// Revision of the code generator. Bump it whenever the program produced for
+// the same shape and options changes, so cached programs are not reused.
+constexpr uint32_t COMPILER_REVISION = 5;
+
+// Shape of C = A (rows_a x cols_a) x B (cols_a x cols_b)
+struct GemmShape {
+    size_t rows_a = 0;
+    size_t cols_a = 0;
+    size_t cols_b = 0;
+};
+
+// Checks that A and B are non-empty, rectangular and compatible; throws otherwise
+GemmShape gemm_shape(
+    const std::vector<std::vector<int>>& matrix_a,
+    const std::vector<std::vector<int>>& matrix_b
+);
+GemmShape gemm_shape(const Matrix& matrix_a, const Matrix& matrix_b);
+
+// One tiling for several independent problems: each is cut into tiles of
+// about half a lane's share of the total work, and all tiles are balanced
+// over the lanes together (Tile::problem tells them apart). problem_tiling[p]
+// receives problem p's own view, which its memory plan is built from.
+TilePlan plan_batch_tiles(const std::vector<GemmShape>& problems, uint32_t num_cores,
+                          size_t tile_rows, size_t tile_cols, std::vector<TilePlan>& problem_tiling);
+
+// Options controlling IR generation and optimization
+struct CompileOptions {
+    bool operand_reuse = true;     // Run the operand-reuse pass
+    uint32_t num_cores = NUM_CORES; // Cores to spread C over (even, 2..64)
+    size_t tile_rows = 0;          // C tile height per lane (0 = automatic)
+    size_t tile_cols = 0;          // C tile width per lane (0 = automatic)
+    MemoryGeometry memory;         // Banks available to the memory planner
+    size_t chunk_ops = 4096;       // IR operations generated per lane at a time; bounds peak memory
+    unsigned threads = 1;          // Compile threads; 1 streams serially, 0 uses every hardware thread
+    bool specialized = true;       // Use a built-in StaticProgram when one matches the shape
+    bool schedule = false;         // Run the scheduling pass (uses both operand latches of each core)
+    double sparse_density = 0.0;   // Lower tiles with at most this fraction of nonzero products
+                                   // sparsely (0 = dense only); needs the matrix values
+    MachineModel machine;          // Latencies the scheduling pass plans for
+    int strassen_levels = -1;      // Strassen recursion depth for single dense problems
+                                   // (-1 = picked by the cost estimate, 0 = triple loop only)
+    size_t strassen_cutoff = 64;   // Smallest leaf dimension the automatic choice recurses to
+    ElementType element_type = ElementType::INT32; // Operand width; narrower types share memory rows
+                                                   // (dense, non-Strassen lowering only)
+    size_t lut_values = 0;         // Table lookups for tiles whose B has at most this many distinct
+                                   // nonzero values, where cheaper (0 = off); needs the matrix values
+    bool autotune = false;         // Tools pick cores, tiling and passes per shape with autotune()
+    std::string tuning_database;   // File autotune() keeps its choices in ("" = search every time)
+};
+
+// Strassen depth the options ask for on a single dense problem of this shape
+// (the estimate's choice when strassen_levels is automatic, 0 for packed
+// elements; throws when the options ask for both)
+uint32_t strassen_depth(const GemmShape& shape, const CompileOptions& options);
+
+// Built-in StaticProgram for the shape, or null when there is none or the
+// options ask for anything a static program was not generated with
+const SpecializedProgram* find_specialized_program(const GemmShape& shape, const CompileOptions& options);
+
+// One problem of a batch compile: where its operands went and where its
+// instructions and results can be found
+struct BatchEntry {
+    GemmShape shape;
+    MemoryPlan memory;      // Its A, B and C, at rows [memory.base_row(), memory.rows_used())
+    size_t tiles = 0;       // C tiles it was cut into
+    size_t c_offset = 0;    // Offset of its C in the batch output (every C row-major, back to back)
+    size_t first_word = 0;  // Its instructions all lie in [first_word, end_word) of the program,
+    size_t end_word = 0;    // interleaved with those of other problems
+};
+
+// Summary of the last compilation
+struct CompileReport {
+    size_t ir_ops = 0;       // IR operations generated, before passes
+    size_t instructions = 0; // Instruction words emitted
+    OperandReuseStats operand_reuse;
+    ScheduleStats schedule;  // Windows over all lanes; cycle estimates of the slowest lane
+    size_t bank_selects = 0; // SET_BANK / SET_SEGMENT instructions inserted
+    size_t sparse_tiles = 0; // Tiles given the sparse lowering
+    size_t lut_tiles = 0;    // Tiles given the LUT lowering
+    uint64_t lut_table_rows = 0; // Scratch rows their tables take
+    TilePlan tiling;                        // Tile-to-lane assignment used
+    MemoryPlan memory;                      // Operand placement used
+    std::vector<size_t> core_instructions; // Instruction words per core_ptr
+    bool specialized = false;               // Program came from a built-in StaticProgram
+    uint32_t strassen_levels = 0;           // Strassen recursion depth used (0 = triple loop)
+    std::vector<BatchEntry> batch;          // Per-problem table of a batch compile (empty otherwise)
+    CompileStats stats;                     // Stage times and counts (see compile_stats.hpp)
+};
+
+// Called with the finished report at the end of every compile
+using StatsCallback = std::function<void(const CompileReport&)>;
+
+struct PipelineStats;
+struct ProgramPhase;
+class StrassenLowering;
+class LutLowering;
 
 class Compiler {
 public:
-    Compiler() = default;
+    Compiler();
+    explicit Compiler(const CompileOptions& options);
+    ~Compiler();
 
     // Compile matrix multiplication code into PIM instructions
     std::vector<InstructionWord> compile_matrix_mult(
         const std::vector<std::vector<int>>& matrix_a,
         const std::vector<std::vector<int>>& matrix_b
     );
+    std::vector<InstructionWord> compile_matrix_mult(const Matrix& matrix_a, const Matrix& matrix_b);
+
+    // Streams the program for C = A (rows_a x cols_a) x B (cols_a x cols_b) into
+    // sink, chunk_ops words at a time. Returns the number of words written.
+    // Without the values only the dense lowering is possible, so this throws
+    // when sparse_density or lut_values is set.
+    size_t compile_matrix_mult(size_t rows_a, size_t cols_a, size_t cols_b, InstructionSink& sink);
+
+    // Same, taking the values into account when sparse_density or lut_values is set
+    size_t compile_matrix_mult(const Matrix& matrix_a, const Matrix& matrix_b, InstructionSink& sink);
+    size_t compile_matrix_mult(const CsrMatrix& matrix_a, const CscMatrix& matrix_b, InstructionSink& sink);
+
+    // Compiles independent problems into one program. Memory is planned for all
+    // of them together, and their tiles are balanced over the lanes, so small
+    // problems run side by side. report().batch has the per-problem table.
+    // Only the dense lowering is batched; throws when sparse_density or
+    // lut_values is set.
+    std::vector<InstructionWord> compile_batch(const std::vector<GemmShape>& problems);
+    size_t compile_batch(const std::vector<GemmShape>& problems, InstructionSink& sink);
+
+    const CompileReport& report() const { return report_; }
+
+    // Options of the following compiles. The thread pool and IR buffers stay,
+    // so one long-lived compiler can serve requests with different options.
+    void set_options(const CompileOptions& options) { options_ = options; }
+    const CompileOptions& options() const { return options_; }
+
+    // Hands every finished report to callback (e.g. to log or aggregate the
+    // stats); an empty callback removes it
+    void set_stats_callback(StatsCallback callback) { stats_callback_ = std::move(callback); }
+
+    // Translates one IR operation of the given lane; returns false (with a
+    // warning) for unknown types
+    static bool translate_ir_op(const IROperation& ir_op, uint32_t lane, const MemoryPlan& memory_plan,
+                                InstructionWord& word);
 
 private:
-    // Translates the Intermediate Representation (IR) code to PIM Instructions
-    std::vector<InstructionWord> translate_ir_to_pim(
-        const std::vector<IROperation>& ir_code,
-        size_t rows_a,
-        size_t cols_a,
-        size_t cols_b);
-
-    // Helper methods
-    std::vector<InstructionWord> generate_lut_instructions();
-    std::vector<InstructionWord> generate_load_instructions(
-        const std::vector<std::vector<int>>& matrix,
-        uint32_t base_addr
-    );
-    std::vector<InstructionWord> generate_compute_instructions(
-        uint32_t rows_a,
-        uint32_t cols_a,
-        uint32_t cols_b
-    );
-    std::vector<InstructionWord> generate_store_instructions(
-        uint32_t rows,
-        uint32_t cols,
-        uint32_t base_addr
-    );
+    // Whole program for the shape, built by whichever path options_.threads selects.
+    // sparse is null for the dense lowering; weights is B for the LUT lowering.
+    std::vector<InstructionWord> compile_program(const GemmShape& shape, const SparseOperands* sparse,
+                                                 const Matrix* weights = nullptr);
+
+    // Streaming counterpart of compile_program
+    size_t compile_to_sink(const GemmShape& shape, const SparseOperands* sparse, InstructionSink& sink,
+                           const Matrix* weights = nullptr);
+
+    // True when options_.threads resolves to more than one thread
+    bool parallel() const;
+
+    // Stages shared by both paths: tiling and memory plan, extended for the
+    // Strassen lowering when the options pick it and dense allows it, or for
+    // the LUT lowering when weights (B) are given
+    void plan(size_t rows_a, size_t cols_a, size_t cols_b, bool dense, const Matrix* weights = nullptr);
+
+    // Batch counterpart of plan(): one tiling over all lanes, one memory plan per problem
+    void plan_batch(const std::vector<GemmShape>& problems);
+
+    // Plans the lane streams compile against, indexed by Tile::problem
+    std::vector<const MemoryPlan*> memory_plans() const;
+
+    // Parts of the planned program in order: the Strassen phases, or just the tiling
+    std::vector<ProgramPhase> phases() const;
+
+    // Copies a built-in program into the report and, if given, the sink
+    void emit_specialized(const SpecializedProgram& program, InstructionSink* sink);
+
+    // Runs the planned tiles through the pipeline into sink, on whichever path
+    // options_.threads selects
+    size_t compile_planned(const SparseOperands* sparse, InstructionSink& sink);
+
+    // Serial path: lanes streamed and interleaved chunk by chunk
+    void compile_streaming(const ProgramPhase& phase, const SparseOperands* sparse, InstructionSink& sink);
+
+    // Parallel path: tiles generated on the thread pool, then gathered into the
+    // interleaved order at the end of program
+    void compile_parallel(const ProgramPhase& phase, const SparseOperands* sparse,
+                          std::vector<InstructionWord>& program);
+
+    // Every phase through the parallel path; returns the whole program
+    std::vector<InstructionWord> compile_parallel(const SparseOperands* sparse);
+
+    // Appends the FENCE words that open a phase with fence set: one on both
+    // cores of every lane with tiles, so none of the phase's loads issue before
+    // the stores of earlier phases have reached memory
+    void append_phase_fences(const ProgramPhase& phase, std::vector<InstructionWord>& words);
+
+    // Folds one lane's scheduling estimate into a phase's
+    static void add_lane_schedule(ScheduleStats& phase, const ScheduleStats& lane);
+
+    // Folds the pass and generation stats of one stream into report_.stats
+    void add_pipeline_stats(const PipelineStats& stats);
+
+    // Records the total time and hands the report to the stats callback
+    void finish_stats();
+
+    CompileOptions options_;
+    CompileReport report_;
+    std::unique_ptr<ThreadPool> pool_; // Created on first parallel compile
+    std::unique_ptr<IRArenaPool> arenas_; // IR buffers, kept from stream to stream and compile to compile
+    std::unique_ptr<StrassenLowering> strassen_; // Leaf plans and sums of a Strassen compile
+    std::unique_ptr<LutLowering> lut_;           // Tables of a LUT compile
+    std::chrono::steady_clock::time_point compile_start_;
+    StatsCallback stats_callback_;
 };
 
 } // namespace pim 
\ No newline at end of file
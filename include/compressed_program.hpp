@@ -0,0 +1,181 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "instruction.hpp"
+#include "program_file.hpp"
+#include "sink.hpp"
+
+namespace pim {
+
+// Arithmetic run of instruction words
+//
+// Word n of the run is start + n * delta. Inside a block, copy r of the run
+// is shifted by r * stride. All arithmetic wraps modulo 2^32, so a negative
+// step is stored as its two's complement.
+struct WordRun {
+    uint32_t start = 0;
+    uint32_t delta = 0;
+    uint32_t count = 0;
+    uint32_t stride = 0;
+};
+
+// repeat copies of the next runs consecutive runs, expanded in order
+struct RunBlock {
+    uint32_t repeat = 1;
+    uint32_t runs = 0;
+};
+
+// Loop-compressed program
+//
+// The unrolled stream is the blocks in order; a block is a repeat-N loop over
+// its runs whose address fields advance by a fixed stride per iteration.
+// Interleaved lane streams repeat the same opcode and core pattern round
+// after round with addresses advancing in step, so a program of millions of
+// words usually folds into a few thousand descriptors.
+class CompressedProgram {
+public:
+    CompressedProgram() = default;
+
+    // Takes descriptors built elsewhere (e.g. read from a file); throws if any is empty
+    CompressedProgram(std::vector<WordRun> runs, std::vector<RunBlock> blocks);
+
+    // Words of the unrolled program
+    size_t size() const { return size_; }
+
+    const std::vector<WordRun>& runs() const { return runs_; }
+    const std::vector<RunBlock>& blocks() const { return blocks_; }
+
+    // Size of its .pimz container
+    size_t file_bytes() const;
+
+    // Lazy expansion: hands out the unrolled words in order, a batch at a time
+    class Reader {
+    public:
+        explicit Reader(const CompressedProgram& program) : program_(program) {}
+
+        // Writes up to max words to out; returns how many were written (0 at the end)
+        size_t read(InstructionWord* out, size_t max);
+
+        bool done() const { return block_ == program_.blocks_.size(); }
+
+    private:
+        const CompressedProgram& program_;
+        size_t block_ = 0;     // Current block
+        size_t first_run_ = 0; // Its first run
+        uint32_t copy_ = 0;    // Iteration of the block
+        uint32_t run_ = 0;     // Run within the block
+        uint32_t word_ = 0;    // Word within the run
+    };
+
+    // Whole unrolled program
+    std::vector<InstructionWord> expand() const;
+
+    // Checksum of the unrolled program (see ProgramChecksum)
+    uint64_t checksum() const;
+
+private:
+    friend class CompressingSink;
+
+    std::vector<WordRun> runs_;
+    std::vector<RunBlock> blocks_;
+    size_t size_ = 0;
+};
+
+// Compresses a program while the compiler streams into it
+//
+// Words are first cut into maximal arithmetic runs. Runs are then folded into
+// blocks: at each position the period (in runs) whose repetitions cover the
+// most runs wins, and a block left open at the end of the buffered runs keeps
+// absorbing further repetitions as they arrive. Folding looks at
+// FOLD_WINDOW runs at a time, so memory stays bounded for any program size.
+class CompressingSink : public InstructionSink {
+public:
+    static constexpr size_t FOLD_WINDOW = 8192;
+    static constexpr size_t MAX_PERIOD = 32;
+
+    void write(const InstructionWord* words, size_t count) override;
+    void finish() override;
+
+    // Complete once finish() has run
+    const CompressedProgram& program() const { return program_; }
+    uint64_t checksum() const { return checksum_.value(); }
+
+private:
+    // Hands a finished run to the folder
+    void push_run(const WordRun& run);
+
+    // Folds buffered runs into blocks; unless final, keeps enough runs back
+    // that a block starting among them can still be recognized
+    void fold(bool final);
+
+    // Extends the last block by the repetitions starting at pending_[at]; returns the runs absorbed
+    size_t extend_last_block(size_t at, size_t end);
+
+    // Runs covered by repeating pending_[at, at + period) with constant strides
+    size_t coverage(size_t at, size_t end, size_t period) const;
+
+    // Appends repeat copies of pending_[at, at + period) as one block
+    void append_block(size_t at, size_t period, size_t repeat);
+
+    WordRun run_;           // Run being extended
+    InstructionWord last_ = 0; // Its last word
+    std::vector<WordRun> pending_; // Runs not folded yet
+    CompressedProgram program_;
+    ProgramChecksum checksum_;
+};
+
+// Checks an unrolled instruction stream against a compressed program
+//
+// Stream the compiler's output into it; after finish(), matches() tells
+// whether every word agreed and the lengths are equal.
+class CompressedProgramVerifier : public InstructionSink {
+public:
+    explicit CompressedProgramVerifier(const CompressedProgram& program);
+
+    void write(const InstructionWord* words, size_t count) override;
+    void finish() override;
+
+    bool matches() const { return finished_ && mismatch_ == SIZE_MAX; }
+
+    // Index of the first word that differs, or where one stream ended early
+    // (SIZE_MAX when there is none)
+    size_t mismatch() const { return mismatch_; }
+
+    // Words compared so far
+    size_t compared() const { return compared_; }
+
+private:
+    CompressedProgram::Reader reader_;
+    std::vector<InstructionWord> expected_;
+    size_t compared_ = 0;
+    size_t mismatch_ = SIZE_MAX;
+    bool finished_ = false;
+};
+
+// Compressed program container (.pimz)
+//
+// The .pimb header with magic "PIMZ" (word count and checksum describe the
+// unrolled program), then the descriptors, all little-endian:
+//
+//   offset  size  field
+//        0    96  program header
+//       96     8  run count
+//      104     8  block count
+//      112  16*R  runs: start, delta, count, stride (4 bytes each)
+//        .   8*B  blocks: repeat, runs (4 bytes each)
+constexpr char COMPRESSED_PROGRAM_MAGIC[5] = "PIMZ";
+
+void write_compressed_program(const std::string& path, const ProgramHeader& header,
+                              const CompressedProgram& program);
+
+// Reads a container into header and the returned program; throws when it is
+// malformed or its descriptors do not add up to header.word_count
+CompressedProgram read_compressed_program(const std::string& path, ProgramHeader& header);
+
+// True when the file starts with the .pimz magic
+bool is_compressed_program_file(const std::string& path);
+
+} // namespace pim
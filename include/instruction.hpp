@@ -32,8 +32,12 @@ namespace instr_format {
     constexpr uint32_t ROW_ADDR_SHIFT = 0;
     constexpr uint32_t ROW_ADDR_MASK = 0x1FF; // 9 bits
 
+    // Width of a packed instruction
+    constexpr uint32_t INSTRUCTION_BITS = 19;
+    constexpr uint32_t INSTRUCTION_MASK = (1u << INSTRUCTION_BITS) - 1;
+
     // Helper function to pack fields into a 32-bit instruction word
-    inline uint32_t pack(Opcode op, uint32_t core_ptr, bool rd, bool wr, uint32_t row_addr) {
+    constexpr uint32_t pack(Opcode op, uint32_t core_ptr, bool rd, bool wr, uint32_t row_addr) {
         uint32_t instruction = 0;
         instruction |= (static_cast<uint32_t>(op) & OPCODE_MASK) << OPCODE_SHIFT;
         instruction |= (core_ptr & CORE_PTR_MASK) << CORE_PTR_SHIFT;
@@ -52,8 +56,8 @@ namespace instr_format {
         uint32_t row_addr;
     };
 
-    inline UnpackedInstr unpack(uint32_t instruction) {
-        UnpackedInstr unpacked;
+    constexpr UnpackedInstr unpack(uint32_t instruction) {
+        UnpackedInstr unpacked{};
         unpacked.opcode   = static_cast<Opcode>((instruction >> OPCODE_SHIFT) & OPCODE_MASK);
         unpacked.core_ptr = (instruction >> CORE_PTR_SHIFT) & CORE_PTR_MASK;
         unpacked.rd       = ((instruction >> RD_FLAG_SHIFT) & RD_FLAG_MASK) != 0;
@@ -62,6 +66,27 @@ namespace instr_format {
         return unpacked;
     }
 
+    // COMPUTE_SETUP with the RD flag set leaves the accumulator alone and writes
+    // the core's bank register instead: WR=0 sets the low 9 bits of the bank
+    // number (SET_BANK), WR=1 the high 9 bits (SET_SEGMENT)
+    constexpr bool is_bank_select(const UnpackedInstr& unpacked) {
+        return unpacked.opcode == Opcode::COMPUTE_SETUP && unpacked.rd;
+    }
+
+    // MEM_STORE with the RD flag set stores nothing and is a fence (FENCE): the
+    // core issues nothing after it until every MEM_STORE before it in the
+    // program, on any core, has reached memory. Ordinary stores leave RD at 0.
+    constexpr bool is_fence(const UnpackedInstr& unpacked) {
+        return unpacked.opcode == Opcode::MEM_STORE && unpacked.rd;
+    }
+
+    // Each core has two operand latches. MEM_LOAD with WR set fills the second
+    // one; COMPUTE_EXEC's RD and WR flags pick the latch read for operand 0 and
+    // operand 1. Programs that leave these flags at 0 only use the first latch.
+    //
+    // COMPUTE_EXEC's row address gives the operands' ElementType (see below);
+    // programs that leave it at 0 multiply whole 32-bit words.
+
      // Helper to get Opcode as string for printing
      inline std::string opcode_to_string(Opcode op) {
          switch (op) {
@@ -73,9 +98,57 @@ namespace instr_format {
          }
      }
 
+    // Mnemonic of a decoded instruction, naming the bank-select and fence forms
+    inline std::string mnemonic(const UnpackedInstr& unpacked) {
+        if (is_bank_select(unpacked)) {
+            return unpacked.wr ? "SET_SEGMENT" : "SET_BANK";
+        }
+        if (is_fence(unpacked)) {
+            return "FENCE";
+        }
+        return opcode_to_string(unpacked.opcode);
+    }
+
 } // namespace instr_format
 
 // Typedef for clarity in the rest of the code
 using InstructionWord = uint32_t;
 
+// Number of addressable cores (CORE_PTR is 6 bits wide)
+constexpr uint32_t NUM_CORES = instr_format::CORE_PTR_MASK + 1;
+
+// Width of the operand elements packed into a memory row
+//
+// A row (and a latch) holds 32 / bits elements side by side, element t in
+// bits [t * bits, (t + 1) * bits) as two's complement. COMPUTE_EXEC with the
+// type in its row address multiplies matching elements of its two operands and
+// adds every product to the accumulator, so one load and one MAC cover
+// elements_per_row() values of k.
+enum class ElementType : uint32_t {
+    INT32 = 0,
+    INT16 = 1,
+    INT8  = 2
+};
+
+constexpr uint32_t element_bits(ElementType type) { return 32u >> static_cast<uint32_t>(type); }
+constexpr uint32_t elements_per_row(ElementType type) { return 1u << static_cast<uint32_t>(type); }
+
+inline const char* element_type_name(ElementType type) {
+    switch (type) {
+        case ElementType::INT16: return "int16";
+        case ElementType::INT8: return "int8";
+        default: return "int32";
+    }
+}
+
+// True when value is representable in the element type
+constexpr bool element_fits(ElementType type, int32_t value) {
+    return type == ElementType::INT32 ||
+           (value >= -(1 << (element_bits(type) - 1)) && value < (1 << (element_bits(type) - 1)));
+}
+
+// Cores are paired into MAC lanes: the even core holds operand buffer 0, the
+// odd core operand buffer 1, and compute/store instructions address the even core
+constexpr uint32_t NUM_LANES = NUM_CORES / 2;
+
 } // namespace pim 
\ No newline at end of file
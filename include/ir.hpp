@@ -1,8 +1,10 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
+#include <memory>
+#include <mutex>
 #include <vector>
-#include <type_traits> // Needed for std::enable_if_t (though we removed its use)
 
 namespace pim {
 
@@ -12,37 +14,128 @@ enum class IROpType {
     LOAD_A_ELEMENT, // Load an element from Matrix A
     LOAD_B_ELEMENT, // Load an element from Matrix B
     EXECUTE_MAC,    // Perform the Multiply-Accumulate operation
-    STORE_C_ELEMENT // Store the result from Accumulator to Matrix C
+    STORE_C_ELEMENT, // Store the result from Accumulator to Matrix C
+    SELECT_BANK,    // Set the low bits of a core's bank register (row = value)
+    SELECT_SEGMENT, // Set the high bits of a core's bank register (row = value)
+    LOAD_ELEMENT,   // Load the element at the global row in row (elementwise lowering)
+    STORE_ELEMENT,  // Store the accumulator to the global row in row (elementwise lowering)
+    FENCE           // Hold the core of target_buffer until every earlier store has reached memory
+};
+
+// Order in which the C[i][j] accumulation chains are visited
+enum class LoopOrder {
+    IJK, // Row-major over C
+    JIK  // Column-major over C
+};
+
+// Loop nest used when generating the IR
+struct LoopSchedule {
+    LoopOrder order = LoopOrder::IJK;
+    // Reverse the middle and inner loops on alternate passes, so that each chain
+    // starts with an operand the previous chain left in a buffer
+    bool serpentine = false;
 };
 
 // Intermediate Representation Operation Structure
+//
+// One 64-bit word, so a chunk of IR is a flat array of integers:
+//
+//   bits   field
+//    0- 3  type
+//       4  target buffer for loads, bank selects and fences (0 or 1)
+//    5- 6  operand latch written by a load (0 or 1); for EXECUTE_MAC, bit 5 is
+//          the latch read from buffer 0 and bit 6 the one read from buffer 1
+//    7-34  col
+//   35-62  row
+//
+// row and col locate the element in its operand: (i, k) for LOAD_A_ELEMENT,
+// (k, j) for LOAD_B_ELEMENT, (i, j) for RESET_ACC and STORE_C_ELEMENT. The
+// elementwise operations keep the global row in row, and bank selects the
+// value written to the bank register.
+// Memory holds at most 2^27 rows, and every index is smaller than the number
+// of elements of some operand, so 28 bits are enough. The lane and batch
+// problem an operation belongs to are those of its tile.
 struct IROperation {
-    IROpType type;
+    static constexpr uint32_t INDEX_BITS = 28;
+    static constexpr uint64_t INDEX_MASK = (uint64_t{1} << INDEX_BITS) - 1;
+    static constexpr uint32_t BUFFER_SHIFT = 4;
+    static constexpr uint32_t LATCH_SHIFT = 5;
+    static constexpr uint32_t COL_SHIFT = 7;
+    static constexpr uint32_t ROW_SHIFT = COL_SHIFT + INDEX_BITS;
+    // Everything but the latch: equal keys load the same element into the same buffer
+    static constexpr uint64_t KEY_MASK = ~(uint64_t{3} << LATCH_SHIFT);
+
+    uint64_t bits = 0;
+
+    IROperation() = default;
+
+    explicit IROperation(IROpType type, uint64_t row = 0, uint64_t col = 0, uint8_t buffer = 0)
+        : bits(static_cast<uint64_t>(type) | (static_cast<uint64_t>(buffer & 1) << BUFFER_SHIFT) |
+               ((col & INDEX_MASK) << COL_SHIFT) | ((row & INDEX_MASK) << ROW_SHIFT)) {}
+
+    IROpType type() const { return static_cast<IROpType>(bits & 0xF); }
+    uint8_t target_buffer() const { return static_cast<uint8_t>((bits >> BUFFER_SHIFT) & 1); }
+    uint8_t latch() const { return static_cast<uint8_t>((bits >> LATCH_SHIFT) & 3); }
+    uint64_t row() const { return (bits >> ROW_SHIFT) & INDEX_MASK; }
+    uint64_t col() const { return (bits >> COL_SHIFT) & INDEX_MASK; }
+
+    void set_latch(uint8_t latch) {
+        bits = (bits & KEY_MASK) | (static_cast<uint64_t>(latch & 3) << LATCH_SHIFT);
+    }
+
+    bool is_load() const { return (LOAD_TYPES >> (bits & 0xF)) & 1; }
+
+private:
+    static constexpr uint32_t LOAD_TYPES = (1u << static_cast<uint32_t>(IROpType::LOAD_A_ELEMENT)) |
+                                           (1u << static_cast<uint32_t>(IROpType::LOAD_B_ELEMENT)) |
+                                           (1u << static_cast<uint32_t>(IROpType::LOAD_ELEMENT));
+};
+
+static_assert(sizeof(IROperation) == 8, "IROperation is one 64-bit word");
 
-    // Operands (relevant fields depend on type)
-    size_t i = 0; // Row index for A or C
-    size_t j = 0; // Col index for B or C
-    size_t k = 0; // Inner dimension index for A or B
-    uint8_t target_buffer = 0; // Target buffer for loads (0 or 1)
+// Storage for the IR of one stream: the chunk handed from pass to pass and
+// the passes' working buffers. reset() empties them but keeps the capacity,
+// so a stream given a recycled arena does not allocate for its IR.
+struct IRArena {
+    std::vector<IROperation> chunk;   // Operations being generated and optimized
+    std::vector<IROperation> scratch; // Bank-select output, swapped with chunk
+    std::vector<IROperation> pending; // Held back by the scheduling pass
 
-    // Constructor for operations without extra operands (like EXECUTE_MAC)
-    explicit IROperation(IROpType t) : type(t) {
-        // Optionally add checks: assert(t == IROpType::EXECUTE_MAC);
+    void reset() {
+        chunk.clear();
+        scratch.clear();
+        pending.clear();
     }
 
-    // Constructor for Load operations
-    IROperation(IROpType t, size_t r_or_k, size_t k_or_c, uint8_t buf) : type(t), target_buffer(buf) {
-        // Assign indices based on the type
-        if (type == IROpType::LOAD_A_ELEMENT) { i = r_or_k; k = k_or_c; }
-        else if (type == IROpType::LOAD_B_ELEMENT) { k = r_or_k; j = k_or_c; }
-        // Optionally add checks: assert(t == IROpType::LOAD_A_ELEMENT || t == IROpType::LOAD_B_ELEMENT);
+    size_t bytes() const {
+        return (chunk.capacity() + scratch.capacity() + pending.capacity()) * sizeof(IROperation);
+    }
+};
+
+// Arenas recycled from stream to stream and from compile to compile. Safe to
+// share between threads.
+class IRArenaPool {
+public:
+    // An idle arena, reset, or a new one
+    std::unique_ptr<IRArena> acquire() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (idle_.empty()) {
+            return std::unique_ptr<IRArena>(new IRArena());
+        }
+        std::unique_ptr<IRArena> arena = std::move(idle_.back());
+        idle_.pop_back();
+        arena->reset();
+        return arena;
     }
 
-     // Constructor for Reset/Store operations
-     IROperation(IROpType t, size_t r_idx, size_t c_idx) : type(t), i(r_idx), j(c_idx) {
-        // Optionally add checks: assert(t == IROpType::RESET_ACC || t == IROpType::STORE_C_ELEMENT);
-     }
+    void release(std::unique_ptr<IRArena> arena) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        idle_.push_back(std::move(arena));
+    }
 
+private:
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<IRArena>> idle_;
 };
 
 } // namespace pim 
\ No newline at end of file
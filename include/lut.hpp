@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "compiler.hpp"
+#include "matrix_io.hpp"
+#include "memory_plan.hpp"
+#include "pipeline.hpp"
+#include "scheduler.hpp"
+
+namespace pim {
+
+// Table-lookup lowering for B with few distinct values (e.g. 2-4 bit weights)
+//
+// B is known at compile time, so every product A[i][k] * B[k][j] is one of a
+// few multiples of A[i][k]. A LUT tile first computes those multiples into a
+// table (LutBlock) and then sums table rows instead of multiplying: a chain
+// costs one load and one MAC per nonzero group instead of two loads and a MAC
+// per k, zero weights cost nothing, and equal rows and columns of B are
+// computed once. The tables cost a chain per A row and entry, so they pay off
+// on wide tiles and on B with repeated rows or columns.
+//
+// A column block qualifies when it has at most options.lut_values distinct
+// nonzero values. A tile of it gets the LUT lowering when its estimated cycles
+// are fewer than tiling_cost gives its MAC lowering and its table fits in
+// memory; other tiles keep the MAC lowering. The tables, and the constant rows
+// of every lane with a LUT tile, are scratch space appended to plan, each on
+// banks of its own so the lanes do not queue on one bank. The plan depends on
+// B's values, so it cannot be rebuilt from the shape alone.
+class LutLowering {
+public:
+    LutLowering(MemoryPlan& plan, const TilePlan& tiling, const Matrix& matrix_b, const CompileOptions& options);
+
+    LutLowering(const LutLowering&) = delete;
+    LutLowering& operator=(const LutLowering&) = delete;
+
+    // Job of the tile, or null when it keeps the MAC lowering
+    const LutJob* job(const Tile& tile) const {
+        const LutJob& job = jobs_[(tile.row_begin / tile_rows_) * grid_cols_ + tile.col_begin / tile_cols_];
+        return job.block ? &job : nullptr;
+    }
+
+    size_t tile_count() const { return tile_count_; }
+    uint64_t table_rows() const { return table_rows_; }
+
+private:
+    std::vector<LutBlock> blocks_; // One per column block
+    std::vector<LutJob> jobs_;     // One per tile, row-major over the tile grid
+    size_t tile_rows_ = 1;
+    size_t tile_cols_ = 1;
+    size_t grid_cols_ = 1;
+    size_t tile_count_ = 0;
+    uint64_t table_rows_ = 0;
+};
+
+} // namespace pim
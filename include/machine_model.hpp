@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+
+namespace pim {
+
+// Latencies of the PIM machine, in cycles
+//
+// The instruction scheduler plans with these numbers and the simulator times
+// programs with them, so a program scheduled for one model runs best on it.
+struct MachineModel {
+    uint32_t load_latency = 4;   // Cycles from MEM_LOAD issue until the latch is valid
+    uint32_t store_latency = 4;  // Cycles until a MEM_STORE has reached memory
+    uint32_t mac_latency = 1;    // Cycles until COMPUTE_EXEC's accumulator is valid
+    uint32_t setup_latency = 1;  // Cycles until COMPUTE_SETUP's accumulator is valid
+    uint32_t bank_cycles = 2;    // Cycles a bank is occupied per access
+};
+
+} // namespace pim
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace pim {
+
+// Read-only view of a whole file
+//
+// The file is memory-mapped where the platform allows it, and read into
+// memory otherwise. Either way data() stays valid for the object's lifetime.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const unsigned char* data() const { return data_; }
+    size_t size() const { return length_; }
+    bool mapped() const { return mapped_; }
+
+private:
+    const unsigned char* data_ = nullptr;
+    size_t length_ = 0;
+    bool mapped_ = false;
+    std::vector<unsigned char> copy_; // Backing store when the file is not mapped
+};
+
+} // namespace pim
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace pim {
+
+// Dense row-major int32 matrix
+//
+// The elements are immutable and shared between copies. They live either in
+// an owned buffer or directly in a memory-mapped .npy file.
+class Matrix {
+public:
+    Matrix() = default;
+
+    // Takes ownership of rows * cols row-major elements
+    Matrix(size_t rows, size_t cols, std::vector<int32_t> elements);
+
+    // Copies a nested vector; throws if the rows are not all the same length
+    static Matrix from_rows(const std::vector<std::vector<int>>& rows);
+
+    size_t rows() const { return rows_; }
+    size_t cols() const { return cols_; }
+    bool empty() const { return rows_ == 0 || cols_ == 0; }
+
+    const int32_t* data() const { return data_; }
+    const int32_t* row(size_t i) const { return data_ + i * cols_; }
+    int32_t operator()(size_t i, size_t j) const { return data_[i * cols_ + j]; }
+
+    bool operator==(const Matrix& other) const;
+    bool operator!=(const Matrix& other) const { return !(*this == other); }
+
+private:
+    friend Matrix read_npy(const std::string& filename);
+
+    size_t rows_ = 0;
+    size_t cols_ = 0;
+    const int32_t* data_ = nullptr;
+    std::shared_ptr<const void> owner_; // Keeps the buffer or the mapping alive
+};
+
+// Parses matrix_a and matrix_b from a C++ source file, e.g.
+//   std::vector<std::vector<int>> matrix_a = {{ 1, 2 }, { 3, 4 }};
+// The file is mapped and scanned once; definitions may span lines, and
+// // and /* */ comments are skipped. Throws with a line number on bad input.
+std::pair<Matrix, Matrix> parse_matrix_file(const std::string& filename);
+
+// Reads a 2-D .npy array of little-endian int32, int16 or int8. C-ordered
+// int32 data is used in place from the mapped file; anything else is converted.
+Matrix read_npy(const std::string& filename);
+
+// Writes a C-ordered int32 .npy file (format version 1.0)
+void write_npy(const std::string& filename, const Matrix& matrix);
+
+// Reads A and B from one C++ source file, two .npy files or two Matrix Market
+// (.mtx) files
+std::pair<Matrix, Matrix> read_matrix_inputs(const std::vector<std::string>& paths);
+
+// Reads a batch manifest: one problem per line, given as the one or two input
+// files read_matrix_inputs takes, separated by whitespace. Relative paths are
+// resolved against the manifest's directory; blank lines and # comments are
+// skipped.
+std::vector<std::pair<Matrix, Matrix>> read_batch_inputs(const std::string& manifest);
+
+} // namespace pim
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "matrix_io.hpp"
+#include "memory_plan.hpp"
+
+namespace pim {
+
+// Memory initialization image (.pimi)
+//
+// The rows the host writes before a program runs: every copy of the A and B
+// blocks a memory plan placed, packed to the plan's element type, and its
+// constant rows. Everything else, C included, starts at zero, so an image and
+// a program container make a standalone run.
+//
+//   offset  size  field
+//        0     4  magic "PIMI"
+//        4     4  format version
+//        8     8  rows_per_bank, num_banks
+//       16     8  segment count
+//       24     8  rows over all segments
+//
+// Each segment follows as an 8-byte first row, an 8-byte row count and the
+// rows as little-endian 32-bit words.
+constexpr uint32_t MEMORY_IMAGE_FORMAT_VERSION = 1;
+constexpr size_t MEMORY_IMAGE_HEADER_BYTES = 32;
+constexpr char MEMORY_IMAGE_MAGIC[5] = "PIMI";
+
+class MemoryImage {
+public:
+    // Consecutive rows starting at first_row
+    struct Segment {
+        uint64_t first_row = 0;
+        std::vector<int32_t> rows;
+    };
+
+    MemoryImage() = default;
+    explicit MemoryImage(const MemoryGeometry& geometry) : geometry_(geometry) {}
+
+    // Adds the rows memory_plan places for A and B. Throws if the matrices do
+    // not match the plan's shape or an element does not fit its element type.
+    void add(const MemoryPlan& memory_plan, const Matrix& matrix_a, const Matrix& matrix_b);
+
+    const MemoryGeometry& geometry() const { return geometry_; }
+    const std::vector<Segment>& segments() const { return segments_; }
+    uint64_t row_count() const;
+    uint64_t file_bytes() const;
+
+    void write(const std::string& path) const;
+    static MemoryImage read(const std::string& path);
+
+private:
+    // Segment for rows starting at first_row; extends the last one when they are adjacent
+    std::vector<int32_t>& segment_at(uint64_t first_row);
+
+    MemoryGeometry geometry_;
+    std::vector<Segment> segments_;
+};
+
+} // namespace pim
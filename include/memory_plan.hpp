@@ -0,0 +1,186 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "instruction.hpp"
+#include "scheduler.hpp"
+
+namespace pim {
+
+// Physical memory organization
+//
+// ROW_ADDR only reaches rows_per_bank rows, so each core carries a bank
+// register that is written by SET_BANK (low 9 bits of the bank number) and
+// SET_SEGMENT (high 9 bits). A global row g lives at bank g / rows_per_bank,
+// row g % rows_per_bank.
+struct MemoryGeometry {
+    uint32_t rows_per_bank = instr_format::ROW_ADDR_MASK + 1; // At most 512
+    uint32_t num_banks = 4096;                                // At most 2^18
+
+    uint64_t total_rows() const { return static_cast<uint64_t>(rows_per_bank) * num_banks; }
+
+    // Throws if the geometry cannot be addressed by the instruction format
+    void validate() const;
+};
+
+// Bank number split into the fields written by SET_SEGMENT / SET_BANK
+constexpr uint32_t BANK_SELECT_BITS = 9;
+constexpr uint32_t BANK_SELECT_MASK = (1u << BANK_SELECT_BITS) - 1;
+constexpr uint32_t MAX_BANKS = 1u << (2 * BANK_SELECT_BITS);
+
+// How the planner placed the operand blocks
+enum class PlacementMode {
+    REPLICATED, // Every lane has private copies of its A and B blocks on banks of its own
+    SPREAD,     // One copy of each block, every block group starting on a fresh bank
+    PACKED      // Blocks packed back to back
+};
+
+// Placement of A, B and C in PIM memory
+//
+// Operands are cut along the tiling: A into row blocks (one per tile row),
+// B into column blocks stored column-major (so a C[i][j] chain walks
+// consecutive rows), C into its tiles. The even core of a lane both loads A
+// and stores C, so C tiles sit in the banks of their A block, while B goes to
+// separate banks because the odd core loads it concurrently.
+//
+// Lanes sharing a tile row (or column) read the same A (or B) block, which
+// would serialize them on one bank. When the geometry allows it the planner
+// gives each lane private copies of its blocks (REPLICATED); otherwise it keeps
+// one copy per block on a fresh bank (SPREAD), and as a last resort packs
+// everything back to back (PACKED).
+//
+// With a narrow element type, elements_per_row() consecutive k of an A row or
+// B column share a memory row, so every A row and B column takes k_rows()
+// rows. The k the addresses take counts those rows. C stays one element per row.
+class MemoryPlan {
+public:
+    MemoryPlan() = default;
+
+    // Lays out C = A (rows_a x cols_a) x B (cols_a x cols_b) for the given tiling,
+    // from base_row on, trying no layout more conflict-free than best (batches
+    // place one plan after another). Throws if the operands do not fit the geometry.
+    static MemoryPlan build(const MemoryGeometry& geometry,
+                            size_t rows_a, size_t cols_a, size_t cols_b,
+                            const TilePlan& tiling, uint64_t base_row = 0,
+                            PlacementMode best = PlacementMode::REPLICATED,
+                            ElementType element_type = ElementType::INT32);
+
+    // Global row of each element as seen by the given lane; k is the row
+    // within the A row or B column (k / elements_per_row() of a packed k)
+    uint64_t address_a(uint32_t lane, size_t i, size_t k) const {
+        size_t block = i / tile_rows_;
+        return a_blocks_[lane * a_lane_stride_ + block] + (i - block * tile_rows_) * k_rows_ + k;
+    }
+    uint64_t address_b(uint32_t lane, size_t k, size_t j) const {
+        size_t block = j / tile_cols_;
+        return b_blocks_[lane * b_lane_stride_ + block] + (j - block * tile_cols_) * k_rows_ + k;
+    }
+    uint64_t address_c(size_t i, size_t j) const {
+        size_t block_row = i / tile_rows_;
+        size_t block_col = j / tile_cols_;
+        size_t col_begin = block_col * tile_cols_;
+        size_t width = std::min(tile_cols_, cols_b_ - col_begin);
+        return c_tiles_[block_row * grid_cols_ + block_col] +
+               (i - block_row * tile_rows_) * width + (j - col_begin);
+    }
+
+    uint32_t bank_of(uint64_t global_row) const {
+        return static_cast<uint32_t>(global_row / geometry_.rows_per_bank);
+    }
+    uint32_t row_of(uint64_t global_row) const {
+        return static_cast<uint32_t>(global_row % geometry_.rows_per_bank);
+    }
+
+    // Every placed copy of an A row block or B column block (the host or the
+    // image emitter has to fill all of them)
+    struct BlockCopy {
+        size_t block = 0;
+        uint64_t base = 0;
+    };
+    const std::vector<BlockCopy>& a_copies() const { return a_copies_; }
+    const std::vector<BlockCopy>& b_copies() const { return b_copies_; }
+
+    // Appends the row of every copy of A[i][k] / B[k][j] to rows
+    void copies_of_a(size_t i, size_t k, std::vector<uint64_t>& rows) const;
+    void copies_of_b(size_t k, size_t j, std::vector<uint64_t>& rows) const;
+
+    // Rows the host has to initialize besides A and B
+    struct ConstantRow {
+        uint64_t row = 0;
+        int32_t value = 0;
+    };
+    const std::vector<ConstantRow>& constants() const { return constants_; }
+
+    // Appends rows of scratch space after everything placed so far, starting
+    // on a fresh bank; returns its first row. Throws if the geometry has no room.
+    uint64_t append_scratch(uint64_t rows);
+
+    // Asks the host to store value at row before the program runs
+    void add_constant(uint64_t row, int32_t value) { constants_.push_back(ConstantRow{row, value}); }
+
+    const MemoryGeometry& geometry() const { return geometry_; }
+    size_t rows_a() const { return rows_a_; }
+    size_t cols_a() const { return cols_a_; }
+    size_t cols_b() const { return cols_b_; }
+    ElementType element_type() const { return element_type_; }
+    size_t elements_per_row() const { return pim::elements_per_row(element_type_); }
+    size_t k_rows() const { return k_rows_; } // Rows of each A row and B column
+    size_t tile_rows() const { return tile_rows_; }
+    size_t tile_cols() const { return tile_cols_; }
+
+    // Footprint of each operand (rows including copies, and distinct banks
+    // touched), followed by the scratch space when there is any
+    struct RegionUsage {
+        std::string name;
+        uint64_t rows = 0;
+        uint32_t banks = 0;
+    };
+    std::vector<RegionUsage> usage() const;
+
+    uint64_t base_row() const { return base_row_; }
+    uint64_t rows_used() const { return rows_used_; } // End of the plan's rows, counted from row 0
+    PlacementMode mode() const { return mode_; }
+
+private:
+    size_t a_block_rows(size_t block) const { return std::min(tile_rows_, rows_a_ - block * tile_rows_); }
+    size_t b_block_cols(size_t block) const { return std::min(tile_cols_, cols_b_ - block * tile_cols_); }
+
+    MemoryGeometry geometry_;
+    size_t rows_a_ = 0;
+    size_t cols_a_ = 0;
+    size_t cols_b_ = 0;
+    ElementType element_type_ = ElementType::INT32;
+    size_t k_rows_ = 0;
+    size_t tile_rows_ = 1;
+    size_t tile_cols_ = 1;
+    size_t grid_cols_ = 1;
+    // Base row of A row blocks / B column blocks, indexed lane * stride + block;
+    // the stride is 0 unless blocks are replicated per lane
+    std::vector<uint64_t> a_blocks_;
+    std::vector<uint64_t> b_blocks_;
+    size_t a_lane_stride_ = 0;
+    size_t b_lane_stride_ = 0;
+    std::vector<uint64_t> c_tiles_;  // Base row of each C tile, row-major over the tile grid
+    std::vector<BlockCopy> a_copies_;
+    std::vector<BlockCopy> b_copies_;
+    std::vector<ConstantRow> constants_;
+    uint64_t scratch_begin_ = 0; // Scratch rows are [scratch_begin_, rows_used_) when scratch_rows_ > 0
+    uint64_t scratch_rows_ = 0;
+    uint64_t base_row_ = 0;
+    uint64_t rows_used_ = 0;
+    PlacementMode mode_ = PlacementMode::PACKED;
+};
+
+// Tiling of C = A x B for the memory plan: plan_tiles, except that when the
+// automatic tiling leaves no room for per-lane copies, the other automatic
+// tile sizes are tried in order, and the first whose copies fit wins. Lanes
+// sharing one copy of a block serialize on its bank, which costs far more
+// than a less even tiling. Explicit tile sizes are kept as given.
+TilePlan plan_replicable_tiles(const MemoryGeometry& geometry, size_t rows_a, size_t cols_a, size_t cols_b,
+                               uint32_t num_cores, size_t tile_rows = 0, size_t tile_cols = 0,
+                               ElementType element_type = ElementType::INT32);
+
+} // namespace pim
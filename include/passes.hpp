@@ -0,0 +1,153 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "ir.hpp"
+#include "machine_model.hpp"
+#include "memory_plan.hpp"
+
+namespace pim {
+
+// Load counts reported by the operand-reuse pass
+struct OperandReuseStats {
+    size_t loads_before = 0;     // LOAD_A/LOAD_B/LOAD_ELEMENT operations seen
+    size_t loads_eliminated = 0; // Loads dropped because the buffer already held the value
+};
+
+// Operand-reuse pass
+//
+// A single accumulator per lane means C[i][j] has to be finished before the
+// next chain starts, so reuse is only possible where neighbouring chains meet.
+// schedule() picks a serpentine loop nest so every chain begins with the
+// operand its predecessor ended on; run() tracks what each target_buffer holds
+// and removes loads that would write the value already there.
+class OperandReusePass {
+public:
+    // Loop schedule that maximizes reuse for an rows_a x cols_b tile of C. The
+    // savings do not depend on K, so the inner dimension is not an input.
+    static LoopSchedule schedule(size_t rows_a, size_t cols_b);
+
+    // Removes redundant loads in place; buffer state carries over between calls
+    void run(std::vector<IROperation>& ir_code);
+
+    const OperandReuseStats& stats() const { return stats_; }
+
+private:
+    // Key (IROperation::KEY_MASK) of the load that last filled each buffer;
+    // all ones, which no key is, while a buffer holds nothing known
+    uint64_t held_[2] = {~uint64_t{0}, ~uint64_t{0}};
+    OperandReuseStats stats_;
+};
+
+// Bank-select pass
+//
+// Inserts SELECT_SEGMENT / SELECT_BANK operations in front of every load or
+// store whose bank differs from the one the issuing core last selected. A new
+// pass knows nothing about the bank registers, so the first access of each
+// core always selects its bank. Runs over the operations of one lane, using
+// scratch (e.g. IRArena::scratch) as its output buffer.
+class BankSelectPass {
+public:
+    BankSelectPass(const MemoryPlan& plan, uint32_t lane, std::vector<IROperation>& scratch)
+        : plan_(plan), lane_(lane), scratch_(scratch) {}
+
+    void run(std::vector<IROperation>& ir_code);
+
+    size_t selects_inserted() const { return selects_inserted_; }
+
+private:
+    const MemoryPlan& plan_;
+    uint32_t lane_;
+    uint32_t core_bank_[2] = {}; // Bank register of each core of the lane
+    bool core_known_[2] = {};
+    size_t selects_inserted_ = 0;
+    std::vector<IROperation>& scratch_; // Output buffer, swapped with the input each run
+};
+
+// Counters reported by the scheduling pass. Cycle counts are the pass's own
+// estimate, summed over windows: the same operations in generation order
+// versus the order it picked.
+struct ScheduleStats {
+    size_t windows = 0;
+    uint64_t cycles_before = 0;
+    uint64_t cycles_after = 0;
+};
+
+// Scheduling pass
+//
+// Every core has two operand latches. The pass renames each lane's loads onto
+// them alternately, so the load of the next operand can be in flight while a
+// MAC still reads the current one. It then builds a dependency DAG over a
+// window of operations (RAW, WAR and WAW on the latches, the accumulator and
+// memory rows; a FENCE after the window's earlier stores and before its later
+// loads) and list-schedules it: one issue per core per cycle, a bank
+// busy for bank_cycles per access, result latencies from the machine model,
+// longest remaining path first. This software-pipelines the k loop and lets
+// the next chain's loads overlap the previous chain's store.
+//
+// Windows are WINDOW_OPS operations counted from the start of the tile, so
+// the result does not depend on how the stream was chunked. Operations of an
+// unfinished window are held back until more arrive or flush() is called.
+// Must run before the bank-select pass. Runs over the operations of one lane
+// and holds them back in pending (e.g. IRArena::pending).
+class SchedulePass {
+public:
+    static constexpr size_t WINDOW_OPS = 512;
+
+    SchedulePass(const MemoryPlan& plan, uint32_t lane, const MachineModel& machine,
+                 std::vector<IROperation>& pending)
+        : plan_(plan), lane_(lane), machine_(machine), pending_(pending) {}
+
+    // Replaces ir_code with the scheduled windows completed so far
+    void run(std::vector<IROperation>& ir_code);
+
+    // Appends the scheduled remainder to ir_code
+    void flush(std::vector<IROperation>& ir_code);
+
+    const ScheduleStats& stats() const { return stats_; }
+
+private:
+    struct Edge {
+        uint32_t to;
+        uint32_t latency;
+    };
+    struct Node {
+        uint8_t side = 0;      // Core of the lane issuing the operation
+        bool memory = false;   // Loads and stores occupy a bank
+        uint32_t bank = 0;
+        uint64_t address = 0;
+        uint32_t latency = 1;  // Cycles until its result can be used
+        uint32_t preds = 0;    // Predecessors not yet scheduled
+        uint64_t earliest = 0; // First cycle all inputs are ready
+        uint64_t height = 0;   // Longest latency path to the end of the window
+        uint64_t cycle = 0;    // Issue cycle picked
+    };
+    // Last writer and readers since of a latch, the accumulator or a memory row
+    struct Resource {
+        int64_t writer = -1;
+        std::vector<uint32_t> readers;
+    };
+
+    void rename(IROperation& ir_op);
+    void schedule_window(size_t begin, size_t end, std::vector<IROperation>& out);
+
+    const MemoryPlan& plan_;
+    uint32_t lane_;
+    MachineModel machine_;
+    std::vector<IROperation>& pending_; // Renamed, not yet scheduled
+    uint8_t next_latch_[2] = {};       // Latch the next load of each buffer fills
+    uint8_t held_latch_[2] = {};       // Latch holding each buffer's current operand
+    ScheduleStats stats_;
+
+    // Per-window scratch, kept to reuse the allocations
+    std::vector<Node> nodes_;
+    std::vector<std::vector<Edge>> succs_;
+    std::vector<uint32_t> ready_;
+    std::vector<uint32_t> order_;
+    std::unordered_map<uint64_t, Resource> rows_;
+    std::unordered_map<uint32_t, uint64_t> bank_free_;
+};
+
+} // namespace pim
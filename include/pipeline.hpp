@@ -0,0 +1,287 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "compile_stats.hpp"
+#include "ir.hpp"
+#include "memory_plan.hpp"
+#include "passes.hpp"
+#include "scheduler.hpp"
+#include "sparse.hpp"
+
+namespace pim {
+
+// Source of a tile's IR, a chunk at a time
+class IRGenerator {
+public:
+    virtual ~IRGenerator() = default;
+
+    // Appends up to max_ops operations to out; returns how many were appended
+    virtual size_t generate(std::vector<IROperation>& out, size_t max_ops) = 0;
+
+    virtual bool done() const = 0;
+};
+
+// Resumable IR generator for one tile
+//
+// Emits one RESET/LOAD/MAC/STORE chain per C[i][j] of the tile, in the order
+// given by the loop schedule. The position is a (chain, step) pair, so
+// generation can stop after any operation and pick up there on the next call.
+// With operand values (the sparse lowering) a chain only covers the k where
+// A[i][k] and B[k][j] are both nonzero; a chain with none is RESET + STORE.
+// cols_a counts rows of packed elements, MemoryPlan::k_rows(), for a dense
+// chain.
+class TileIRGenerator : public IRGenerator {
+public:
+    TileIRGenerator(const Tile& tile, size_t cols_a, const LoopSchedule& loop_schedule,
+                    const SparseOperands* sparse = nullptr);
+
+    size_t generate(std::vector<IROperation>& out, size_t max_ops) override;
+
+    bool done() const override { return chain_ == chain_count_; }
+
+    // Operations in a dense chain: RESET, three per k, STORE
+    size_t ops_per_chain() const { return 3 * cols_a_ + 2; }
+
+private:
+    Tile tile_;
+    size_t cols_a_;
+    LoopSchedule loop_schedule_;
+    const SparseOperands* sparse_;
+    std::vector<uint32_t> chain_k_;  // Nonzero k of the current chain (sparse only)
+    size_t prepared_chain_ = SIZE_MAX; // Chain chain_k_ belongs to
+    size_t middle_count_;
+    size_t chain_count_;
+    size_t chain_ = 0; // Current chain
+    size_t step_ = 0;  // Position within the chain
+};
+
+// Element (i, j) of operand 'A', 'B' or 'C' of a memory plan, seen through a
+// window at (row_offset, col_offset). For B, i is the k index. Elements beyond
+// rows x cols do not exist: they read as zero and are never written. Reads
+// go to lane 0's copy, so only a plan without replicated blocks can be read.
+struct MatrixView {
+    const MemoryPlan* plan = nullptr;
+    char operand = 'C';
+    size_t row_offset = 0;
+    size_t col_offset = 0;
+    size_t rows = 0;
+    size_t cols = 0;
+
+    bool contains(size_t i, size_t j) const { return i < rows && j < cols; }
+    uint64_t address(size_t i, size_t j) const {
+        size_t row = row_offset + i;
+        size_t col = col_offset + j;
+        return operand == 'A' ? plan->address_a(0, row, col)
+             : operand == 'B' ? plan->address_b(0, row, col)
+             : plan->address_c(row, col);
+    }
+    // Every copy of the element, as a writer has to update them all
+    void copies(size_t i, size_t j, std::vector<uint64_t>& rows) const {
+        size_t row = row_offset + i;
+        size_t col = col_offset + j;
+        if (operand == 'A') plan->copies_of_a(row, col, rows);
+        else if (operand == 'B') plan->copies_of_b(row, col, rows);
+        else rows.push_back(plan->address_c(row, col));
+    }
+};
+
+// Signed sum of matrix blocks, out = sum of +/- sources, over rows x cols
+//
+// Lowered with the MAC lanes: each output element is a chain that loads
+// every source element next to a +1 or -1 operand and accumulates the
+// products. Lane l finds +1 at row constants + 2l and -1 right after it.
+struct ElementwiseJob {
+    struct Term {
+        MatrixView source;
+        bool negate = false;
+    };
+    MatrixView out;
+    std::vector<Term> terms;
+    size_t rows = 0;
+    size_t cols = 0;
+    uint64_t constants = 0;
+};
+
+// Resumable IR generator for one tile of an elementwise job
+//
+// A chain is RESET, LOAD_ELEMENT source / LOAD_ELEMENT sign / MAC per term
+// present at (i, j), and a STORE_ELEMENT per copy of the output element. Odd
+// chains take the terms in reverse, so a chain starts with the sign its
+// predecessor ended on and the operand-reuse pass drops that constant load.
+class ElementwiseIRGenerator : public IRGenerator {
+public:
+    ElementwiseIRGenerator(const Tile& tile, const ElementwiseJob& job);
+
+    size_t generate(std::vector<IROperation>& out, size_t max_ops) override;
+
+    bool done() const override { return chain_ == chain_count_; }
+
+private:
+    Tile tile_;
+    const ElementwiseJob& job_;
+    std::vector<const ElementwiseJob::Term*> chain_terms_; // Terms present in the current chain
+    std::vector<uint64_t> chain_outputs_;                  // Rows the current chain stores to
+    size_t prepared_chain_ = SIZE_MAX;
+    size_t chain_count_;
+    size_t chain_ = 0;
+    size_t step_ = 0;
+};
+
+// B's values over one column block, grouped for the LUT lowering (lut.hpp)
+//
+// The rows of the block that are equal form a group, and a table entry is a
+// group g with one of the nonzero values v of its row. Each A row i gets a
+// table holding v * (sum over k in g of A[i][k]) per entry, so C[i][j] sums
+// one table row for every group where B[g][j] is nonzero. Equal columns of
+// the block share their sum.
+struct LutBlock {
+    struct Entry {
+        uint32_t group = 0;
+        uint32_t constant = 0; // Index of v among the lowering's constant rows
+    };
+    std::vector<uint32_t> group_begin;    // groups + 1 offsets into group_k
+    std::vector<uint32_t> group_k;        // k of every group, ascending
+    std::vector<Entry> entries;           // Ordered by group
+    std::vector<uint32_t> column_begin;   // distinct columns + 1 offsets into column_entries
+    std::vector<uint32_t> column_entries; // Entries each distinct column sums, by group
+    std::vector<uint32_t> copy_begin;     // distinct columns + 1 offsets into copies
+    std::vector<uint32_t> copies;         // Columns of C equal to each distinct column
+
+    size_t columns() const { return column_begin.size() - 1; }
+};
+
+// A tile lowered with lookups: its table rows and the lane's constant rows
+struct LutJob {
+    const LutBlock* block = nullptr;
+    uint64_t table = 0;     // Entry e of the table of row i is at table + (i - row_begin) * entries + e
+    uint64_t constants = 0; // Row of constant 0 for the tile's lane
+    uint32_t one = 0;       // Index of the +1 constant
+};
+
+// Resumable IR generator for a LUT tile
+//
+// First the tables: a chain per (i, entry) that multiplies the group's A
+// elements by the entry's constant and stores the result with STORE_ELEMENT.
+// Then a FENCE on both cores, so no lookup issues before the table stores have
+// landed, and the products: a chain per (i, distinct column) that loads each
+// table row it needs next to +1, and stores C to every copy of the column.
+class LutIRGenerator : public IRGenerator {
+public:
+    LutIRGenerator(const Tile& tile, const LutJob& job);
+
+    size_t generate(std::vector<IROperation>& out, size_t max_ops) override;
+
+    bool done() const override { return chain_ == table_chains_ + product_chains_; }
+
+private:
+    // Fills chain_ops_ with the operations of chain chain_
+    void prepare_chain();
+
+    Tile tile_;
+    const LutJob& job_;
+    size_t table_chains_;
+    size_t product_chains_;
+    std::vector<IROperation> chain_ops_;
+    size_t prepared_chain_ = SIZE_MAX;
+    size_t chain_ = 0;
+    size_t step_ = 0;
+};
+
+class LutLowering;
+
+// Counters collected while streaming
+struct PipelineStats {
+    size_t ir_ops = 0; // Operations generated, before passes
+    OperandReuseStats operand_reuse;
+    ScheduleStats schedule;
+    size_t bank_selects = 0;
+    size_t sparse_tiles = 0; // Tiles given the sparse lowering
+    size_t lut_tiles = 0;    // Tiles given the LUT lowering
+    double generate_seconds = 0;
+    PassStats reuse_pass;
+    PassStats schedule_pass;
+    PassStats bank_pass;
+    double refill_seconds = 0; // All of the above, as spent inside next()
+    std::array<size_t, IR_OP_TYPES> ops_by_type{}; // Operations handed out
+};
+
+// IR stream of one lane: its tiles in order, generated a chunk at a time and
+// run through the per-tile passes before being handed out. Each tile is
+// compiled against memory_plans[tile.problem]. A null machine model skips the
+// scheduling pass. With operand values, each tile whose
+// product density is at most sparse->threshold gets the sparse lowering.
+// With jobs, every tile is a tile of the elementwise job jobs[tile.problem].
+// With a LUT lowering, the tiles it picked get table lookups instead of MACs.
+// The IR lives in arena, or in an arena of the stream's own when it is null.
+class LaneStream {
+public:
+    LaneStream(const std::vector<Tile>& tiles, const std::vector<const MemoryPlan*>& memory_plans,
+               bool operand_reuse, size_t chunk_ops, const MachineModel* machine = nullptr,
+               const SparseOperands* sparse = nullptr, const std::vector<ElementwiseJob>* jobs = nullptr,
+               const LutLowering* lut = nullptr, IRArena* arena = nullptr);
+
+    LaneStream(const LaneStream&) = delete;
+    LaneStream& operator=(const LaneStream&) = delete;
+
+    // Next optimized operation of the lane; false once every tile is exhausted
+    bool next(IROperation& ir_op) {
+        if (cursor_ == chunk_.size() && !refill()) {
+            return false;
+        }
+        ir_op = chunk_[cursor_++];
+        return true;
+    }
+
+    // Tile of the operation next() returned last, which gives its lane and problem
+    const Tile& tile() const { return tiles_[chunk_tile_]; }
+
+    const PipelineStats& stats() const { return stats_; }
+
+    // Bytes held by the IR buffers
+    size_t buffer_bytes() const { return arena_.bytes(); }
+
+private:
+    // Generates and optimizes the next chunk; false when the lane is finished
+    bool refill();
+    void start_tile();
+    void finish_tile();
+
+    const std::vector<Tile>& tiles_;
+    const std::vector<const MemoryPlan*>& memory_plans_;
+    bool operand_reuse_;
+    size_t chunk_ops_;
+    const MachineModel* machine_;
+    const SparseOperands* sparse_;
+    const std::vector<ElementwiseJob>* jobs_;
+    const LutLowering* lut_;
+
+    size_t tile_index_ = 0;
+    std::unique_ptr<IRGenerator> generator_;
+    std::unique_ptr<OperandReusePass> reuse_pass_;
+    std::unique_ptr<SchedulePass> schedule_pass_;
+    std::unique_ptr<BankSelectPass> bank_pass_;
+
+    std::unique_ptr<IRArena> own_arena_;
+    IRArena& arena_;
+    std::vector<IROperation>& chunk_; // arena_.chunk
+    size_t chunk_tile_ = 0;           // Tile the operations in chunk_ come from
+    size_t cursor_ = 0;
+    PipelineStats stats_;
+};
+
+// Part of a program: tiles interleaved over the lanes like a whole program.
+// Phases run one after another. A phase that reads what earlier ones stored
+// sets fence, so it opens with a FENCE on every core it uses.
+struct ProgramPhase {
+    const TilePlan* tiling = nullptr;
+    std::vector<const MemoryPlan*> plans;              // Indexed by Tile::problem
+    const std::vector<ElementwiseJob>* jobs = nullptr; // Elementwise jobs instead of products
+    const LutLowering* lut = nullptr;                  // Table lookups for the tiles it picked
+    bool fence = false;                                // Wait for the earlier phases' stores
+};
+
+} // namespace pim
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "compiler.hpp"
+#include "program_file.hpp"
+
+namespace pim {
+
+// Size limits of a ProgramCache (container bytes)
+struct ProgramCacheLimits {
+    uint64_t memory_bytes = 256ull << 20; // Programs kept loaded
+    uint64_t disk_bytes = 4ull << 30;     // Programs kept in the cache directory
+};
+
+// Counters since the cache was created
+struct ProgramCacheStats {
+    uint64_t memory_hits = 0;
+    uint64_t disk_hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0; // Programs dropped from memory or deleted from disk
+};
+
+// Compiled programs keyed by shape, the options that affect code generation
+// and COMPILER_REVISION
+//
+// Dense programs never depend on the matrix values, so one compilation serves
+// every multiplication of that shape; get() refuses options that ask for the
+// sparse lowering. Loaded programs are kept in memory, least
+// recently used first out. With a directory, every program is also written
+// there as <key>.pimb and mapped back on later runs. A file's modification
+// time records its last use, so the oldest files are deleted first when the
+// directory grows past its limit.
+class ProgramCache {
+public:
+    explicit ProgramCache(const std::string& directory = "",
+                          const ProgramCacheLimits& limits = ProgramCacheLimits());
+
+    // Program for C = A (rows_a x cols_a) x B (cols_a x cols_b), compiled on a
+    // miss. A miss compiles with compiler when given (after setting its
+    // options), so a caller can keep one warm and read its report afterwards.
+    std::shared_ptr<const ProgramImage> get(const GemmShape& shape, const CompileOptions& options,
+                                            Compiler* compiler = nullptr);
+
+    // Canonical key text; equal keys mean identical programs
+    static std::string key(const GemmShape& shape, const CompileOptions& options);
+
+    const ProgramCacheStats& stats() const { return stats_; }
+
+private:
+    struct Entry {
+        std::string key;
+        std::shared_ptr<const ProgramImage> program;
+    };
+
+    std::string path_for(const std::string& key) const;
+    std::shared_ptr<const ProgramImage> load_from_disk(const std::string& key, const GemmShape& shape);
+    std::shared_ptr<const ProgramImage> compile(const std::string& key, const GemmShape& shape,
+                                                const CompileOptions& options, Compiler* compiler);
+    void insert(const std::string& key, std::shared_ptr<const ProgramImage> program);
+    void trim_disk();
+
+    std::string directory_;
+    ProgramCacheLimits limits_;
+    ProgramCacheStats stats_;
+
+    std::mutex mutex_;
+    std::list<Entry> lru_; // Most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+    uint64_t memory_bytes_ = 0;
+};
+
+} // namespace pim
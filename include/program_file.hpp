@@ -0,0 +1,214 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include "compiler.hpp"
+#include "instruction.hpp"
+#include "mapped_file.hpp"
+#include "memory_plan.hpp"
+#include "sink.hpp"
+
+namespace pim {
+
+// Compiled program container (.pimb)
+//
+// A fixed little-endian header followed by the instruction words bit-packed
+// back to back, INSTRUCTION_BITS each (word n starts at payload bit 19 * n,
+// LSB first). The payload is padded with PROGRAM_PADDING_BYTES zero bytes so
+// a reader can fetch any word with one unaligned 32-bit load.
+//
+//   offset  size  field
+//        0     4  magic "PIMB"
+//        4     4  format version
+//        8    24  rows_a, cols_a, cols_b
+//       32     4  num_cores
+//       36     4  placement mode
+//       40    16  tile_rows, tile_cols as requested (0 = automatic)
+//       56     8  rows_per_bank, num_banks
+//       64     8  rows used by the memory plan
+//       72     8  word count
+//       80     8  checksum (FNV-1a over the 32-bit words)
+//       88     4  Strassen recursion depth (0 = triple loop)
+//       92     4  operand element type (0 int32, 1 int16, 2 int8)
+//
+// The tiling and memory plan are deterministic, so the header stores their
+// inputs and a loader rebuilds the plan with memory_plan().
+constexpr uint32_t PROGRAM_FORMAT_VERSION = 3;
+constexpr size_t PROGRAM_HEADER_BYTES = 96;
+constexpr size_t PROGRAM_PADDING_BYTES = 4;
+constexpr char PROGRAM_MAGIC[5] = "PIMB";
+
+struct ProgramHeader {
+    uint32_t version = PROGRAM_FORMAT_VERSION;
+    GemmShape shape;
+    uint32_t num_cores = NUM_CORES;
+    PlacementMode placement = PlacementMode::PACKED;
+    uint64_t tile_rows = 0;
+    uint64_t tile_cols = 0;
+    MemoryGeometry memory;
+    uint64_t rows_used = 0;
+    uint64_t word_count = 0;
+    uint64_t checksum = 0;
+    uint32_t strassen_levels = 0;
+    ElementType element_type = ElementType::INT32;
+
+    // Bytes of the packed payload, without padding
+    uint64_t payload_bytes() const { return (word_count * instr_format::INSTRUCTION_BITS + 7) / 8; }
+};
+
+// Header codec shared by the program containers; magic names the container type
+void encode_program_header(const ProgramHeader& header, const char* magic, unsigned char* out);
+ProgramHeader decode_program_header(const unsigned char* in, const char* magic);
+
+// Header fields describing the compiled shape and plan (counts and checksum left at 0)
+ProgramHeader make_program_header(const CompileOptions& options, const CompileReport& report);
+
+// Rebuilds the tiling and memory plan a header describes
+MemoryPlan program_memory_plan(const ProgramHeader& header);
+
+// Little-endian field helpers for the container formats
+void put_u32(unsigned char* p, uint32_t value);
+void put_u64(unsigned char* p, uint64_t value);
+uint32_t get_u32(const unsigned char* p);
+uint64_t get_u64(const unsigned char* p);
+
+// Running checksum of an instruction stream (FNV-1a, one step per word)
+class ProgramChecksum {
+public:
+    void update(const InstructionWord* words, size_t count) {
+        uint64_t hash = hash_;
+        for (size_t n = 0; n < count; ++n) {
+            hash = (hash ^ words[n]) * 0x100000001B3ull;
+        }
+        hash_ = hash;
+    }
+
+    uint64_t value() const { return hash_; }
+
+private:
+    uint64_t hash_ = 0xCBF29CE484222325ull;
+};
+
+// Packs a program container while the compiler streams into it
+//
+// A placeholder header goes out first. finish() fills it in from the
+// compiler's options and report, which are complete by then. Subclasses
+// decide where the bytes go.
+class PackedProgramSink : public InstructionSink {
+public:
+    void write(const InstructionWord* words, size_t count) override;
+    void finish() override;
+
+protected:
+    PackedProgramSink(const CompileOptions& options, const CompileReport& report)
+        : options_(options), report_(report) {}
+
+    // Appends bytes after everything written so far
+    virtual void put_bytes(const unsigned char* bytes, size_t count) = 0;
+    // Overwrites the header at the start of the container
+    virtual void put_header(const unsigned char* header) = 0;
+
+private:
+    const CompileOptions& options_;
+    const CompileReport& report_;
+    uint64_t bits_ = 0; // Packed bits not yet written
+    uint32_t bit_count_ = 0;
+    uint64_t words_written_ = 0;
+    ProgramChecksum checksum_;
+};
+
+// Writes the container to a file. The file has to be seekable, so "-" is rejected.
+class ProgramFileSink : public PackedProgramSink {
+public:
+    ProgramFileSink(const std::string& path, const CompileOptions& options, const CompileReport& report);
+    ~ProgramFileSink() override;
+
+    ProgramFileSink(const ProgramFileSink&) = delete;
+    ProgramFileSink& operator=(const ProgramFileSink&) = delete;
+
+    void finish() override;
+
+protected:
+    void put_bytes(const unsigned char* bytes, size_t count) override;
+    void put_header(const unsigned char* header) override;
+
+private:
+    std::FILE* file_ = nullptr;
+    std::vector<char> buffer_; // stdio buffer
+};
+
+// Builds the container in memory
+class ProgramBufferSink : public PackedProgramSink {
+public:
+    ProgramBufferSink(const CompileOptions& options, const CompileReport& report);
+
+    std::vector<unsigned char>& bytes() { return bytes_; }
+
+protected:
+    void put_bytes(const unsigned char* bytes, size_t count) override {
+        bytes_.insert(bytes_.end(), bytes, bytes + count);
+    }
+    void put_header(const unsigned char* header) override {
+        std::copy(header, header + PROGRAM_HEADER_BYTES, bytes_.begin());
+    }
+
+private:
+    std::vector<unsigned char> bytes_;
+};
+
+// Read-only view of a program container
+//
+// The file is memory-mapped (see MappedFile), and words are unpacked on
+// demand straight from the mapping. An image can also own an in-memory
+// container, e.g. one built by ProgramBufferSink.
+class ProgramImage {
+public:
+    explicit ProgramImage(const std::string& path);
+    explicit ProgramImage(std::vector<unsigned char> bytes);
+
+    const ProgramHeader& header() const { return header_; }
+    size_t size() const { return static_cast<size_t>(header_.word_count); }
+
+    InstructionWord word(size_t index) const {
+        uint64_t bit = static_cast<uint64_t>(index) * instr_format::INSTRUCTION_BITS;
+        const unsigned char* p = payload_ + (bit >> 3);
+        uint32_t raw = static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+                       (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+        return (raw >> (bit & 7)) & instr_format::INSTRUCTION_MASK;
+    }
+
+    // Unpacks words [first, first + count) into out
+    void decode(size_t first, size_t count, InstructionWord* out) const;
+
+    // Recomputes the checksum over every word
+    bool verify() const;
+
+    // Rebuilds the tiling and memory plan the program was compiled against
+    MemoryPlan memory_plan() const;
+
+    // The whole container, byte_size() bytes
+    const unsigned char* bytes() const { return payload_ - PROGRAM_HEADER_BYTES; }
+    size_t byte_size() const { return byte_size_; }
+
+private:
+    // Validates the container at data and points payload_ into it
+    void attach(const unsigned char* data, size_t size, const std::string& name);
+
+    std::unique_ptr<MappedFile> file_;
+    std::vector<unsigned char> bytes_; // Backing store of in-memory images
+    size_t byte_size_ = 0;
+    ProgramHeader header_;
+    const unsigned char* payload_ = nullptr;
+};
+
+// Writes a human-readable listing of words to out, numbering them from first_index
+void write_disassembly(std::FILE* out, const InstructionWord* words, size_t count, size_t first_index);
+void write_disassembly_header(std::FILE* out);
+void write_disassembly_footer(std::FILE* out);
+
+} // namespace pim
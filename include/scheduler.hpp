@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace pim {
+
+// Block of C computed by one MAC lane: rows [row_begin, row_end), cols [col_begin, col_end)
+struct Tile {
+    size_t row_begin = 0;
+    size_t row_end = 0;
+    size_t col_begin = 0;
+    size_t col_end = 0;
+    uint32_t lane = 0;
+    uint32_t problem = 0; // Index of the GEMM within a batch (0 for a single one)
+
+    size_t rows() const { return row_end - row_begin; }
+    size_t cols() const { return col_end - col_begin; }
+};
+
+// Assignment of C tiles to lanes
+struct TilePlan {
+    uint32_t lanes = 1;    // Lanes used (num_cores / 2)
+    size_t tile_rows = 0;  // Nominal tile height (edge tiles may be smaller)
+    size_t tile_cols = 0;  // Nominal tile width
+    std::vector<std::vector<Tile>> lane_tiles; // Tiles per lane, in execution order
+};
+
+// Lanes formed by num_cores cores; throws unless num_cores is even and in 2..64
+uint32_t lane_count(uint32_t num_cores);
+
+// Tile sizes (rows, cols) the automatic tiling chooses from, best first: grids
+// with at most one tile per lane, smallest tile first, then the widest
+std::vector<std::pair<size_t, size_t>> automatic_tile_sizes(size_t rows, size_t cols, uint32_t num_cores);
+
+// Partitions C (rows x cols) into tiles and assigns them to the lanes formed by
+// num_cores cores. A tile size of 0 picks the tiling that minimizes the largest
+// tile when every lane gets at most one; explicit sizes are balanced greedily
+// (largest tile first, onto the least loaded lane).
+TilePlan plan_tiles(size_t rows, size_t cols, uint32_t num_cores, size_t tile_rows = 0, size_t tile_cols = 0);
+
+} // namespace pim
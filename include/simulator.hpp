@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "compressed_program.hpp"
+#include "instruction.hpp"
+#include "machine_model.hpp"
+#include "matrix_io.hpp"
+#include "memory_image.hpp"
+#include "memory_plan.hpp"
+#include "program_file.hpp"
+
+namespace pim {
+
+// Execution model used by the simulator
+//
+// Every core owns two operand latches and an accumulator. Cores are paired
+// into MAC lanes: the even core of a pair holds operand 0 and the odd core
+// holds operand 1, so the legacy stream (loads to core_ptr 0 and 1) maps onto
+// lane 0. The second latch lets a load fill one while a MAC reads the other;
+// programs that leave the flags below at 0 only ever use latch 0.
+//   MEM_LOAD      core c: latch[c][WR] = mem[bank[c]][row_addr]
+//   MEM_STORE     core c: mem[bank[c]][row_addr] = acc[c]
+//   FENCE         core c: wait for every earlier MEM_STORE to reach memory
+//   COMPUTE_SETUP core c: acc[c] = 0
+//   SET_BANK      core c: bank[c] = (bank[c] & ~0x1FF) | row_addr
+//   SET_SEGMENT   core c: bank[c] = (row_addr << 9) | (bank[c] & 0x1FF)
+//   COMPUTE_EXEC  core c: acc[c] += latch[c & ~1][RD] * latch[c | 1][WR]
+//
+// With a narrower ElementType in its row address, COMPUTE_EXEC multiplies the
+// latches element by element and adds the sum of the products.
+//
+// Timing is a dataflow model: each core issues its own instructions in program
+// order (one per cycle), and an instruction starts once the latches and
+// accumulator it reads are ready and the ones it overwrites are no longer needed.
+// A bank serves one access every bank_cycles, so loads and stores from
+// different cores to the same bank serialize (accesses claim banks in program order).
+// A store reaches memory store_latency cycles after it starts; a load of the
+// row waits until then, and the cycles it waits are counted as row stalls.
+// Compiled programs order such loads with a FENCE, so they see no row stalls.
+struct MachineConfig : MachineModel {
+    uint32_t issue_width = 0;    // Instructions dispatched per cycle by the controller (0 = unbounded)
+    bool timing = true;          // Disable to run the functional model only
+};
+
+// Counters reported after a run
+struct SimStats {
+    uint64_t instructions = 0;
+    uint64_t cycles = 0;
+    uint64_t loads = 0;
+    uint64_t stores = 0;
+    uint64_t setups = 0;
+    uint64_t macs = 0;
+    uint64_t bank_selects = 0;        // SET_BANK / SET_SEGMENT executed
+    uint64_t bank_stall_cycles = 0;   // Cycles loads/stores waited for a busy bank
+    uint64_t fences = 0;              // FENCE executed
+    uint64_t row_stall_cycles = 0;    // Cycles loads waited for a store to their row to land
+    std::vector<uint64_t> core_instructions; // Per-core instruction counts
+    double seconds = 0.0;                    // Host time spent simulating
+
+    // Simulated instructions per host second
+    double instructions_per_second() const {
+        return seconds > 0.0 ? static_cast<double>(instructions) / seconds : 0.0;
+    }
+};
+
+class Simulator {
+public:
+    explicit Simulator(const MachineConfig& config = MachineConfig(),
+                       const MemoryGeometry& geometry = MemoryGeometry());
+
+    // Host-side initialization: places A and B where the memory plan puts them
+    void load_matrices(const MemoryPlan& memory_plan, const Matrix& matrix_a, const Matrix& matrix_b);
+
+    // Writes the rows of a memory image
+    void load_image(const MemoryImage& image);
+
+    // Executes a packed instruction stream; memory and core state persist between runs
+    SimStats run(const std::vector<InstructionWord>& program);
+
+    // Executes a program container, unpacking words straight from its mapping
+    SimStats run(const ProgramImage& program);
+
+    // Executes a loop-compressed program, expanding it one decode batch at a time
+    SimStats run(const CompressedProgram& program);
+
+    // Reads the result from the C tiles of the memory plan
+    Matrix read_matrix_c(const MemoryPlan& memory_plan) const;
+
+    // Clears memory and core state
+    void reset();
+
+    const std::vector<int32_t>& memory() const { return memory_; }
+
+private:
+    // Pre-decoded instruction, so the hot loop never touches the bit fields.
+    // For COMPUTE_EXEC row_addr carries the latch selects (bit 0: operand 0's
+    // latch, bit 1: operand 1's) and the element type above them.
+    struct DecodedInstr {
+        uint8_t kind;
+        uint8_t core;
+        uint16_t row_addr;
+    };
+
+    struct CoreState {
+        int32_t latch[2] = {0, 0};
+        int64_t acc = 0;
+        uint32_t bank = 0;
+        // Timing scoreboard (cycle numbers)
+        uint64_t next_issue = 0;          // In-order issue: next free issue slot
+        uint64_t latch_ready[2] = {0, 0}; // Latch value valid
+        uint64_t latch_read[2] = {0, 0};  // Last COMPUTE_EXEC that read the latch
+        uint64_t acc_ready = 0;           // Accumulator value valid
+        uint64_t acc_read = 0;            // Last MEM_STORE that read the accumulator
+    };
+
+    // Decodes and executes program_size words; fetch(base, n) returns words [base, base + n)
+    template <typename Fetch>
+    SimStats run_batches(size_t program_size, Fetch fetch);
+
+    template <bool Timing>
+    void execute(const DecodedInstr* begin, const DecodedInstr* end, uint64_t first_index, SimStats& stats);
+
+    MachineConfig config_;
+    MemoryGeometry geometry_;
+    std::vector<int32_t> memory_;
+    std::vector<uint64_t> bank_free_; // Cycle at which each bank accepts the next access
+    std::vector<uint64_t> row_ready_; // Cycle at which the last store to each row has landed
+    uint64_t stores_done_ = 0;        // Cycle at which every store so far has landed
+    std::vector<CoreState> cores_;
+    uint64_t last_cycle_ = 0;
+};
+
+} // namespace pim
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+#include "instruction.hpp"
+
+namespace pim {
+
+// Destination for streamed instruction words
+//
+// The compiler hands words over in chunks; a sink must consume (or copy) them
+// before write() returns.
+class InstructionSink {
+public:
+    virtual ~InstructionSink() = default;
+
+    virtual void write(const InstructionWord* words, size_t count) = 0;
+
+    // Called once after the last chunk
+    virtual void finish() {}
+};
+
+// Collects the whole program in memory
+class VectorSink : public InstructionSink {
+public:
+    void write(const InstructionWord* words, size_t count) override {
+        words_.insert(words_.end(), words, words + count);
+    }
+
+    std::vector<InstructionWord>& words() { return words_; }
+
+private:
+    std::vector<InstructionWord> words_;
+};
+
+// Forwards every chunk to a callback
+class CallbackSink : public InstructionSink {
+public:
+    using Callback = std::function<void(const InstructionWord*, size_t)>;
+
+    explicit CallbackSink(Callback callback) : callback_(std::move(callback)) {}
+
+    void write(const InstructionWord* words, size_t count) override { callback_(words, count); }
+
+private:
+    Callback callback_;
+};
+
+// Hands every chunk to several sinks in turn
+class TeeSink : public InstructionSink {
+public:
+    void add(InstructionSink& sink) { sinks_.push_back(&sink); }
+
+    void write(const InstructionWord* words, size_t count) override {
+        for (InstructionSink* sink : sinks_) sink->write(words, count);
+    }
+    void finish() override {
+        for (InstructionSink* sink : sinks_) sink->finish();
+    }
+
+private:
+    std::vector<InstructionSink*> sinks_;
+};
+
+// Writes raw little-endian 32-bit words to a file, or to stdout for "-" (pipes)
+class FileSink : public InstructionSink {
+public:
+    explicit FileSink(const std::string& path);
+    ~FileSink() override;
+
+    FileSink(const FileSink&) = delete;
+    FileSink& operator=(const FileSink&) = delete;
+
+    void write(const InstructionWord* words, size_t count) override;
+    void finish() override;
+
+private:
+    std::FILE* file_ = nullptr;
+    bool owns_file_ = false;
+    std::vector<char> buffer_; // stdio buffer for files the sink opens (closed before it is freed)
+};
+
+} // namespace pim
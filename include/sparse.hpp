@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "matrix_io.hpp"
+#include "scheduler.hpp"
+
+namespace pim {
+
+// Compressed sparse row matrix. Column indices ascend within each row; a
+// stored value of 0 counts as a zero.
+struct CsrMatrix {
+    size_t rows = 0;
+    size_t cols = 0;
+    std::vector<size_t> row_begin;   // rows + 1 offsets into col_index / values
+    std::vector<uint32_t> col_index;
+    std::vector<int32_t> values;
+
+    size_t stored() const { return values.size(); }
+
+    // Throws unless the offsets and indices describe a valid rows x cols matrix
+    void validate() const;
+};
+
+// Compressed sparse column matrix, the transpose layout of CsrMatrix
+struct CscMatrix {
+    size_t rows = 0;
+    size_t cols = 0;
+    std::vector<size_t> col_begin;   // cols + 1 offsets into row_index / values
+    std::vector<uint32_t> row_index;
+    std::vector<int32_t> values;
+
+    size_t stored() const { return values.size(); }
+
+    void validate() const;
+};
+
+CsrMatrix to_csr(const Matrix& matrix);
+CscMatrix to_csc(const Matrix& matrix);
+CscMatrix to_csc(const CsrMatrix& matrix);
+Matrix to_dense(const CsrMatrix& matrix);
+Matrix to_dense(const CscMatrix& matrix);
+
+// Operand values for the sparse lowering: A by rows, B by columns
+struct SparseOperands {
+    const CsrMatrix* a = nullptr;
+    const CscMatrix* b = nullptr;
+    double threshold = 0.0; // Tiles at or below this product density are lowered sparsely
+
+    // Fraction of the tile's (i, k, j) products whose A and B elements are both nonzero
+    double product_density(const Tile& tile) const;
+
+    // Appends the k where A[i][k] and B[k][j] are both nonzero, ascending
+    void common_k(size_t i, size_t j, std::vector<uint32_t>& out) const;
+};
+
+// Reads a Matrix Market coordinate file ("%%MatrixMarket matrix coordinate
+// integer general") into CSR. Entries may come in any order; duplicates are
+// rejected.
+CsrMatrix read_matrix_market(const std::string& filename);
+
+// Writes the matrix as a Matrix Market coordinate file, row by row
+void write_matrix_market(const std::string& filename, const CsrMatrix& matrix);
+
+} // namespace pim
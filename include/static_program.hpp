@@ -0,0 +1,331 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include "instruction.hpp"
+#include "memory_plan.hpp"
+
+namespace pim {
+
+// Compile-time programs for fixed GEMM shapes
+//
+// StaticProgram<M, K, N> holds the program for C = A (M x K) x B (K x N) as a
+// constexpr std::array, so it lives in read-only data and costs nothing at run
+// time. The generator below evaluates the same pipeline as Compiler (automatic
+// tiling, per-lane memory copies, operand reuse, bank selects, round-robin
+// interleaving) and produces the same words as a runtime compile with default
+// options, apart from num_cores. Shapes whose operands do not fit the default
+// geometry with per-lane copies fail to compile.
+//
+// Evaluation happens inside the C++ compiler, so this is meant for the small
+// shapes baked into firmware; large shapes run into its constexpr limits.
+namespace static_program_detail {
+
+constexpr MemoryGeometry GEOMETRY{};
+
+constexpr size_t ceil_div(size_t a, size_t b) {
+    return (a + b - 1) / b;
+}
+
+// Tile of one lane with the base rows of its private A block, B block and C tile
+struct LaneLayout {
+    bool active = false;
+    size_t row_begin = 0;
+    size_t row_end = 0;
+    size_t col_begin = 0;
+    size_t col_end = 0;
+    uint64_t a_base = 0;
+    uint64_t b_base = 0;
+    uint64_t c_base = 0;
+};
+
+struct Layout {
+    size_t tile_rows = 0;
+    size_t tile_cols = 0;
+    bool replicated = false; // Per-lane copies fit the geometry
+    uint64_t rows_used = 0;
+    LaneLayout lanes[NUM_LANES] = {};
+};
+
+// plan_tiles with automatic tiling followed by the REPLICATED MemoryPlan
+constexpr Layout plan_layout(size_t rows_a, size_t cols_a, size_t cols_b, uint32_t lanes) {
+    Layout layout{};
+    size_t best_area = rows_a * cols_b + 1;
+    for (size_t grid_rows = 1; grid_rows <= (lanes < rows_a ? lanes : rows_a); ++grid_rows) {
+        size_t grid_cols = (lanes / grid_rows < cols_b) ? lanes / grid_rows : cols_b;
+        size_t candidate_rows = ceil_div(rows_a, grid_rows);
+        size_t candidate_cols = ceil_div(cols_b, grid_cols);
+        size_t area = candidate_rows * candidate_cols;
+        if (area < best_area || (area == best_area && candidate_cols > layout.tile_cols)) {
+            best_area = area;
+            layout.tile_rows = candidate_rows;
+            layout.tile_cols = candidate_cols;
+        }
+    }
+
+    // Automatic tiling never makes more tiles than lanes, so the balancer hands
+    // the n-th largest tile (ties in grid order) to lane n
+    size_t grid_rows = ceil_div(rows_a, layout.tile_rows);
+    size_t grid_cols = ceil_div(cols_b, layout.tile_cols);
+    auto tile_area = [&](size_t tile) {
+        size_t r = tile / grid_cols * layout.tile_rows;
+        size_t c = tile % grid_cols * layout.tile_cols;
+        size_t height = (rows_a - r < layout.tile_rows) ? rows_a - r : layout.tile_rows;
+        size_t width = (cols_b - c < layout.tile_cols) ? cols_b - c : layout.tile_cols;
+        return height * width;
+    };
+    for (size_t tile = 0; tile < grid_rows * grid_cols; ++tile) {
+        size_t lane = 0;
+        for (size_t other = 0; other < grid_rows * grid_cols; ++other) {
+            if (tile_area(other) > tile_area(tile) || (tile_area(other) == tile_area(tile) && other < tile)) {
+                ++lane;
+            }
+        }
+        LaneLayout& slot = layout.lanes[lane];
+        slot.active = true;
+        slot.row_begin = tile / grid_cols * layout.tile_rows;
+        slot.row_end = (slot.row_begin + layout.tile_rows < rows_a) ? slot.row_begin + layout.tile_rows : rows_a;
+        slot.col_begin = tile % grid_cols * layout.tile_cols;
+        slot.col_end = (slot.col_begin + layout.tile_cols < cols_b) ? slot.col_begin + layout.tile_cols : cols_b;
+    }
+
+    // Per lane: A block then C tile on the even core's banks, B block on fresh ones
+    uint64_t bank_rows = GEOMETRY.rows_per_bank;
+    uint64_t next = 0;
+    uint64_t banks = 0;
+    auto start_group = [&](uint64_t rows) {
+        if (next % bank_rows != 0) next += bank_rows - next % bank_rows;
+        banks += ceil_div(rows, bank_rows);
+    };
+    for (uint32_t lane = 0; lane < lanes; ++lane) {
+        LaneLayout& slot = layout.lanes[lane];
+        if (!slot.active) continue;
+        uint64_t a_rows = static_cast<uint64_t>(slot.row_end - slot.row_begin) * cols_a;
+        uint64_t b_rows = static_cast<uint64_t>(slot.col_end - slot.col_begin) * cols_a;
+        uint64_t c_rows = static_cast<uint64_t>(slot.row_end - slot.row_begin) * (slot.col_end - slot.col_begin);
+        start_group(a_rows + c_rows);
+        slot.a_base = next;
+        slot.c_base = next + a_rows;
+        next += a_rows + c_rows;
+        start_group(b_rows);
+        slot.b_base = next;
+        next += b_rows;
+    }
+    layout.replicated = (banks <= GEOMETRY.num_banks);
+    layout.rows_used = next;
+    return layout;
+}
+
+// Counters matching CompileReport
+struct Summary {
+    size_t words = 0;
+    size_t ir_ops = 0;
+    size_t loads_before = 0;
+    size_t loads_eliminated = 0;
+    size_t bank_selects = 0;
+    bool addresses_valid = true; // Every access falls inside the geometry
+};
+
+// TileIRGenerator, OperandReusePass, BankSelectPass and translate_ir_op for
+// one lane, fused into a word-at-a-time state machine
+struct LaneState {
+    LaneLayout tile;
+    uint32_t lane = 0;
+    size_t cols_a = 0;
+    bool ijk = true;
+    size_t middle_count = 0;
+    size_t chain_count = 0;
+    size_t chain = 0;
+    size_t step = 0;
+
+    // Element held by each operand buffer
+    bool held[2] = {false, false};
+    size_t held_row[2] = {0, 0};
+    size_t held_col[2] = {0, 0};
+
+    // Bank register of each core of the lane
+    bool bank_known[2] = {false, false};
+    uint32_t bank[2] = {0, 0};
+
+    // Bank selects queued in front of an access, then the access itself
+    InstructionWord pending[3] = {0, 0, 0};
+    size_t pending_count = 0;
+    size_t pending_next = 0;
+
+    constexpr void start(const LaneLayout& layout, uint32_t lane_index, size_t inner) {
+        tile = layout;
+        lane = lane_index;
+        cols_a = inner;
+        size_t rows = tile.row_end - tile.row_begin;
+        size_t cols = tile.col_end - tile.col_begin;
+        ijk = (cols >= rows);
+        middle_count = ijk ? cols : rows;
+        chain_count = tile.active ? rows * cols : 0;
+    }
+
+    constexpr bool next(InstructionWord& word, Summary& summary) {
+        while (pending_next == pending_count) {
+            if (chain == chain_count) return false;
+            generate(summary);
+        }
+        word = pending[pending_next++];
+        return true;
+    }
+
+private:
+    // Queues the words for the operation at (chain, step) and advances
+    constexpr void generate(Summary& summary) {
+        size_t outer = chain / middle_count;
+        size_t m = chain % middle_count;
+        size_t middle = (outer % 2 == 1) ? middle_count - 1 - m : m;
+        size_t i = tile.row_begin + (ijk ? outer : middle);
+        size_t j = tile.col_begin + (ijk ? middle : outer);
+        size_t chain_length = 3 * cols_a + 2;
+        uint32_t core = 2 * lane;
+
+        pending_count = 0;
+        pending_next = 0;
+        ++summary.ir_ops;
+        if (step == 0) {
+            queue(instr_format::pack(Opcode::COMPUTE_SETUP, core, false, false, 0));
+        } else if (step == chain_length - 1) {
+            uint64_t address = tile.c_base + (i - tile.row_begin) * (tile.col_end - tile.col_begin) +
+                               (j - tile.col_begin);
+            access(0, address, Opcode::MEM_STORE, summary);
+        } else {
+            size_t k_step = (step - 1) / 3;
+            size_t k = (chain % 2 == 1) ? cols_a - 1 - k_step : k_step;
+            size_t kind = (step - 1) % 3;
+            if (kind == 2) {
+                queue(instr_format::pack(Opcode::COMPUTE_EXEC, core, false, false, 0));
+            } else {
+                size_t side = kind;
+                size_t row = (side == 0) ? i : k;
+                size_t col = (side == 0) ? k : j;
+                ++summary.loads_before;
+                if (held[side] && held_row[side] == row && held_col[side] == col) {
+                    ++summary.loads_eliminated;
+                } else {
+                    held[side] = true;
+                    held_row[side] = row;
+                    held_col[side] = col;
+                    uint64_t address = (side == 0)
+                        ? tile.a_base + (i - tile.row_begin) * cols_a + k
+                        : tile.b_base + (j - tile.col_begin) * cols_a + k;
+                    access(side, address, Opcode::MEM_LOAD, summary);
+                }
+            }
+        }
+
+        if (++step == chain_length) {
+            step = 0;
+            ++chain;
+        }
+    }
+
+    constexpr void queue(InstructionWord word) {
+        pending[pending_count++] = word;
+    }
+
+    constexpr void access(size_t side, uint64_t address, Opcode opcode, Summary& summary) {
+        uint32_t core = 2 * lane + static_cast<uint32_t>(side);
+        uint32_t target = static_cast<uint32_t>(address / GEOMETRY.rows_per_bank);
+        if (target >= GEOMETRY.num_banks) {
+            summary.addresses_valid = false;
+        }
+        if (!bank_known[side] || (bank[side] >> BANK_SELECT_BITS) != (target >> BANK_SELECT_BITS)) {
+            queue(instr_format::pack(Opcode::COMPUTE_SETUP, core, true, true, target >> BANK_SELECT_BITS));
+            ++summary.bank_selects;
+        }
+        if (!bank_known[side] || (bank[side] & BANK_SELECT_MASK) != (target & BANK_SELECT_MASK)) {
+            queue(instr_format::pack(Opcode::COMPUTE_SETUP, core, true, false, target & BANK_SELECT_MASK));
+            ++summary.bank_selects;
+        }
+        bank_known[side] = true;
+        bank[side] = target;
+        bool store = (opcode == Opcode::MEM_STORE);
+        queue(instr_format::pack(opcode, core, !store, store,
+                                 static_cast<uint32_t>(address % GEOMETRY.rows_per_bank)));
+    }
+};
+
+// Interleaves the lanes round-robin; writes the words to out unless it is null
+constexpr Summary generate(const Layout& layout, size_t cols_a, uint32_t lanes, InstructionWord* out) {
+    Summary summary{};
+    LaneState states[NUM_LANES] = {};
+    for (uint32_t lane = 0; lane < lanes; ++lane) {
+        states[lane].start(layout.lanes[lane], lane, cols_a);
+    }
+
+    bool any = true;
+    while (any) {
+        any = false;
+        for (uint32_t lane = 0; lane < lanes; ++lane) {
+            InstructionWord word = 0;
+            if (!states[lane].next(word, summary)) continue;
+            any = true;
+            if (out) out[summary.words] = word;
+            ++summary.words;
+        }
+    }
+    return summary;
+}
+
+template <size_t Words>
+constexpr std::array<InstructionWord, Words> build(const Layout& layout, size_t cols_a, uint32_t lanes) {
+    std::array<InstructionWord, Words> program{};
+    generate(layout, cols_a, lanes, program.data());
+    return program;
+}
+
+} // namespace static_program_detail
+
+// Program for C = A (M x K) x B (K x N) on Cores cores, built at compile time
+template <size_t M, size_t K, size_t N, uint32_t Cores = NUM_CORES>
+struct StaticProgram {
+    static_assert(M > 0 && K > 0 && N > 0, "Input matrices cannot be empty.");
+    static_assert(Cores >= 2 && Cores <= NUM_CORES && Cores % 2 == 0,
+                  "Core count must be an even number between 2 and 64.");
+
+    static constexpr static_program_detail::Layout layout =
+        static_program_detail::plan_layout(M, K, N, Cores / 2);
+    static_assert(layout.replicated,
+                  "Operands need more banks than the default geometry has; compile this shape at run time.");
+
+    static constexpr static_program_detail::Summary summary =
+        static_program_detail::generate(layout, K, Cores / 2, nullptr);
+    static_assert(summary.addresses_valid, "Program addresses a row outside the memory geometry.");
+
+    static constexpr std::array<InstructionWord, summary.words> words =
+        static_program_detail::build<summary.words>(layout, K, Cores / 2);
+};
+
+template <size_t M, size_t K, size_t N, uint32_t Cores = NUM_CORES>
+constexpr std::array<InstructionWord, StaticProgram<M, K, N, Cores>::summary.words> compile() {
+    return StaticProgram<M, K, N, Cores>::words;
+}
+
+// Type-erased view of a StaticProgram, used by Compiler to find a match at run time
+struct SpecializedProgram {
+    size_t rows_a = 0;
+    size_t cols_a = 0;
+    size_t cols_b = 0;
+    uint32_t num_cores = NUM_CORES;
+    const InstructionWord* words = nullptr;
+    size_t size = 0;
+    size_t ir_ops = 0;
+    size_t loads_before = 0;
+    size_t loads_eliminated = 0;
+    size_t bank_selects = 0;
+};
+
+template <size_t M, size_t K, size_t N, uint32_t Cores = NUM_CORES>
+constexpr SpecializedProgram specialize() {
+    using Program = StaticProgram<M, K, N, Cores>;
+    return SpecializedProgram{M, K, N, Cores, Program::words.data(), Program::words.size(),
+                              Program::summary.ir_ops, Program::summary.loads_before,
+                              Program::summary.loads_eliminated, Program::summary.bank_selects};
+}
+
+} // namespace pim
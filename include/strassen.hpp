@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "compiler.hpp"
+#include "memory_plan.hpp"
+#include "pipeline.hpp"
+#include "scheduler.hpp"
+
+namespace pim {
+
+// Deepest recursion the lowering accepts (7^4 leaf products)
+constexpr uint32_t MAX_STRASSEN_LEVELS = 4;
+
+// Estimated cycles of C = A x B lowered with the given recursion depth (0 =
+// the triple loop) under options. The triple loop and the leaf products use
+// the tuner's model (autotune.hpp). A sum phase takes its busiest lane's
+// time: load_latency + bank_cycles per term (half the load latency with
+// scheduling), and per output mac_latency plus bank_cycles for each four
+// lanes in the phase, whose stores collide on shared banks (at least one).
+// The constants are fitted against the simulator. The phases run one after
+// another, and each fence waits out a store. Throws when the leaves do not
+// fit the memory geometry.
+uint64_t strassen_cost(const GemmShape& shape, uint32_t levels, const CompileOptions& options);
+
+// Depth with the fewest estimated cycles among those whose leaf products are
+// at least options.strassen_cutoff in every dimension; 0 when no recursion
+// beats the triple loop
+uint32_t choose_strassen_levels(const GemmShape& shape, const CompileOptions& options);
+
+// Strassen recursion, flattened
+//
+// levels levels of Strassen's seven-product scheme turn C = A x B into 7^levels
+// leaf products of ceil(M/2^levels) x ceil(K/2^levels) x ceil(N/2^levels)
+// blocks. Each leaf multiplies a signed sum of A blocks by a signed sum of B
+// blocks, and each C block is a signed sum of leaf results, with the signs of
+// every level multiplied together. Blocks running past the edge of A, B or C
+// are padded with zeros: missing terms are skipped, missing outputs never
+// stored. The program runs in three phases: the operand sums into the leaves'
+// A and B, the leaf products with the ordinary lowering, and the sums of leaf
+// results into C. Lanes read blocks other lanes stored in the phase before,
+// so the second and third phases open with fences.
+//
+// The constructor appends the leaf operands and the +1/-1 constant rows to
+// top, which must not be REPLICATED since the sums read it. Leaf operands are
+// replicated per lane when they fit, and the sums store every copy. The
+// constructor is deterministic, so a loader can rebuild the same plan from
+// the shape and depth.
+class StrassenLowering {
+public:
+    StrassenLowering(MemoryPlan& top, uint32_t levels, uint32_t num_cores);
+
+    StrassenLowering(const StrassenLowering&) = delete;
+    StrassenLowering& operator=(const StrassenLowering&) = delete;
+
+    uint32_t levels() const { return levels_; }
+    size_t leaf_count() const { return leaves_.size(); }
+
+    // The three phases, in program order
+    std::vector<ProgramPhase> phases() const;
+
+private:
+    uint32_t levels_;
+    std::vector<MemoryPlan> leaves_;
+    std::vector<ElementwiseJob> operand_jobs_; // A sum of every leaf, then B sum of every leaf
+    std::vector<ElementwiseJob> combine_jobs_; // One per C block inside C
+    TilePlan operand_tiling_;
+    TilePlan product_tiling_;
+    TilePlan combine_tiling_;
+    std::vector<const MemoryPlan*> operand_plans_;
+    std::vector<const MemoryPlan*> product_plans_;
+    std::vector<const MemoryPlan*> combine_plans_;
+};
+
+} // namespace pim
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace pim {
+
+// Fixed set of worker threads running parallel_for loops with work stealing
+//
+// Each participant (the workers plus the calling thread) starts with an equal
+// slice of the index range. A participant that runs out steals the back half
+// of another one's remaining slice. Slices are single atomic words, so
+// neither taking nor stealing an index needs a lock.
+class ThreadPool {
+public:
+    // threads counts the caller; 0 uses every hardware thread
+    explicit ThreadPool(unsigned threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned size() const { return static_cast<unsigned>(workers_.size()) + 1; }
+
+    // Calls body(i) for every i in [0, count) and waits for all of them. The
+    // first exception thrown by body is rethrown here.
+    void parallel_for(size_t count, const std::function<void(size_t)>& body);
+
+private:
+    // Remaining [begin, end) of one participant, packed as begin << 32 | end
+    struct alignas(64) Slice {
+        std::atomic<uint64_t> bounds{0};
+    };
+
+    void worker_loop(unsigned index);
+    void run_slices(unsigned index);
+    bool take(unsigned index, size_t& item);
+    bool steal(unsigned index);
+
+    std::vector<std::thread> workers_;
+    std::unique_ptr<Slice[]> slices_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    uint64_t generation_ = 0;
+    unsigned running_ = 0;
+    bool stop_ = false;
+    const std::function<void(size_t)>* body_ = nullptr;
+
+    std::atomic<bool> failed_{false};
+    std::exception_ptr error_;
+};
+
+} // namespace pim
@@ -0,0 +1,317 @@
+#include "autotune.hpp"
+#include "passes.hpp"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace pim {
+
+namespace {
+
+size_t ceil_div(size_t a, size_t b) {
+    return (a + b - 1) / b;
+}
+
+// Work of one lane's tiles
+struct LaneWork {
+    uint64_t steps = 0;    // MAC steps
+    uint64_t chains = 0;
+    uint64_t a_shared = 0; // Chain boundaries where the next chain starts on the A element in its latch
+    uint64_t b_shared = 0; // Boundaries starting on the B element in its latch
+};
+
+// Work of a tiling, known before the memory plan and the passes are chosen
+struct TilingWork {
+    std::vector<LaneWork> lanes;
+    uint64_t words = 0;          // Words with no load removed and no bank select
+    uint64_t boundaries = 0;     // Chain boundaries within tiles; operand reuse saves a load at each
+    uint32_t lanes_used = 0;
+    uint32_t block_sharing = 1;  // Most lanes reading one A or B block, with one copy of each
+};
+
+TilingWork tiling_work(const TilePlan& tiling, size_t k_rows) {
+    TilingWork work;
+    work.lanes.resize(tiling.lanes);
+    std::vector<std::pair<size_t, uint32_t>> row_lanes; // (tile row, lane) of every tile
+    std::vector<std::pair<size_t, uint32_t>> col_lanes;
+    for (uint32_t lane = 0; lane < tiling.lanes; ++lane) {
+        LaneWork& lane_work = work.lanes[lane];
+        for (const Tile& tile : tiling.lane_tiles[lane]) {
+            uint64_t chains = static_cast<uint64_t>(tile.rows()) * tile.cols();
+            lane_work.steps += chains * k_rows;
+            lane_work.chains += chains;
+            // The serpentine nest shares the middle loop's operand within a
+            // pass and the other one across each turn
+            bool rows_outer = OperandReusePass::schedule(tile.rows(), tile.cols()).order == LoopOrder::IJK;
+            uint64_t outer = rows_outer ? tile.rows() : tile.cols();
+            uint64_t middle_shared = chains - outer;
+            lane_work.a_shared += rows_outer ? middle_shared : outer - 1;
+            lane_work.b_shared += rows_outer ? outer - 1 : middle_shared;
+            work.words += chains * (3 * k_rows + 2);
+            work.boundaries += chains - 1;
+            row_lanes.emplace_back(tile.row_begin, lane);
+            col_lanes.emplace_back(tile.col_begin, lane);
+        }
+        if (lane_work.chains > 0) ++work.lanes_used;
+    }
+    // Distinct lanes per tile row (A block) and per tile column (B block)
+    for (auto* pairs : {&row_lanes, &col_lanes}) {
+        std::sort(pairs->begin(), pairs->end());
+        pairs->erase(std::unique(pairs->begin(), pairs->end()), pairs->end());
+        for (size_t begin = 0; begin < pairs->size();) {
+            size_t end = begin;
+            while (end < pairs->size() && (*pairs)[end].first == (*pairs)[begin].first) ++end;
+            work.block_sharing = std::max(work.block_sharing, static_cast<uint32_t>(end - begin));
+            begin = end;
+        }
+    }
+    return work;
+}
+
+} // namespace
+
+double step_cycles(const MachineModel& machine, bool schedule, uint32_t sharing) {
+    double latency = machine.load_latency + 1.0; // Load, then the MAC in the cycle its latch is valid
+    if (schedule) latency /= 2;                  // The other latch takes the next step's load meanwhile
+    return std::max({2.0, latency, static_cast<double>(machine.bank_cycles) * sharing});
+}
+
+namespace {
+
+CostEstimate work_cost(const TilingWork& work, PlacementMode placement, bool operand_reuse, bool schedule,
+                       const MachineModel& machine)
+{
+    uint32_t sharing = placement == PlacementMode::REPLICATED ? 1
+                     : placement == PlacementMode::SPREAD ? work.block_sharing
+                     : work.lanes_used; // Packed blocks share banks with their neighbours too
+    double step = step_cycles(machine, schedule, sharing);
+    double bank = machine.bank_cycles;
+    // Between chains the even core stores C once the last MAC is done and
+    // resets the accumulator before the next chain's first MAC. When that
+    // chain starts with an A load, the load also waits for the store to
+    // leave the bank, which C shares with A.
+    double reset = std::max(0.0, machine.mac_latency + machine.setup_latency + 1.0 - step);
+    double reload_a = std::max(reset, machine.mac_latency + std::max(2.0, bank) - 1.0);
+    double busiest = 0;
+    for (const LaneWork& lane : work.lanes) {
+        uint64_t a_shared = operand_reuse ? lane.a_shared : 0;
+        uint64_t b_shared = operand_reuse ? lane.b_shared : 0;
+        double issue = lane.steps * step + a_shared * reset + (lane.chains - a_shared) * reload_a;
+        // The even core's bank takes the A loads and the C stores, the odd core's the B loads
+        double even_bank = bank * (lane.steps - a_shared + lane.chains);
+        double odd_bank = bank * (lane.steps - b_shared);
+        busiest = std::max({busiest, issue, even_bank, odd_bank});
+    }
+    CostEstimate cost;
+    cost.placement = placement;
+    cost.cycles = static_cast<uint64_t>(std::ceil(busiest)) +
+                  machine.load_latency + machine.mac_latency + machine.store_latency;
+    // A lane's two cores select their first bank with SET_SEGMENT and SET_BANK
+    cost.words = work.words - (operand_reuse ? work.boundaries : 0) + 4 * work.lanes_used;
+    return cost;
+}
+
+// Fewer cycles, then fewer words, then fewer tiles: fewer block copies to
+// place, and no dependence on the order candidates are searched in
+bool cheaper(const CostEstimate& a, size_t a_tiles, const CostEstimate& b, size_t b_tiles) {
+    if (a.cycles != b.cycles) return a.cycles < b.cycles;
+    return a.words != b.words ? a.words < b.words : a_tiles < b_tiles;
+}
+
+size_t k_rows_of(const GemmShape& shape, const CompileOptions& options) {
+    return ceil_div(shape.cols_a, elements_per_row(options.element_type));
+}
+
+// Distinct tile extents that cut dim into 1..max_blocks blocks
+std::vector<size_t> tile_extents(size_t dim, size_t max_blocks) {
+    std::vector<size_t> extents;
+    for (size_t blocks = 1; blocks <= std::min(dim, max_blocks); ++blocks) {
+        size_t extent = ceil_div(dim, blocks);
+        if (extents.empty() || extents.back() != extent) extents.push_back(extent);
+    }
+    return extents;
+}
+
+} // namespace
+
+CostEstimate estimate_cost(const GemmShape& shape, const CompileOptions& options) {
+    TilePlan tiling = plan_replicable_tiles(options.memory, shape.rows_a, shape.cols_a, shape.cols_b,
+                                            options.num_cores, options.tile_rows, options.tile_cols,
+                                            options.element_type);
+    MemoryPlan plan = MemoryPlan::build(options.memory, shape.rows_a, shape.cols_a, shape.cols_b, tiling, 0,
+                                        PlacementMode::REPLICATED, options.element_type);
+    return tiling_cost(tiling, plan.k_rows(), plan.mode(), options);
+}
+
+CostEstimate tiling_cost(const TilePlan& tiling, size_t k_rows, PlacementMode placement,
+                         const CompileOptions& options)
+{
+    return work_cost(tiling_work(tiling, k_rows), placement, options.operand_reuse, options.schedule,
+                     options.machine);
+}
+
+TuningDatabase::TuningDatabase(const std::string& path) : path_(path) {
+    if (path_.empty()) return;
+    std::ifstream in(path_);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream fields(line);
+        std::string key;
+        TuneChoice choice;
+        int reuse = 0;
+        int schedule = 0;
+        if (!(fields >> key >> choice.num_cores >> choice.tile_rows >> choice.tile_cols >> reuse >> schedule >>
+              choice.cost.cycles >> choice.cost.words)) {
+            continue; // Torn or foreign line; the shape is searched again
+        }
+        choice.operand_reuse = reuse != 0;
+        choice.schedule = schedule != 0;
+        choices_[key] = choice;
+    }
+}
+
+bool TuningDatabase::find(const std::string& key, TuneChoice& choice) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = choices_.find(key);
+    if (found == choices_.end()) return false;
+    choice = found->second;
+    return true;
+}
+
+void TuningDatabase::store(const std::string& key, const TuneChoice& choice) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    choices_[key] = choice;
+    if (path_.empty()) return;
+    bool fresh = !std::ifstream(path_).good();
+    std::ofstream out(path_, std::ios::app);
+    if (fresh) {
+        out << "# key cores tile_rows tile_cols reuse schedule cycles words\n";
+    }
+    // One write per line, so lines from concurrent processes do not interleave
+    std::ostringstream line;
+    line << key << " " << choice.num_cores << " " << choice.tile_rows << " " << choice.tile_cols << " "
+         << choice.operand_reuse << " " << choice.schedule << " " << choice.cost.cycles << " "
+         << choice.cost.words << "\n";
+    out << line.str() << std::flush;
+    if (!out) {
+        throw std::runtime_error("Could not write tuning database " + path_);
+    }
+}
+
+std::string TuningDatabase::key(const GemmShape& shape, const CompileOptions& options) {
+    const MachineModel& machine = options.machine;
+    return "t" + std::to_string(TUNER_REVISION) + "-r" + std::to_string(COMPILER_REVISION) + "-" +
+           std::to_string(shape.rows_a) + "x" + std::to_string(shape.cols_a) + "x" + std::to_string(shape.cols_b) +
+           "-c" + std::to_string(options.num_cores) +
+           "-g" + std::to_string(options.memory.num_banks) + "x" + std::to_string(options.memory.rows_per_bank) +
+           "-" + element_type_name(options.element_type) +
+           "-m" + std::to_string(machine.load_latency) + "." + std::to_string(machine.store_latency) + "." +
+           std::to_string(machine.mac_latency) + "." + std::to_string(machine.setup_latency) + "." +
+           std::to_string(machine.bank_cycles);
+}
+
+TuneResult autotune(const GemmShape& shape, CompileOptions& options, TuningDatabase* database) {
+    if (options.sparse_density > 0 || options.lut_values > 0) {
+        throw std::runtime_error("The tuner's cost model covers the dense lowering; it cannot tune --sparse or --lut.");
+    }
+    if (options.strassen_levels > 0) {
+        throw std::runtime_error("The tuner picks a triple-loop configuration; it cannot be combined with --strassen N.");
+    }
+    lane_count(options.num_cores); // Validates the core limit
+
+    TuneResult result;
+    auto apply = [&](const TuneChoice& choice) {
+        options.num_cores = choice.num_cores;
+        options.tile_rows = choice.tile_rows;
+        options.tile_cols = choice.tile_cols;
+        options.operand_reuse = choice.operand_reuse;
+        options.schedule = choice.schedule;
+        options.strassen_levels = 0;
+        result.choice = choice;
+    };
+    std::string key = TuningDatabase::key(shape, options);
+    TuneChoice stored;
+    if (database && database->find(key, stored)) {
+        apply(stored);
+        result.from_database = true;
+        return result;
+    }
+    try {
+        result.given = estimate_cost(shape, options);
+    } catch (const std::runtime_error&) {
+        // The options as given do not fit; any candidate that does is better
+    }
+
+    size_t k_rows = k_rows_of(shape, options);
+    bool found = false;
+    TuneChoice best;
+    size_t best_tiles = 0;
+    for (uint32_t cores = options.num_cores; cores >= 2; cores -= 2) {
+        uint32_t lanes = cores / 2;
+        // The automatic tiling gives each lane at most one tile; smaller tiles
+        // balance awkward shapes better and shrink the blocks each lane copies
+        for (size_t tile_rows : tile_extents(shape.rows_a, 2 * lanes)) {
+            for (size_t tile_cols : tile_extents(shape.cols_b, 2 * lanes)) {
+                size_t tiles = ceil_div(shape.rows_a, tile_rows) * ceil_div(shape.cols_b, tile_cols);
+                if (tiles > 2 * lanes) continue;
+                TilePlan tiling = plan_tiles(shape.rows_a, shape.cols_b, cores, tile_rows, tile_cols);
+                TilingWork work = tiling_work(tiling, k_rows);
+                result.candidates += 4; // Operand reuse and scheduling, each on or off
+
+                // Skip the memory plan when even the best placement and passes cannot win
+                if (found && !cheaper(work_cost(work, PlacementMode::REPLICATED, true, true, options.machine),
+                                      tiles, best.cost, best_tiles)) {
+                    continue;
+                }
+                MemoryPlan plan;
+                try {
+                    plan = MemoryPlan::build(options.memory, shape.rows_a, shape.cols_a, shape.cols_b, tiling, 0,
+                                             PlacementMode::REPLICATED, options.element_type);
+                } catch (const std::runtime_error&) {
+                    continue;
+                }
+                for (bool operand_reuse : {true, false}) {
+                    for (bool schedule : {true, false}) {
+                        CostEstimate cost = work_cost(work, plan.mode(), operand_reuse, schedule, options.machine);
+                        if (found && !cheaper(cost, tiles, best.cost, best_tiles)) continue;
+                        best = TuneChoice{cores, tile_rows, tile_cols, operand_reuse, schedule, cost};
+                        best_tiles = tiles;
+                        found = true;
+                    }
+                }
+            }
+        }
+    }
+    if (!found) {
+        throw std::runtime_error("No tiling of " + std::to_string(shape.rows_a) + "x" + std::to_string(shape.cols_a) +
+                                 "x" + std::to_string(shape.cols_b) + " fits the memory geometry.");
+    }
+    apply(best);
+    if (database) database->store(key, best);
+    return result;
+}
+
+std::string tune_summary(const TuneResult& result) {
+    const TuneChoice& choice = result.choice;
+    std::ostringstream out;
+    out << choice.num_cores << " cores, " << choice.tile_rows << "x" << choice.tile_cols << " tiles, operand reuse "
+        << (choice.operand_reuse ? "on" : "off") << ", schedule " << (choice.schedule ? "on" : "off")
+        << "; estimated " << choice.cost.cycles << " cycles, " << choice.cost.words << " words";
+    if (result.from_database) {
+        out << " (from the tuning database)";
+    } else {
+        out << " (" << result.candidates << " configurations";
+        if (result.given.cycles > 0) {
+            out << "; as given: " << result.given.cycles << " cycles, " << result.given.words << " words";
+        }
+        out << ")";
+    }
+    return out.str();
+}
+
+} // namespace pim
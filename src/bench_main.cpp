@@ -0,0 +1,571 @@
+#include "cli.hpp"
+#include "compiler.hpp"
+#include "matrix_io.hpp"
+#include "pipeline.hpp"
+#include "program_file.hpp"
+#include "sink.hpp"
+#include <sys/resource.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <new>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace pim;
+
+// Every heap allocation of the process is counted, so a phase's allocations
+// are the difference of two readings
+static std::atomic<uint64_t> allocation_count{0};
+
+void* operator new(size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Small shapes are run until their compiles add up to this, so their best
+// time is not just timer noise
+constexpr double MIN_MEASURED_SECONDS = 0.2;
+constexpr unsigned MAX_RUNS = 1000;
+
+double seconds_since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+struct BenchShape {
+    std::string name;
+    GemmShape shape;
+};
+
+// Default suite: squares, tall-skinny and deep products, and GEMV-like
+// shapes, with dimensions from 8 to 2048. Every one fits the default geometry.
+std::vector<BenchShape> default_suite(bool large) {
+    std::vector<BenchShape> suite;
+    for (size_t n : {8, 16, 32, 64, 128, 256}) {
+        suite.push_back({"square-" + std::to_string(n), {n, n, n}});
+    }
+    if (large) {
+        suite.push_back({"square-512", {512, 512, 512}});
+    }
+    suite.push_back({"tall-2048x64x16", {2048, 64, 16}});
+    suite.push_back({"tall-2048x16x64", {2048, 16, 64}});
+    suite.push_back({"deep-16x2048x16", {16, 2048, 16}});
+    suite.push_back({"gemv-2048x512x1", {2048, 512, 1}});
+    suite.push_back({"gemv-1x2048x512", {1, 2048, 512}});
+    suite.push_back({"gemv-2048x8x1", {2048, 8, 1}});
+    return suite;
+}
+
+// Parses "MxKxN"
+GemmShape parse_shape(const std::string& text) {
+    GemmShape shape;
+    char x1 = 0, x2 = 0;
+    std::istringstream in(text);
+    if (!(in >> shape.rows_a >> x1 >> shape.cols_a >> x2 >> shape.cols_b) || x1 != 'x' || x2 != 'x' ||
+        in.peek() != EOF || shape.rows_a == 0 || shape.cols_a == 0 || shape.cols_b == 0) {
+        throw std::runtime_error("Expected --shape MxKxN, got '" + text + "'");
+    }
+    return shape;
+}
+
+// Writes a random A and B as a C++ input file, the format pim_compiler parses
+void write_random_input(const std::string& path, const GemmShape& shape, std::mt19937& random) {
+    std::uniform_int_distribution<int> value(-128, 127);
+    std::FILE* file = std::fopen(path.c_str(), "w");
+    if (!file) {
+        throw std::runtime_error("Could not open output file: " + path);
+    }
+    auto write_matrix = [&](const char* name, size_t rows, size_t cols) {
+        std::fprintf(file, "std::vector<std::vector<int>> %s = {", name);
+        for (size_t i = 0; i < rows; ++i) {
+            std::fputs(i ? ",\n    {" : "\n    {", file);
+            for (size_t j = 0; j < cols; ++j) {
+                std::fprintf(file, j ? ", %d" : "%d", value(random));
+            }
+            std::fputc('}', file);
+        }
+        std::fputs("\n};\n", file);
+    };
+    write_matrix("matrix_a", shape.rows_a, shape.cols_a);
+    write_matrix("matrix_b", shape.cols_a, shape.cols_b);
+    if (std::fclose(file) != 0) {
+        throw std::runtime_error("Failed to write " + path + ".");
+    }
+}
+
+// Peak resident set size since the last reset_peak_rss(), in bytes
+void reset_peak_rss() {
+    // Linux resets VmHWM when "5" is written here; elsewhere the peak stays process-wide
+    if (std::FILE* file = std::fopen("/proc/self/clear_refs", "w")) {
+        std::fputs("5", file);
+        std::fclose(file);
+    }
+}
+
+uint64_t peak_rss() {
+    if (std::FILE* file = std::fopen("/proc/self/status", "r")) {
+        char line[256];
+        while (std::fgets(line, sizeof(line), file)) {
+            unsigned long long kib = 0;
+            if (std::sscanf(line, "VmHWM: %llu kB", &kib) == 1) {
+                std::fclose(file);
+                return kib * 1024;
+            }
+        }
+        std::fclose(file);
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+}
+
+// Packs the program like -o does, but throws the bytes away
+class DiscardingProgramSink : public PackedProgramSink {
+public:
+    DiscardingProgramSink(const CompileOptions& options, const CompileReport& report)
+        : PackedProgramSink(options, report) {}
+
+protected:
+    void put_bytes(const unsigned char*, size_t) override {}
+    void put_header(const unsigned char*) override {}
+};
+
+// Measurements of one shape; times are the best over the repetitions
+struct BenchResult {
+    std::string name;
+    GemmShape shape;
+    uint64_t instructions = 0;
+    uint64_t ir_ops = 0;
+    double parse_seconds = 0;
+    double ir_build_seconds = 0;  // Tiling, memory plan, IR generation and passes
+    double translate_seconds = 0; // IR to instruction words
+    double emit_seconds = 0;      // Packing the words into a container
+    double compile_seconds = 0;   // End to end, as pim_compiler runs it
+    uint64_t peak_rss_bytes = 0;
+    uint64_t allocations = 0;     // During the end-to-end compile
+
+    double instructions_per_second() const {
+        return compile_seconds > 0 ? instructions / compile_seconds : 0.0;
+    }
+    double allocations_per_instruction() const {
+        return instructions > 0 ? static_cast<double>(allocations) / instructions : 0.0;
+    }
+};
+
+// Runs the pipeline stage by stage, one lane after another, timing each
+// stage separately. Lanes are not interleaved, which changes the word order
+// but not the work.
+void measure_phases(const Matrix& matrix_a, const Matrix& matrix_b, const CompileOptions& options,
+                    BenchResult& result)
+{
+    Clock::time_point start = Clock::now();
+    CompileReport report;
+    report.tiling = plan_replicable_tiles(options.memory, matrix_a.rows(), matrix_a.cols(), matrix_b.cols(),
+                                          options.num_cores, options.tile_rows, options.tile_cols,
+                                          options.element_type);
+    report.memory = MemoryPlan::build(options.memory, matrix_a.rows(), matrix_a.cols(), matrix_b.cols(),
+                                      report.tiling, 0, PlacementMode::REPLICATED, options.element_type);
+    double ir_build = seconds_since(start);
+    double translate = 0;
+    double emit = 0;
+
+    std::vector<const MemoryPlan*> plans{&report.memory};
+    DiscardingProgramSink packer(options, report);
+    size_t chunk_ops = std::max<size_t>(options.chunk_ops, 1);
+    std::vector<IROperation> ir_chunk(chunk_ops);
+    std::vector<InstructionWord> words(chunk_ops);
+    uint64_t ir_ops = 0;
+    for (uint32_t lane = 0; lane < report.tiling.lanes; ++lane) {
+        LaneStream stream(report.tiling.lane_tiles[lane], plans, options.operand_reuse, chunk_ops,
+                          options.schedule ? &options.machine : nullptr);
+        for (;;) {
+            start = Clock::now();
+            size_t ops = 0;
+            while (ops < chunk_ops && stream.next(ir_chunk[ops])) ++ops;
+            ir_build += seconds_since(start);
+            if (ops == 0) {
+                ir_ops += stream.stats().ir_ops;
+                break;
+            }
+
+            start = Clock::now();
+            size_t count = 0;
+            for (size_t n = 0; n < ops; ++n) {
+                if (Compiler::translate_ir_op(ir_chunk[n], lane, report.memory, words[count])) ++count;
+            }
+            translate += seconds_since(start);
+
+            start = Clock::now();
+            packer.write(words.data(), count);
+            emit += seconds_since(start);
+        }
+    }
+    start = Clock::now();
+    packer.finish();
+    emit += seconds_since(start);
+
+    result.ir_ops = ir_ops;
+    result.ir_build_seconds = std::min(result.ir_build_seconds, ir_build);
+    result.translate_seconds = std::min(result.translate_seconds, translate);
+    result.emit_seconds = std::min(result.emit_seconds, emit);
+}
+
+BenchResult run_shape(const BenchShape& bench, const CompileOptions& options, unsigned repeat,
+                      std::mt19937& random, const std::string& scratch)
+{
+    BenchResult result;
+    result.name = bench.name;
+    result.shape = bench.shape;
+    result.parse_seconds = result.ir_build_seconds = result.translate_seconds = result.emit_seconds =
+        result.compile_seconds = INFINITY;
+
+    write_random_input(scratch, bench.shape, random);
+    reset_peak_rss();
+    double measured = 0;
+    for (unsigned run = 0; run < repeat || (measured < MIN_MEASURED_SECONDS && run < MAX_RUNS); ++run) {
+        Clock::time_point start = Clock::now();
+        std::pair<Matrix, Matrix> matrices = read_matrix_inputs({scratch});
+        result.parse_seconds = std::min(result.parse_seconds, seconds_since(start));
+
+        measure_phases(matrices.first, matrices.second, options, result);
+
+        Compiler compiler(options);
+        CallbackSink discard([](const InstructionWord*, size_t) {});
+        uint64_t allocations = allocation_count.load(std::memory_order_relaxed);
+        start = Clock::now();
+        result.instructions = compiler.compile_matrix_mult(matrices.first, matrices.second, discard);
+        double compile_seconds = seconds_since(start);
+        result.compile_seconds = std::min(result.compile_seconds, compile_seconds);
+        measured += compile_seconds;
+        result.allocations = allocation_count.load(std::memory_order_relaxed) - allocations;
+    }
+    result.peak_rss_bytes = peak_rss();
+    std::remove(scratch.c_str());
+    return result;
+}
+
+// --- JSON output and the baseline reader ---
+
+std::string json_escape(const std::string& text) {
+    std::string out;
+    for (char c : text) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out;
+}
+
+void write_json(std::ostream& out, const std::vector<BenchResult>& results, const CompileOptions& options,
+                unsigned repeat)
+{
+    out << std::setprecision(9);
+    out << "{\n"
+        << "  \"benchmark\": \"pim_bench\",\n"
+        << "  \"format\": 1,\n"
+        << "  \"compiler_revision\": " << COMPILER_REVISION << ",\n"
+        << "  \"num_cores\": " << options.num_cores << ",\n"
+        << "  \"threads\": " << options.threads << ",\n"
+        << "  \"repeat\": " << repeat << ",\n"
+        << "  \"results\": [";
+    for (size_t r = 0; r < results.size(); ++r) {
+        const BenchResult& result = results[r];
+        out << (r ? ",\n" : "\n") << "    {\n"
+            << "      \"name\": \"" << json_escape(result.name) << "\",\n"
+            << "      \"rows_a\": " << result.shape.rows_a << ",\n"
+            << "      \"cols_a\": " << result.shape.cols_a << ",\n"
+            << "      \"cols_b\": " << result.shape.cols_b << ",\n"
+            << "      \"instructions\": " << result.instructions << ",\n"
+            << "      \"ir_ops\": " << result.ir_ops << ",\n"
+            << "      \"parse_seconds\": " << result.parse_seconds << ",\n"
+            << "      \"ir_build_seconds\": " << result.ir_build_seconds << ",\n"
+            << "      \"translate_seconds\": " << result.translate_seconds << ",\n"
+            << "      \"emit_seconds\": " << result.emit_seconds << ",\n"
+            << "      \"compile_seconds\": " << result.compile_seconds << ",\n"
+            << "      \"instructions_per_second\": " << result.instructions_per_second() << ",\n"
+            << "      \"peak_rss_bytes\": " << result.peak_rss_bytes << ",\n"
+            << "      \"allocations\": " << result.allocations << ",\n"
+            << "      \"allocations_per_instruction\": " << result.allocations_per_instruction() << "\n"
+            << "    }";
+    }
+    out << "\n  ]\n}\n";
+}
+
+// Just enough JSON to read a file written by write_json: every result's
+// name and numeric fields
+class BaselineReader {
+public:
+    explicit BaselineReader(const std::string& text) : p_(text.c_str()), end_(p_ + text.size()) {}
+
+    std::map<std::string, std::map<std::string, double>> read() {
+        std::map<std::string, std::map<std::string, double>> results;
+        expect('{');
+        while (!consume('}')) {
+            std::string key = read_string();
+            expect(':');
+            if (key == "results") {
+                expect('[');
+                while (!consume(']')) {
+                    std::string name;
+                    std::map<std::string, double> fields;
+                    expect('{');
+                    while (!consume('}')) {
+                        std::string field = read_string();
+                        expect(':');
+                        if (peek() == '"') {
+                            std::string value = read_string();
+                            if (field == "name") name = value;
+                        } else {
+                            fields[field] = read_number();
+                        }
+                        consume(',');
+                    }
+                    results[name] = fields;
+                    consume(',');
+                }
+            } else if (peek() == '"') {
+                read_string();
+            } else {
+                read_number();
+            }
+            consume(',');
+        }
+        return results;
+    }
+
+private:
+    char peek() {
+        while (p_ != end_ && std::isspace(static_cast<unsigned char>(*p_))) ++p_;
+        return p_ == end_ ? '\0' : *p_;
+    }
+    bool consume(char c) {
+        if (peek() != c) return false;
+        ++p_;
+        return true;
+    }
+    void expect(char c) {
+        if (!consume(c)) throw std::runtime_error(std::string("Baseline is not pim_bench JSON (expected '") + c + "').");
+    }
+    std::string read_string() {
+        expect('"');
+        std::string value;
+        while (p_ != end_ && *p_ != '"') {
+            if (*p_ == '\\' && p_ + 1 != end_) ++p_;
+            value += *p_++;
+        }
+        expect('"');
+        return value;
+    }
+    double read_number() {
+        peek();
+        char* number_end = nullptr;
+        double value = std::strtod(p_, &number_end);
+        if (number_end == p_) throw std::runtime_error("Baseline is not pim_bench JSON (expected a number).");
+        p_ = number_end;
+        return value;
+    }
+
+    const char* p_;
+    const char* end_;
+};
+
+// Prints current against baseline; returns the number of regressions beyond threshold
+size_t compare_with_baseline(const std::vector<BenchResult>& results, const std::string& path, double threshold,
+                             std::ostream& out)
+{
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("Could not open baseline: " + path);
+    }
+    std::stringstream text;
+    text << file.rdbuf();
+    std::map<std::string, std::map<std::string, double>> baseline = BaselineReader(text.str()).read();
+
+    out << "\nAgainst baseline " << path << " (threshold " << std::fixed << std::setprecision(0)
+              << threshold * 100 << "%):\n"
+              << "  shape                  instr/s change   alloc/instr change   peak RSS change\n";
+    size_t regressions = 0;
+    auto change = [](double current, double base) { return base > 0 ? current / base - 1.0 : 0.0; };
+    for (const BenchResult& result : results) {
+        auto found = baseline.find(result.name);
+        if (found == baseline.end()) {
+            out << "  " << std::left << std::setw(22) << result.name << std::right << " not in baseline\n";
+            continue;
+        }
+        std::map<std::string, double>& base = found->second;
+        // Throughput must not drop; allocations and memory must not grow
+        double speed = change(result.instructions_per_second(), base["instructions_per_second"]);
+        double allocations = change(static_cast<double>(result.allocations), std::max(base["allocations"], 1.0));
+        double memory = change(static_cast<double>(result.peak_rss_bytes), base["peak_rss_bytes"]);
+        std::vector<std::string> failed;
+        if (speed < -threshold) failed.push_back("throughput");
+        if (result.allocations > base["allocations"] && allocations > threshold) failed.push_back("allocations");
+        if (memory > threshold) failed.push_back("peak RSS");
+        if (base["instructions"] != static_cast<double>(result.instructions)) {
+            failed.push_back("instruction count " + std::to_string(static_cast<uint64_t>(base["instructions"])) +
+                             " -> " + std::to_string(result.instructions));
+        }
+
+        out << "  " << std::left << std::setw(22) << result.name << std::right << std::showpos
+                  << std::fixed << std::setprecision(1) << std::setw(15) << speed * 100 << "%"
+                  << std::setw(19) << allocations * 100 << "%" << std::setw(16) << memory * 100 << "%"
+                  << std::noshowpos;
+        for (size_t f = 0; f < failed.size(); ++f) {
+            out << (f ? ", " : "  REGRESSION: ") << failed[f];
+        }
+        out << "\n";
+        regressions += failed.empty() ? 0 : 1;
+    }
+    return regressions;
+}
+
+// A relative change such as 0.1; atof would take "1O" for 1 and junk for 0
+double parse_threshold(const std::string& text) {
+    try {
+        size_t consumed = 0;
+        double value = std::stod(text, &consumed);
+        if (consumed != text.size() || !(value >= 0)) throw std::invalid_argument(text);
+        return value;
+    } catch (const std::exception&) {
+        throw std::runtime_error("Invalid value '" + text + "' for --threshold (expected a fraction, e.g. 0.1)");
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    CompileOptions options;
+    options.specialized = false; // Measure the pipeline, not a table copy; the triple loop, not Strassen
+    std::vector<BenchShape> shapes;
+    std::string filter;
+    std::string json_output;
+    std::string baseline;
+    double threshold = 0.10;
+    unsigned repeat = 3;
+    unsigned seed = 1;
+    bool large = false;
+    bool usage = false;
+
+    try {
+        for (int arg = 1; arg < argc; ++arg) {
+            std::string flag = argv[arg];
+            if (parse_compile_option(argc, argv, arg, options)) continue;
+            bool has_value = arg + 1 < argc;
+            if (flag == "--shape" && has_value) {
+                std::string text = argv[++arg];
+                shapes.push_back({text, parse_shape(text)});
+            } else if (flag == "--filter" && has_value) {
+                filter = argv[++arg];
+            } else if (flag == "--large") {
+                large = true;
+            } else if (flag == "--repeat" && has_value) {
+                repeat = parse_number<unsigned>(argv[++arg], flag);
+                if (repeat == 0) throw std::runtime_error("--repeat must be at least 1");
+            } else if (flag == "--seed" && has_value) {
+                seed = parse_number<unsigned>(argv[++arg], flag);
+            } else if (flag == "--json" && has_value) {
+                json_output = argv[++arg];
+            } else if (flag == "--baseline" && has_value) {
+                baseline = argv[++arg];
+            } else if (flag == "--threshold" && has_value) {
+                threshold = parse_threshold(argv[++arg]);
+            } else {
+                throw std::runtime_error("Unexpected argument: " + flag);
+            }
+        }
+        // The phase columns time the dense triple loop, so the compile they sit next to must be one
+        if (options.sparse_density > 0 || options.lut_values > 0 || options.strassen_levels > 0 || options.autotune) {
+            throw std::runtime_error("pim_bench measures the dense triple loop; --sparse, --lut, --strassen N and "
+                                     "--tune are not supported");
+        }
+        options.strassen_levels = 0;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        usage = true;
+    }
+    if (usage) {
+        std::cerr << "Usage: " << argv[0] << " [--shape MxKxN]... [--filter TEXT] [--large] [--repeat N] [--seed N]"
+                     " [--json FILE] [--baseline FILE [--threshold F]] [options]\n"
+                  << "  --shape MxKxN   Benchmark this shape instead of the default suite (repeatable)\n"
+                  << "  --filter TEXT   Only shapes whose name contains TEXT\n"
+                  << "  --large         Add square-512 to the default suite\n"
+                  << "  --repeat N      Runs per shape, more for small ones; the best time counts (default 3)\n"
+                  << "  --seed N        Seed of the random matrices (default 1)\n"
+                  << "  --json FILE     Write the results as JSON (- for stdout)\n"
+                  << "  --baseline FILE Compare against an earlier --json file; exits with 2 on regressions\n"
+                  << "  --threshold F   Allowed relative change before it counts as a regression (default 0.1)\n"
+                  << compile_options_usage();
+        return 1;
+    }
+    if (shapes.empty()) {
+        shapes = default_suite(large);
+    }
+    if (!filter.empty()) {
+        shapes.erase(std::remove_if(shapes.begin(), shapes.end(),
+                                    [&](const BenchShape& s) { return s.name.find(filter) == std::string::npos; }),
+                     shapes.end());
+    }
+
+    // The table goes to stderr when the JSON goes to stdout
+    std::ostream& log = (json_output == "-") ? std::cerr : std::cout;
+    try {
+        std::string scratch = "pim_bench_" + std::to_string(getpid()) + ".cpp";
+        std::mt19937 random(seed);
+        std::vector<BenchResult> results;
+        log << "  shape                  instructions   parse  ir build  translate    emit  compile"
+               "     M instr/s  peak RSS MiB  alloc/instr\n";
+        for (const BenchShape& shape : shapes) {
+            results.push_back(run_shape(shape, options, repeat, random, scratch));
+            const BenchResult& result = results.back();
+            auto ms = [](double seconds) { return seconds * 1e3; };
+            log << "  " << std::left << std::setw(22) << result.name << std::right << std::setw(13)
+                << result.instructions << std::fixed << std::setprecision(1) << std::setw(8)
+                << ms(result.parse_seconds) << std::setw(10) << ms(result.ir_build_seconds) << std::setw(11)
+                << ms(result.translate_seconds) << std::setw(8) << ms(result.emit_seconds) << std::setw(9)
+                << ms(result.compile_seconds) << std::setw(14) << result.instructions_per_second() / 1e6
+                << std::setw(14) << result.peak_rss_bytes / 1048576.0 << std::setprecision(5) << std::setw(13)
+                << result.allocations_per_instruction() << "\n";
+        }
+        log << "  (times in ms, best of at least " << repeat << " runs)\n";
+
+        if (json_output == "-") {
+            write_json(std::cout, results, options, repeat);
+        } else if (!json_output.empty()) {
+            std::ofstream out(json_output);
+            write_json(out, results, options, repeat);
+            if (!out.flush()) {
+                throw std::runtime_error("Failed to write " + json_output + ".");
+            }
+            log << "Wrote " << json_output << "\n";
+        }
+
+        if (!baseline.empty()) {
+            size_t regressions = compare_with_baseline(results, baseline, threshold, log);
+            log << (regressions ? std::to_string(regressions) + " shape(s) regressed\n" : "No regressions\n");
+            return regressions ? 2 : 0;
+        }
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+}
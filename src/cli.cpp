@@ -0,0 +1,126 @@
+#include "cli.hpp"
+#include <stdexcept>
+
+namespace pim {
+
+namespace {
+
+// Returns the value following the flag at argv[index]
+std::string next_value(int argc, char* argv[], int& index) {
+    if (index + 1 >= argc) {
+        throw std::runtime_error(std::string("Missing value for ") + argv[index]);
+    }
+    return argv[++index];
+}
+
+// Parses "load=N,store=N,mac=N,setup=N,bank=N"; keys may be omitted
+void parse_machine(const std::string& text, MachineModel& machine) {
+    size_t begin = 0;
+    while (begin < text.size()) {
+        size_t end = text.find(',', begin);
+        if (end == std::string::npos) end = text.size();
+        std::string item = text.substr(begin, end - begin);
+        size_t equals = item.find('=');
+        if (equals == std::string::npos) {
+            throw std::runtime_error("Expected key=value in --machine, got '" + item + "'");
+        }
+        std::string key = item.substr(0, equals);
+        uint32_t value = parse_number<uint32_t>(item.substr(equals + 1), "--machine " + key);
+        if (key == "load") machine.load_latency = value;
+        else if (key == "store") machine.store_latency = value;
+        else if (key == "mac") machine.mac_latency = value;
+        else if (key == "setup") machine.setup_latency = value;
+        else if (key == "bank") machine.bank_cycles = value;
+        else throw std::runtime_error("Unknown --machine key '" + key + "'");
+        begin = end + 1;
+    }
+}
+
+double parse_fraction(const std::string& text, const std::string& flag) {
+    try {
+        size_t consumed = 0;
+        double value = std::stod(text, &consumed);
+        if (consumed != text.size() || !(value >= 0.0 && value <= 1.0)) throw std::invalid_argument(text);
+        return value;
+    } catch (const std::exception&) {
+        throw std::runtime_error("Invalid value '" + text + "' for " + flag + " (expected 0..1)");
+    }
+}
+
+} // namespace
+
+bool parse_compile_option(int argc, char* argv[], int& index, CompileOptions& options) {
+    std::string arg = argv[index];
+    if (arg == "--cores") {
+        options.num_cores = parse_number<uint32_t>(next_value(argc, argv, index), arg);
+    } else if (arg == "--tile") {
+        std::string value = next_value(argc, argv, index);
+        size_t x = value.find('x');
+        if (x == std::string::npos) {
+            throw std::runtime_error("Expected --tile RxC, got '" + value + "'");
+        }
+        options.tile_rows = parse_number<size_t>(value.substr(0, x), arg);
+        options.tile_cols = parse_number<size_t>(value.substr(x + 1), arg);
+    } else if (arg == "--no-reuse") {
+        options.operand_reuse = false;
+    } else if (arg == "--banks") {
+        options.memory.num_banks = parse_number<uint32_t>(next_value(argc, argv, index), arg);
+    } else if (arg == "--bank-rows") {
+        options.memory.rows_per_bank = parse_number<uint32_t>(next_value(argc, argv, index), arg);
+    } else if (arg == "--chunk") {
+        options.chunk_ops = parse_number<size_t>(next_value(argc, argv, index), arg);
+    } else if (arg == "--schedule") {
+        options.schedule = true;
+    } else if (arg == "--machine") {
+        parse_machine(next_value(argc, argv, index), options.machine);
+    } else if (arg == "--sparse") {
+        options.sparse_density = parse_fraction(next_value(argc, argv, index), arg);
+    } else if (arg == "--strassen") {
+        std::string value = next_value(argc, argv, index);
+        options.strassen_levels = (value == "auto") ? -1 : parse_number<int>(value, arg);
+    } else if (arg == "--strassen-cutoff") {
+        options.strassen_cutoff = parse_number<size_t>(next_value(argc, argv, index), arg);
+    } else if (arg == "--element") {
+        std::string value = next_value(argc, argv, index);
+        if (value == "int32") options.element_type = ElementType::INT32;
+        else if (value == "int16") options.element_type = ElementType::INT16;
+        else if (value == "int8") options.element_type = ElementType::INT8;
+        else throw std::runtime_error("Expected --element int32, int16 or int8, got '" + value + "'");
+    } else if (arg == "--lut") {
+        options.lut_values = parse_number<size_t>(next_value(argc, argv, index), arg);
+    } else if (arg == "--tune") {
+        options.autotune = true;
+    } else if (arg == "--tune-db") {
+        options.tuning_database = next_value(argc, argv, index);
+        options.autotune = true;
+    } else if (arg == "--no-specialized") {
+        options.specialized = false;
+    } else if (arg == "--threads") {
+        options.threads = parse_number<unsigned>(next_value(argc, argv, index), arg);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+std::string compile_options_usage() {
+    return "  --cores N       Cores to use (even, 2..64, default 64)\n"
+           "  --tile RxC      C tile size per lane (default: automatic)\n"
+           "  --no-reuse      Disable the operand-reuse pass\n"
+           "  --banks N       Memory banks available to the planner (default 4096)\n"
+           "  --bank-rows N   Rows per bank, at most 512 (default 512)\n"
+           "  --chunk N       IR operations generated per lane at a time (default 4096)\n"
+           "  --threads N     Compile on N threads, 0 = all (default 1: serial streaming)\n"
+           "  --no-specialized  Always run the pipeline, even for shapes with a built-in program\n"
+           "  --schedule      Reorder for latency, double-buffering the operand latches\n"
+           "  --machine SPEC  Latencies, e.g. load=4,store=4,mac=1,setup=1,bank=2 (the defaults)\n"
+           "  --sparse D      Skip zero operands in tiles whose product density is at most D\n"
+           "  --strassen N|auto  Strassen recursion depth, 0 = triple loop (default: auto)\n"
+           "  --strassen-cutoff N  Smallest leaf dimension auto recurses to (default 64)\n"
+           "  --element T     Pack operands as int32, int16 or int8 (default int32)\n"
+           "  --lut N         Table lookups instead of MACs where B has at most N distinct nonzero values\n"
+           "  --tune          Pick cores, tile size and passes for the shape with the cost model\n"
+           "  --tune-db FILE  Keep the tuner's choices in FILE and reuse them (implies --tune)\n";
+}
+
+} // namespace pim
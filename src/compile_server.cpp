@@ -0,0 +1,623 @@
+#include "compile_server.hpp"
+#include "cli.hpp"
+#include "matrix_io.hpp"
+#include "program_file.hpp"
+#include "sink.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace pim {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Longest request line; a longer one ends the connection
+constexpr size_t MAX_REQUEST_LINE = 1 << 16;
+
+// Largest --inline payload, A and B together
+constexpr uint64_t MAX_INLINE_BYTES = 1ull << 34;
+
+enum class ProgramFormat { PIMB, RAW, NONE };
+
+// Buffered reads of request lines and binary payloads from a descriptor
+class FdReader {
+public:
+    explicit FdReader(int fd) : fd_(fd), buffer_(1 << 16) {}
+
+    // Next line, without its line ending; false at the end of input
+    bool read_line(std::string& line) {
+        line.clear();
+        while (true) {
+            const char* start = buffer_.data() + begin_;
+            const char* newline = static_cast<const char*>(std::memchr(start, '\n', end_ - begin_));
+            if (newline) {
+                line.append(start, newline);
+                begin_ += newline - start + 1;
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                return true;
+            }
+            line.append(start, end_ - begin_);
+            begin_ = end_ = 0;
+            if (line.size() > MAX_REQUEST_LINE) {
+                throw std::runtime_error("Request line longer than " + std::to_string(MAX_REQUEST_LINE) + " bytes.");
+            }
+            if (!fill()) return !line.empty();
+        }
+    }
+
+    // Reads exactly count bytes; false if the input ends first
+    bool read_bytes(unsigned char* out, uint64_t count) {
+        while (count > 0) {
+            if (begin_ == end_) {
+                begin_ = end_ = 0;
+                if (!fill()) return false;
+            }
+            size_t available = static_cast<size_t>(std::min<uint64_t>(count, end_ - begin_));
+            std::memcpy(out, buffer_.data() + begin_, available);
+            begin_ += available;
+            out += available;
+            count -= available;
+        }
+        return true;
+    }
+
+private:
+    // Reads into the empty buffer; false at the end of input or once the
+    // connection is shut down
+    bool fill() {
+        while (true) {
+            ssize_t count = ::read(fd_, buffer_.data(), buffer_.size());
+            if (count > 0) {
+                end_ = static_cast<size_t>(count);
+                return true;
+            }
+            if (count < 0 && errno == EINTR) continue;
+            return false;
+        }
+    }
+
+    int fd_;
+    std::vector<char> buffer_;
+    size_t begin_ = 0;
+    size_t end_ = 0;
+};
+
+// Writes all of data; false once the peer is gone
+bool write_all(int fd, const void* data, size_t size) {
+    const char* p = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t count = ::write(fd, p, size);
+        if (count < 0 && errno == EINTR) continue;
+        if (count <= 0) return false;
+        p += count;
+        size -= static_cast<size_t>(count);
+    }
+    return true;
+}
+
+std::vector<std::string> split_words(const std::string& line) {
+    std::istringstream in(line);
+    std::vector<std::string> words;
+    std::string word;
+    while (in >> word) words.push_back(word);
+    return words;
+}
+
+// Error text on one line, so it cannot break the framing
+std::string one_line(std::string text) {
+    std::replace(text.begin(), text.end(), '\n', ' ');
+    std::replace(text.begin(), text.end(), '\r', ' ');
+    return text;
+}
+
+// Parses "MxKxN"
+GemmShape parse_shape(const std::string& text, const std::string& flag) {
+    size_t dims[3];
+    size_t begin = 0;
+    for (int n = 0; n < 3; ++n) {
+        size_t end = n < 2 ? text.find('x', begin) : text.size();
+        if (end == std::string::npos) end = begin;
+        std::string part = text.substr(begin, end - begin);
+        size_t consumed = 0;
+        try {
+            dims[n] = static_cast<size_t>(std::stoull(part, &consumed));
+        } catch (const std::exception&) {
+            consumed = 0;
+        }
+        if (part.empty() || consumed != part.size() || dims[n] == 0) {
+            throw std::runtime_error("Expected " + flag + " MxKxN, got '" + text + "'");
+        }
+        begin = end + 1;
+    }
+    GemmShape shape;
+    shape.rows_a = dims[0];
+    shape.cols_a = dims[1];
+    shape.cols_b = dims[2];
+    return shape;
+}
+
+// Size of the --inline payload following a compile request (0 without one)
+uint64_t inline_payload_bytes(const std::vector<std::string>& words, GemmShape& shape) {
+    for (size_t n = 2; n < words.size(); ++n) {
+        if (words[n] != "--inline") continue;
+        if (n + 1 == words.size()) throw std::runtime_error("Missing value for --inline");
+        shape = parse_shape(words[n + 1], "--inline");
+        long double elements = static_cast<long double>(shape.rows_a) * shape.cols_a +
+                               static_cast<long double>(shape.cols_a) * shape.cols_b;
+        if (elements * 4 > MAX_INLINE_BYTES) {
+            throw std::runtime_error("--inline " + words[n + 1] + " exceeds the " +
+                                     std::to_string(MAX_INLINE_BYTES >> 30) + " GiB payload limit");
+        }
+        return static_cast<uint64_t>(elements) * 4;
+    }
+    return 0;
+}
+
+Matrix decode_matrix(const unsigned char* bytes, size_t rows, size_t cols) {
+    std::vector<int32_t> elements(rows * cols);
+    for (size_t n = 0; n < elements.size(); ++n) {
+        elements[n] = static_cast<int32_t>(get_u32(bytes + 4 * n));
+    }
+    return Matrix(rows, cols, std::move(elements));
+}
+
+int64_t microseconds(double seconds) {
+    return static_cast<int64_t>(std::llround(seconds * 1e6));
+}
+
+} // namespace
+
+struct CompileServer::Connection {
+    explicit Connection(int fd) : out_fd(fd) {}
+
+    // Writes one response; dropped once the peer is gone
+    void send(const std::string& header, const std::vector<unsigned char>& program = {},
+              const std::string& stats = std::string()) {
+        std::lock_guard<std::mutex> lock(write_mutex);
+        if (broken) return;
+        broken = !write_all(out_fd, header.data(), header.size()) ||
+                 !write_all(out_fd, program.data(), program.size()) ||
+                 !write_all(out_fd, stats.data(), stats.size());
+    }
+
+    void send_error(const std::string& id, const std::string& message) {
+        send("error " + id + " " + one_line(message) + "\n");
+    }
+
+    int out_fd;
+    std::mutex write_mutex;
+    bool broken = false;
+
+    std::mutex pending_mutex;
+    std::condition_variable idle;
+    size_t pending = 0; // Compile requests queued or running
+};
+
+struct CompileServer::Job {
+    std::shared_ptr<Connection> connection;
+    Clock::time_point received;
+    std::string id;
+    CompileOptions options;
+    std::vector<std::string> inputs; // Files to read the operands from
+    GemmShape shape;
+    bool shape_only = false;         // --shape: dense compile without values
+    bool has_values = false;         // matrix_a and matrix_b hold the operands
+    Matrix matrix_a;
+    Matrix matrix_b;
+    ProgramFormat format = ProgramFormat::PIMB;
+    bool stats = false;
+};
+
+CompileServer::CompileServer(const CompileServerOptions& options)
+    : options_(options), cache_(options.cache_directory, options.cache_limits),
+      tuning_(options.defaults.tuning_database)
+{
+    if (options_.workers > MAX_SERVER_WORKERS) {
+        throw std::runtime_error("A compile server runs at most " + std::to_string(MAX_SERVER_WORKERS) + " workers.");
+    }
+    unsigned workers = options_.workers != 0 ? options_.workers : std::thread::hardware_concurrency();
+    for (unsigned n = 0; n < std::max(workers, 1u); ++n) {
+        workers_.emplace_back([this] { worker_loop(); });
+    }
+}
+
+CompileServer::~CompileServer() {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        stop_workers_ = true;
+    }
+    queue_ready_.notify_all();
+    for (std::thread& worker : workers_) worker.join();
+}
+
+void CompileServer::serve(int in_fd, int out_fd) {
+    run_connection(in_fd, out_fd);
+}
+
+void CompileServer::listen(const std::string& path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Invalid socket path: " + path);
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    struct stat status;
+    if (::stat(path.c_str(), &status) == 0) {
+        if (!S_ISSOCK(status.st_mode)) {
+            throw std::runtime_error(path + " exists and is not a socket.");
+        }
+        ::unlink(path.c_str()); // Left behind by a server that did not shut down
+    }
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        throw std::runtime_error(std::string("Could not create a socket: ") + std::strerror(errno));
+    }
+    if (::bind(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+        ::listen(fd, SOMAXCONN) != 0) {
+        std::string reason = std::strerror(errno);
+        ::close(fd);
+        throw std::runtime_error("Could not listen on " + path + ": " + reason);
+    }
+    {
+        std::lock_guard<std::mutex> lock(connections_mutex_);
+        listen_fd_ = fd;
+    }
+
+    struct Client {
+        std::thread thread;
+        std::shared_ptr<std::atomic<bool>> done;
+    };
+    std::vector<Client> clients;
+    std::string failure;
+    while (!shutting_down_) {
+        int client = ::accept(fd, nullptr, nullptr);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (!shutting_down_) failure = std::strerror(errno);
+            break;
+        }
+        {
+            std::lock_guard<std::mutex> lock(connections_mutex_);
+            if (shutting_down_) {
+                ::close(client);
+                break;
+            }
+            open_connections_.insert(client);
+        }
+        // Join the threads of connections that have closed
+        clients.erase(std::remove_if(clients.begin(), clients.end(), [](Client& finished) {
+            if (!*finished.done) return false;
+            finished.thread.join();
+            return true;
+        }), clients.end());
+
+        auto done = std::make_shared<std::atomic<bool>>(false);
+        clients.push_back(Client{std::thread([this, client, done] {
+            run_connection(client, client);
+            {
+                std::lock_guard<std::mutex> lock(connections_mutex_);
+                open_connections_.erase(client);
+            }
+            ::close(client);
+            *done = true;
+        }), done});
+    }
+    {
+        std::lock_guard<std::mutex> lock(connections_mutex_);
+        listen_fd_ = -1;
+    }
+    ::close(fd);
+    ::unlink(path.c_str());
+    for (Client& client : clients) client.thread.join();
+    if (!failure.empty()) {
+        throw std::runtime_error("Could not accept a connection on " + path + ": " + failure);
+    }
+}
+
+void CompileServer::request_shutdown() {
+    shutting_down_ = true;
+    std::lock_guard<std::mutex> lock(connections_mutex_);
+    // Wakes the accept loop and every connection's reader; answers still go out
+    if (listen_fd_ >= 0) ::shutdown(listen_fd_, SHUT_RDWR);
+    for (int fd : open_connections_) ::shutdown(fd, SHUT_RD);
+}
+
+void CompileServer::run_connection(int in_fd, int out_fd) {
+    auto connection = std::make_shared<Connection>(out_fd);
+    FdReader reader(in_fd);
+    std::string line;
+    try {
+        while (!shutting_down_ && reader.read_line(line)) {
+            std::vector<std::string> words = split_words(line);
+            if (words.empty() || words[0][0] == '#') continue;
+            const std::string& verb = words[0];
+            std::string id = words.size() > 1 ? words[1] : "-";
+            if (verb == "quit") break;
+            if (verb == "shutdown") {
+                request_shutdown();
+                break;
+            }
+            if (verb == "stats" && words.size() == 2) {
+                send_stats(*connection, id);
+                continue;
+            }
+            if (verb != "compile" || words.size() < 2) {
+                connection->send_error(id, "Expected 'compile ID ...', 'stats ID', 'quit' or 'shutdown'");
+                continue;
+            }
+
+            std::unique_ptr<Job> job(new Job());
+            job->connection = connection;
+            job->id = id;
+            job->options = options_.defaults;
+
+            // The payload has to be read whatever else is wrong with the
+            // request; without its size the stream cannot be followed
+            uint64_t payload = 0;
+            try {
+                payload = inline_payload_bytes(words, job->shape);
+            } catch (const std::exception& e) {
+                connection->send_error(id, std::string(e.what()) + "; closing the connection");
+                break;
+            }
+            if (payload > 0) {
+                std::vector<unsigned char> bytes(static_cast<size_t>(payload));
+                if (!reader.read_bytes(bytes.data(), payload)) {
+                    connection->send_error(id, "Input ended inside the --inline data");
+                    break;
+                }
+                size_t a_elements = job->shape.rows_a * job->shape.cols_a;
+                job->matrix_a = decode_matrix(bytes.data(), job->shape.rows_a, job->shape.cols_a);
+                job->matrix_b = decode_matrix(bytes.data() + 4 * a_elements, job->shape.cols_a, job->shape.cols_b);
+                job->has_values = true;
+            }
+            job->received = Clock::now();
+
+            try {
+                parse_compile_request(words, *job);
+            } catch (const std::exception& e) {
+                {
+                    std::lock_guard<std::mutex> lock(stats_mutex_);
+                    ++stats_.requests;
+                    ++stats_.errors;
+                }
+                connection->send_error(id, e.what());
+                continue;
+            }
+            {
+                std::lock_guard<std::mutex> lock(connection->pending_mutex);
+                ++connection->pending;
+            }
+            {
+                std::lock_guard<std::mutex> lock(queue_mutex_);
+                queue_.push_back(std::move(job));
+            }
+            queue_ready_.notify_one();
+        }
+    } catch (const std::exception& e) {
+        connection->send_error("-", e.what());
+    }
+
+    std::unique_lock<std::mutex> lock(connection->pending_mutex);
+    connection->idle.wait(lock, [&] { return connection->pending == 0; });
+}
+
+size_t LatencyHistogram::bucket_of(double seconds) {
+    double us = seconds * 1e6;
+    if (!(us >= 1.0)) return 0;
+    double bucket = std::floor(std::log2(us) * BUCKETS_PER_OCTAVE) + 1;
+    return static_cast<size_t>(std::min(bucket, static_cast<double>(BUCKETS_PER_OCTAVE * OCTAVES)));
+}
+
+double LatencyHistogram::upper_edge(size_t bucket) {
+    return std::exp2(static_cast<double>(bucket) / BUCKETS_PER_OCTAVE) * 1e-6;
+}
+
+void LatencyHistogram::add(double seconds) {
+    ++counts_[bucket_of(seconds)];
+    ++count_;
+    total_ += seconds;
+    max_ = std::max(max_, seconds);
+}
+
+LatencySummary LatencyHistogram::summary() const {
+    LatencySummary summary;
+    summary.count = count_;
+    if (count_ == 0) return summary;
+    // Nearest rank, found by walking the buckets
+    auto percentile = [&](double p) {
+        uint64_t rank = std::max<uint64_t>(static_cast<uint64_t>(std::ceil(p * count_)), 1);
+        uint64_t seen = 0;
+        for (size_t bucket = 0; bucket < counts_.size(); ++bucket) {
+            seen += counts_[bucket];
+            if (seen >= rank) return std::min(upper_edge(bucket), max_);
+        }
+        return max_;
+    };
+    summary.mean = total_ / count_;
+    summary.p50 = percentile(0.50);
+    summary.p90 = percentile(0.90);
+    summary.p99 = percentile(0.99);
+    summary.max = max_;
+    return summary;
+}
+
+void CompileServer::send_stats(Connection& connection, const std::string& id) {
+    CompileServerStats current = stats();
+    std::ostringstream line;
+    line << "stats " << id << " requests=" << current.requests << " errors=" << current.errors
+         << " cache_hits=" << current.cache_hits << " cache_misses=" << current.cache_misses
+         << " p50_us=" << microseconds(current.latency.p50) << " p90_us=" << microseconds(current.latency.p90)
+         << " p99_us=" << microseconds(current.latency.p99) << " max_us=" << microseconds(current.latency.max)
+         << " mean_us=" << microseconds(current.latency.mean) << "\n";
+    connection.send(line.str());
+}
+
+CompileServerStats CompileServer::stats() const {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    CompileServerStats current = stats_;
+    current.latency = latencies_.summary();
+    return current;
+}
+
+void CompileServer::worker_loop() {
+    // Kept for the worker's life, so its thread pool and IR buffers stay warm
+    Compiler compiler(options_.defaults);
+    while (true) {
+        std::unique_ptr<Job> job;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex_);
+            queue_ready_.wait(lock, [&] { return stop_workers_ || !queue_.empty(); });
+            if (queue_.empty()) return;
+            job = std::move(queue_.front());
+            queue_.pop_front();
+        }
+        run_job(*job, compiler);
+
+        Connection& connection = *job->connection;
+        std::lock_guard<std::mutex> lock(connection.pending_mutex);
+        if (--connection.pending == 0) connection.idle.notify_all();
+    }
+}
+
+void CompileServer::run_job(Job& job, Compiler& compiler) {
+    std::vector<unsigned char> program;
+    std::string stats_json;
+    size_t words = 0;
+    const char* cache_state = "off";
+    std::string error;
+    bool compiled = false;
+    compiler.set_stats_callback([&](const CompileReport&) { compiled = true; });
+    try {
+        double parse_seconds = 0;
+        if (!job.inputs.empty()) {
+            Clock::time_point start = Clock::now();
+            std::pair<Matrix, Matrix> operands = read_matrix_inputs(job.inputs);
+            job.shape = gemm_shape(operands.first, operands.second);
+            job.matrix_a = operands.first;
+            job.matrix_b = operands.second;
+            job.has_values = true;
+            parse_seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        }
+
+        // Tuned options are part of the cache key, so a tuned layer is cached like any other
+        if (job.options.autotune) autotune(job.shape, job.options, &tuning_);
+
+        // A dense program depends only on the shape and options, so the cache serves it
+        bool dense = job.options.sparse_density <= 0 && job.options.lut_values == 0;
+        if (dense && job.format != ProgramFormat::NONE) {
+            std::shared_ptr<const ProgramImage> image = cache_.get(job.shape, job.options, &compiler);
+            cache_state = compiled ? "miss" : "hit";
+            words = image->size();
+            if (job.format == ProgramFormat::PIMB) {
+                program.assign(image->bytes(), image->bytes() + image->byte_size());
+            } else {
+                program.resize(4 * words);
+                std::vector<InstructionWord> block(4096);
+                for (size_t first = 0; first < words; first += block.size()) {
+                    size_t count = std::min(block.size(), words - first);
+                    image->decode(first, count, block.data());
+                    for (size_t n = 0; n < count; ++n) put_u32(program.data() + 4 * (first + n), block[n]);
+                }
+            }
+        } else {
+            compiler.set_options(job.options);
+            std::unique_ptr<ProgramBufferSink> container;
+            CallbackSink raw([&](const InstructionWord* chunk, size_t count) {
+                if (job.format != ProgramFormat::RAW) return;
+                size_t offset = program.size();
+                program.resize(offset + 4 * count);
+                for (size_t n = 0; n < count; ++n) put_u32(program.data() + offset + 4 * n, chunk[n]);
+            });
+            InstructionSink* sink = &raw;
+            if (job.format == ProgramFormat::PIMB) {
+                container.reset(new ProgramBufferSink(job.options, compiler.report()));
+                sink = container.get();
+            }
+            words = job.has_values ? compiler.compile_matrix_mult(job.matrix_a, job.matrix_b, *sink)
+                                   : compiler.compile_matrix_mult(job.shape.rows_a, job.shape.cols_a,
+                                                                  job.shape.cols_b, *sink);
+            if (container) program = std::move(container->bytes());
+        }
+        if (job.stats && compiled) {
+            std::ostringstream out;
+            write_stats_json(out, compiler.report(), parse_seconds);
+            stats_json = out.str();
+        }
+    } catch (const std::exception& e) {
+        error = e.what();
+    }
+    compiler.set_stats_callback(nullptr);
+
+    double latency = std::chrono::duration<double>(Clock::now() - job.received).count();
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        ++stats_.requests;
+        if (!error.empty()) {
+            ++stats_.errors;
+        } else if (std::strcmp(cache_state, "hit") == 0) {
+            ++stats_.cache_hits;
+        } else if (std::strcmp(cache_state, "miss") == 0) {
+            ++stats_.cache_misses;
+        }
+        latencies_.add(latency);
+    }
+    if (!error.empty()) {
+        job.connection->send_error(job.id, error);
+        return;
+    }
+    std::ostringstream header;
+    header << "ok " << job.id << " words=" << words << " cache=" << cache_state
+           << " latency_us=" << microseconds(latency) << " program=" << program.size()
+           << " stats=" << stats_json.size() << "\n";
+    job.connection->send(header.str(), program, stats_json);
+}
+
+void CompileServer::parse_compile_request(const std::vector<std::string>& words, Job& job) {
+    std::vector<char*> argv;
+    for (const std::string& word : words) argv.push_back(const_cast<char*>(word.c_str()));
+    int argc = static_cast<int>(argv.size());
+    for (int arg = 2; arg < argc; ++arg) {
+        if (parse_compile_option(argc, argv.data(), arg, job.options)) continue;
+        std::string word = argv[arg];
+        if (word == "--format" && arg + 1 < argc) {
+            std::string format = argv[++arg];
+            if (format == "pimb") job.format = ProgramFormat::PIMB;
+            else if (format == "raw") job.format = ProgramFormat::RAW;
+            else if (format == "none") job.format = ProgramFormat::NONE;
+            else throw std::runtime_error("--format takes pimb, raw or none, not " + format);
+        } else if (word == "--stats") {
+            job.stats = true;
+        } else if (word == "--shape" && arg + 1 < argc) {
+            job.shape = parse_shape(argv[++arg], word);
+            job.shape_only = true;
+        } else if (word == "--inline" && arg + 1 < argc) {
+            ++arg; // Shape and payload were taken before
+        } else if (word[0] == '-' || job.inputs.size() == 2) {
+            throw std::runtime_error("Unexpected argument: " + word);
+        } else {
+            job.inputs.push_back(word);
+        }
+    }
+    int sources = (job.inputs.empty() ? 0 : 1) + (job.shape_only ? 1 : 0) + (job.has_values ? 1 : 0);
+    if (sources != 1) {
+        throw std::runtime_error("Expected one input: a C++ file, two .npy or .mtx files, --shape or --inline");
+    }
+    if (job.options.lut_values > 0 && job.format == ProgramFormat::PIMB) {
+        // As for -o: a container's header rebuilds the memory plan, but the tables depend on B
+        throw std::runtime_error("A LUT program's memory plan depends on B's values; use --format raw");
+    }
+}
+
+} // namespace pim
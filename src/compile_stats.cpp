@@ -0,0 +1,177 @@
+#include "compile_stats.hpp"
+#include "compiler.hpp"
+#include <iomanip>
+#include <string>
+#include <vector>
+
+namespace pim {
+
+namespace {
+
+const char* placement_mode_name(PlacementMode mode) {
+    switch (mode) {
+        case PlacementMode::REPLICATED: return "replicated";
+        case PlacementMode::SPREAD: return "spread";
+        case PlacementMode::PACKED: return "packed";
+    }
+    return "unknown";
+}
+
+// Problems the report covers, each with its memory plan
+std::vector<std::pair<GemmShape, const MemoryPlan*>> report_problems(const CompileReport& report) {
+    std::vector<std::pair<GemmShape, const MemoryPlan*>> problems;
+    if (report.batch.empty()) {
+        const MemoryPlan& memory = report.memory;
+        problems.emplace_back(GemmShape{memory.rows_a(), memory.cols_a(), memory.cols_b()}, &memory);
+    }
+    for (const BatchEntry& entry : report.batch) {
+        problems.emplace_back(entry.shape, &entry.memory);
+    }
+    return problems;
+}
+
+void write_pass_json(std::ostream& out, const PassStats& pass) {
+    out << "\"seconds\": " << pass.seconds << ", \"ops_in\": " << pass.ops_in << ", \"ops_out\": " << pass.ops_out;
+}
+
+} // namespace
+
+const char* ir_op_type_name(IROpType type) {
+    switch (type) {
+        case IROpType::RESET_ACC: return "RESET_ACC";
+        case IROpType::LOAD_A_ELEMENT: return "LOAD_A_ELEMENT";
+        case IROpType::LOAD_B_ELEMENT: return "LOAD_B_ELEMENT";
+        case IROpType::EXECUTE_MAC: return "EXECUTE_MAC";
+        case IROpType::STORE_C_ELEMENT: return "STORE_C_ELEMENT";
+        case IROpType::SELECT_BANK: return "SELECT_BANK";
+        case IROpType::SELECT_SEGMENT: return "SELECT_SEGMENT";
+        case IROpType::LOAD_ELEMENT: return "LOAD_ELEMENT";
+        case IROpType::STORE_ELEMENT: return "STORE_ELEMENT";
+        case IROpType::FENCE: return "FENCE";
+    }
+    return "UNKNOWN";
+}
+
+const char* instruction_kind_name(size_t kind) {
+    static const char* const names[INSTRUCTION_KINDS] = {
+        "MEM_LOAD", "MEM_STORE", "COMPUTE_SETUP", "COMPUTE_EXEC", "SET_BANK", "SET_SEGMENT", "FENCE"
+    };
+    return kind < INSTRUCTION_KINDS ? names[kind] : "UNKNOWN";
+}
+
+void write_stats_json(std::ostream& out, const CompileReport& report, double parse_seconds) {
+    const CompileStats& stats = report.stats;
+    std::ios_base::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::defaultfloat << std::setprecision(6);
+
+    auto problems = report_problems(report);
+    out << "{\n  \"problems\": [";
+    for (size_t p = 0; p < problems.size(); ++p) {
+        const GemmShape& shape = problems[p].first;
+        out << (p ? ", " : "") << "[" << shape.rows_a << ", " << shape.cols_a << ", " << shape.cols_b << "]";
+    }
+    out << "],\n"
+        << "  \"specialized\": " << (report.specialized ? "true" : "false") << ",\n"
+        << "  \"ir_ops\": " << report.ir_ops << ",\n"
+        << "  \"instructions\": " << report.instructions << ",\n";
+
+    const StageTimes& time = stats.time;
+    out << "  \"time_seconds\": {\"parse\": " << parse_seconds << ", \"plan\": " << time.plan
+        << ", \"ir_generation\": " << time.ir_generation
+        << ", \"operand_reuse\": " << stats.operand_reuse.seconds
+        << ", \"schedule\": " << stats.schedule.seconds
+        << ", \"bank_select\": " << stats.bank_select.seconds
+        << ", \"translate\": " << time.translate << ", \"emit\": " << time.emit
+        << ", \"total\": " << time.total << "},\n";
+
+    out << "  \"passes\": {\n    \"operand_reuse\": {";
+    write_pass_json(out, stats.operand_reuse);
+    out << ", \"loads_before\": " << report.operand_reuse.loads_before
+        << ", \"loads_eliminated\": " << report.operand_reuse.loads_eliminated << "},\n    \"schedule\": {";
+    write_pass_json(out, stats.schedule);
+    out << ", \"windows\": " << report.schedule.windows << ", \"cycles_before\": " << report.schedule.cycles_before
+        << ", \"cycles_after\": " << report.schedule.cycles_after << "},\n    \"bank_select\": {";
+    write_pass_json(out, stats.bank_select);
+    out << ", \"selects_inserted\": " << report.bank_selects << "}\n  },\n";
+
+    out << "  \"ir_ops_by_type\": {";
+    for (size_t type = 0; type < IR_OP_TYPES; ++type) {
+        out << (type ? ", " : "") << "\"" << ir_op_type_name(static_cast<IROpType>(type)) << "\": "
+            << stats.ir_ops_by_type[type];
+    }
+    out << "},\n  \"instructions_by_opcode\": {";
+    for (size_t kind = 0; kind < INSTRUCTION_KINDS; ++kind) {
+        out << (kind ? ", " : "") << "\"" << instruction_kind_name(kind) << "\": " << stats.instructions_by_kind[kind];
+    }
+    out << "},\n"
+        << "  \"buffer_bytes\": " << stats.buffer_bytes << ",\n"
+        << "  \"sparse_tiles\": " << report.sparse_tiles << ",\n"
+        << "  \"lut_tiles\": " << report.lut_tiles << ",\n"
+        << "  \"strassen_levels\": " << report.strassen_levels << ",\n";
+
+    out << "  \"memory\": [";
+    for (size_t p = 0; p < problems.size(); ++p) {
+        const MemoryPlan& memory = *problems[p].second;
+        out << (p ? "," : "") << "\n    {\"mode\": \"" << placement_mode_name(memory.mode())
+            << "\", \"element_type\": \"" << element_type_name(memory.element_type())
+            << "\", \"banks\": " << memory.geometry().num_banks
+            << ", \"rows_per_bank\": " << memory.geometry().rows_per_bank
+            << ", \"base_row\": " << memory.base_row() << ", \"rows_used\": " << memory.rows_used()
+            << ", \"regions\": {";
+        std::vector<MemoryPlan::RegionUsage> regions = memory.usage();
+        for (size_t r = 0; r < regions.size(); ++r) {
+            out << (r ? ", " : "") << "\"" << regions[r].name << "\": {\"rows\": " << regions[r].rows
+                << ", \"banks\": " << regions[r].banks << "}";
+        }
+        out << "}}";
+    }
+    out << "\n  ]\n}\n";
+
+    out.flags(flags);
+    out.precision(precision);
+}
+
+void write_stats_text(std::ostream& out, const CompileReport& report, double parse_seconds) {
+    const CompileStats& stats = report.stats;
+    std::ios_base::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    auto ms = [](double seconds) { return seconds * 1e3; };
+    out << std::fixed << std::setprecision(3);
+
+    out << "Stage times (ms; per-lane stages summed over lanes):\n"
+        << "  parse         " << std::setw(10) << ms(parse_seconds) << "\n"
+        << "  plan          " << std::setw(10) << ms(stats.time.plan) << "\n"
+        << "  ir generation " << std::setw(10) << ms(stats.time.ir_generation) << "\n"
+        << "  operand reuse " << std::setw(10) << ms(stats.operand_reuse.seconds) << "\n"
+        << "  schedule      " << std::setw(10) << ms(stats.schedule.seconds) << "\n"
+        << "  bank select   " << std::setw(10) << ms(stats.bank_select.seconds) << "\n"
+        << "  translate     " << std::setw(10) << ms(stats.time.translate) << "\n"
+        << "  emit          " << std::setw(10) << ms(stats.time.emit) << "\n"
+        << "  total compile " << std::setw(10) << ms(stats.time.total) << "\n";
+
+    out << "Passes (IR operations in -> out):\n";
+    for (auto [name, pass] : {std::make_pair("operand reuse", &stats.operand_reuse),
+                              std::make_pair("schedule", &stats.schedule),
+                              std::make_pair("bank select", &stats.bank_select)}) {
+        out << "  " << std::left << std::setw(14) << name << std::right << std::setw(12) << pass->ops_in
+            << " -> " << pass->ops_out << "\n";
+    }
+
+    out << "IR operations by type:\n";
+    for (size_t type = 0; type < IR_OP_TYPES; ++type) {
+        out << "  " << std::left << std::setw(16) << ir_op_type_name(static_cast<IROpType>(type)) << std::right
+            << std::setw(12) << stats.ir_ops_by_type[type] << "\n";
+    }
+    out << "Instructions by opcode:\n";
+    for (size_t kind = 0; kind < INSTRUCTION_KINDS; ++kind) {
+        out << "  " << std::left << std::setw(16) << instruction_kind_name(kind) << std::right
+            << std::setw(12) << stats.instructions_by_kind[kind] << "\n";
+    }
+    out << "Compiler buffers: " << stats.buffer_bytes << " bytes\n";
+
+    out.flags(flags);
+    out.precision(precision);
+}
+
+} // namespace pim
@@ -1,12 +1,27 @@
 #include "compiler.hpp"
+#include "lut.hpp"
+#include "pipeline.hpp"
+#include "strassen.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <memory>
 #include <stdexcept>
+#include <thread>
 #include <vector>
 #include <iostream>
 
 namespace pim {
 
-// Main compilation function: Generates IR first, then translates to PIM instructions
-std::vector<InstructionWord> Compiler::compile_matrix_mult(
+namespace {
+
+// Batch tiling granularity: enough tiles per lane for the balancer to even out
+// the lanes, few enough to keep operand reuse within each tile
+constexpr double BATCH_TILES_PER_LANE = 2.0;
+
+} // namespace
+
+GemmShape gemm_shape(
     const std::vector<std::vector<int>>& matrix_a,
     const std::vector<std::vector<int>>& matrix_b)
 {
@@ -16,119 +31,881 @@ std::vector<InstructionWord> Compiler::compile_matrix_mult(
          throw std::runtime_error("Input matrices cannot be empty.");
     }
 
-    size_t rows_a = matrix_a.size();
-    size_t cols_a = matrix_a[0].size(); // Also rows_b
-    size_t rows_b = matrix_b.size();
-    size_t cols_b = matrix_b[0].size();
+    GemmShape shape;
+    shape.rows_a = matrix_a.size();
+    shape.cols_a = matrix_a[0].size(); // Also rows_b
+    shape.cols_b = matrix_b[0].size();
 
-    if (cols_a != rows_b) {
+    if (shape.cols_a != matrix_b.size()) {
          throw std::runtime_error("Matrix dimensions mismatch: cols_a must equal rows_b.");
     }
+    for (const auto& row : matrix_a) {
+        if (row.size() != shape.cols_a) throw std::runtime_error("Matrix A rows must all have the same length.");
+    }
+    for (const auto& row : matrix_b) {
+        if (row.size() != shape.cols_b) throw std::runtime_error("Matrix B rows must all have the same length.");
+    }
+    return shape;
+}
 
-    // --- Stage 1: Generate Intermediate Representation (IR) ---
-    std::vector<IROperation> ir_code;
-    // Estimate size to potentially reduce reallocations
-    ir_code.reserve(rows_a * cols_b * (1 + cols_a * 3 + 1));
+GemmShape gemm_shape(const Matrix& matrix_a, const Matrix& matrix_b) {
+    if (matrix_a.empty() || matrix_b.empty()) {
+        throw std::runtime_error("Input matrices cannot be empty.");
+    }
+    if (matrix_a.cols() != matrix_b.rows()) {
+        throw std::runtime_error("Matrix dimensions mismatch: cols_a must equal rows_b.");
+    }
+    GemmShape shape;
+    shape.rows_a = matrix_a.rows();
+    shape.cols_a = matrix_a.cols();
+    shape.cols_b = matrix_b.cols();
+    return shape;
+}
 
-    for (size_t i = 0; i < rows_a; ++i) {
-        for (size_t j = 0; j < cols_b; ++j) {
-            // Reset accumulator for calculating C[i][j]
-            ir_code.emplace_back(IROpType::RESET_ACC, i, j);
+TilePlan plan_batch_tiles(const std::vector<GemmShape>& problems, uint32_t num_cores,
+                          size_t tile_rows, size_t tile_cols, std::vector<TilePlan>& problem_tiling)
+{
+    uint32_t lanes = lane_count(num_cores);
+    auto tile_ops = [](const Tile& tile, size_t cols_a) { return tile.rows() * tile.cols() * (3 * cols_a + 2); };
 
-            for (size_t k = 0; k < cols_a; ++k) { // cols_a is the inner dimension
-                // Load A[i][k] into buffer 0
-                ir_code.emplace_back(IROpType::LOAD_A_ELEMENT, i, k, 0);
-                // Load B[k][j] into buffer 1
-                ir_code.emplace_back(IROpType::LOAD_B_ELEMENT, k, j, 1);
-                // Execute MAC (Accumulator += Buffer0 * Buffer1)
-                ir_code.emplace_back(IROpType::EXECUTE_MAC); // Use explicit constructor
+    // --- Cut each problem into tiles of about 1/TILES_PER_LANE of a lane's
+    // share of the work, then balance every tile over the lanes together ---
+    double total_work = 0;
+    for (const GemmShape& shape : problems) {
+        if (shape.rows_a == 0 || shape.cols_a == 0 || shape.cols_b == 0) {
+            throw std::runtime_error("Input matrices cannot be empty.");
+        }
+        total_work += static_cast<double>(shape.rows_a) * shape.cols_a * shape.cols_b;
+    }
+    std::vector<Tile> tiles;
+    std::vector<TilePlan> cuts;
+    for (uint32_t p = 0; p < problems.size(); ++p) {
+        const GemmShape& shape = problems[p];
+        double work = static_cast<double>(shape.rows_a) * shape.cols_a * shape.cols_b;
+        double pieces = std::ceil(BATCH_TILES_PER_LANE * lanes * work / total_work);
+        uint32_t share = static_cast<uint32_t>(std::min<double>(lanes, std::max(1.0, pieces)));
+        cuts.push_back(plan_tiles(shape.rows_a, shape.cols_b, 2 * share, tile_rows, tile_cols));
+        size_t first = tiles.size();
+        for (const auto& lane_tiles : cuts.back().lane_tiles) {
+            for (Tile tile : lane_tiles) {
+                tile.problem = p;
+                tiles.push_back(tile);
             }
-            // Store result from Accumulator to C[i][j]
-            ir_code.emplace_back(IROpType::STORE_C_ELEMENT, i, j);
         }
+        // Back to grid order, which is the order tiles run in on a lane
+        std::sort(tiles.begin() + first, tiles.end(), [](const Tile& x, const Tile& y) {
+            return x.row_begin != y.row_begin ? x.row_begin < y.row_begin : x.col_begin < y.col_begin;
+        });
+    }
+
+    std::vector<size_t> order(tiles.size());
+    for (size_t t = 0; t < order.size(); ++t) order[t] = t;
+    std::stable_sort(order.begin(), order.end(), [&](size_t x, size_t y) {
+        return tile_ops(tiles[x], problems[tiles[x].problem].cols_a) >
+               tile_ops(tiles[y], problems[tiles[y].problem].cols_a);
+    });
+    std::vector<size_t> load(lanes, 0);
+    for (size_t t : order) {
+        uint32_t lane = static_cast<uint32_t>(std::min_element(load.begin(), load.end()) - load.begin());
+        tiles[t].lane = lane;
+        load[lane] += tile_ops(tiles[t], problems[tiles[t].problem].cols_a);
+    }
+
+    // Each lane runs its problems in batch order
+    TilePlan tiling;
+    tiling.lanes = lanes;
+    tiling.lane_tiles.assign(lanes, {});
+    problem_tiling.assign(problems.size(), TilePlan());
+    for (uint32_t p = 0; p < problems.size(); ++p) {
+        problem_tiling[p].lanes = lanes;
+        problem_tiling[p].tile_rows = cuts[p].tile_rows;
+        problem_tiling[p].tile_cols = cuts[p].tile_cols;
+        problem_tiling[p].lane_tiles.assign(lanes, {});
     }
+    for (const Tile& tile : tiles) {
+        tiling.lane_tiles[tile.lane].push_back(tile);
+        problem_tiling[tile.problem].lane_tiles[tile.lane].push_back(tile);
+    }
+    return tiling;
+}
 
-    // --- Stage 2: Translate IR to PIM Instructions (Packed uint32_t) ---
-    return translate_ir_to_pim(ir_code, rows_a, cols_a, cols_b);
+uint32_t strassen_depth(const GemmShape& shape, const CompileOptions& options) {
+    if (options.element_type != ElementType::INT32) {
+        // The sums of packed operands would overflow their elements
+        if (options.strassen_levels > 0) {
+            throw std::runtime_error("The Strassen lowering needs 32-bit elements.");
+        }
+        return 0;
+    }
+    if (options.strassen_levels >= 0) {
+        return static_cast<uint32_t>(options.strassen_levels);
+    }
+    return choose_strassen_levels(shape, options);
 }
 
-// Private helper function: Translates IR sequence to PIM Instructions
-// This acts as the "lookup table" or translator
-std::vector<InstructionWord> Compiler::translate_ir_to_pim(
-    const std::vector<IROperation>& ir_code,
-    size_t rows_a,
-    size_t cols_a,
-    size_t cols_b)
+// Out of line, where StrassenLowering is complete
+Compiler::Compiler() : arenas_(new IRArenaPool()) {}
+Compiler::Compiler(const CompileOptions& options) : options_(options), arenas_(new IRArenaPool()) {}
+Compiler::~Compiler() = default;
+
+// Main compilation function: Generates IR first, then translates to PIM instructions
+std::vector<InstructionWord> Compiler::compile_matrix_mult(
+    const std::vector<std::vector<int>>& matrix_a,
+    const std::vector<std::vector<int>>& matrix_b)
 {
-    std::vector<InstructionWord> instructions;
-    instructions.reserve(ir_code.size());
-
-    for (const auto& ir_op : ir_code) {
-        Opcode opcode_val;
-        uint32_t core_ptr_val = 0; // Default core_ptr
-        bool rd_flag = false;
-        bool wr_flag = false;
-        uint32_t row_addr_val = 0;
-
-        switch (ir_op.type) {
-            case IROpType::RESET_ACC:
-                opcode_val = Opcode::COMPUTE_SETUP;
-                // Flags and address remain 0
-                break;
-
-            case IROpType::LOAD_A_ELEMENT:
-                opcode_val = Opcode::MEM_LOAD;
-                rd_flag = true;
-                wr_flag = false;
-                // Use target_buffer as core_ptr for loads (fits in 6 bits)
-                core_ptr_val = static_cast<uint32_t>(ir_op.target_buffer);
-                // Calculate address and MASK to 9 bits
-                row_addr_val = (MATRIX_A_BASE + ir_op.i * cols_a + ir_op.k);
-                break;
-
-            case IROpType::LOAD_B_ELEMENT:
-                opcode_val = Opcode::MEM_LOAD;
-                rd_flag = true;
-                wr_flag = false;
-                 // Use target_buffer as core_ptr for loads (fits in 6 bits)
-                core_ptr_val = static_cast<uint32_t>(ir_op.target_buffer);
-                 // Calculate address and MASK to 9 bits
-                row_addr_val = (MATRIX_B_BASE + ir_op.k * cols_b + ir_op.j);
-                break;
-
-            case IROpType::EXECUTE_MAC:
-                opcode_val = Opcode::COMPUTE_EXEC;
-                 // Flags and address remain 0
-                break;
-
-            case IROpType::STORE_C_ELEMENT:
-                opcode_val = Opcode::MEM_STORE;
-                rd_flag = false;
-                wr_flag = true;
-                 // Use default core_ptr_val (0) for stores
-                 // Calculate address and MASK to 9 bits
-                row_addr_val = (MATRIX_C_BASE + ir_op.i * cols_b + ir_op.j);
-                break;
-
-            default:
-                 std::cerr << "Warning: Unknown IR operation type encountered during translation: "
-                           << static_cast<int>(ir_op.type) << ". Skipping." << std::endl;
-                 continue; // Skip this IR operation
-        }
-
-        // Pack the fields into a single instruction word
-        instructions.push_back(
-            instr_format::pack(opcode_val, core_ptr_val, rd_flag, wr_flag, row_addr_val)
-        );
-    }
-
-    return instructions;
-}
-
-// --- Removed old helper functions as they are no longer used ---
-// std::vector<Instruction> Compiler::generate_lut_instructions() { ... }
-// std::vector<Instruction> Compiler::generate_load_instructions(...) { ... }
-// std::vector<Instruction> Compiler::generate_compute_instructions(...) { ... }
-// std::vector<Instruction> Compiler::generate_store_instructions(...) { ... }
+    GemmShape shape = gemm_shape(matrix_a, matrix_b);
+    if (options_.sparse_density > 0 || options_.lut_values > 0) {
+        return compile_matrix_mult(Matrix::from_rows(matrix_a), Matrix::from_rows(matrix_b));
+    }
+    return compile_program(shape, nullptr);
+}
+
+std::vector<InstructionWord> Compiler::compile_matrix_mult(const Matrix& matrix_a, const Matrix& matrix_b) {
+    GemmShape shape = gemm_shape(matrix_a, matrix_b);
+    const Matrix* weights = options_.lut_values > 0 ? &matrix_b : nullptr;
+    if (options_.sparse_density > 0) {
+        CsrMatrix csr_a = to_csr(matrix_a);
+        CscMatrix csc_b = to_csc(matrix_b);
+        SparseOperands sparse{&csr_a, &csc_b, options_.sparse_density};
+        return compile_program(shape, &sparse, weights);
+    }
+    return compile_program(shape, nullptr, weights);
+}
+
+size_t Compiler::compile_matrix_mult(size_t rows_a, size_t cols_a, size_t cols_b, InstructionSink& sink) {
+    if (options_.sparse_density > 0) {
+        throw std::runtime_error("Sparse compilation needs the matrix values.");
+    }
+    if (options_.lut_values > 0) {
+        throw std::runtime_error("The LUT lowering needs the matrix values.");
+    }
+    return compile_to_sink(GemmShape{rows_a, cols_a, cols_b}, nullptr, sink);
+}
+
+size_t Compiler::compile_matrix_mult(const Matrix& matrix_a, const Matrix& matrix_b, InstructionSink& sink) {
+    GemmShape shape = gemm_shape(matrix_a, matrix_b);
+    const Matrix* weights = options_.lut_values > 0 ? &matrix_b : nullptr;
+    if (options_.sparse_density > 0) {
+        CsrMatrix csr_a = to_csr(matrix_a);
+        CscMatrix csc_b = to_csc(matrix_b);
+        SparseOperands sparse{&csr_a, &csc_b, options_.sparse_density};
+        return compile_to_sink(shape, &sparse, sink, weights);
+    }
+    return compile_to_sink(shape, nullptr, sink, weights);
+}
+
+size_t Compiler::compile_matrix_mult(const CsrMatrix& matrix_a, const CscMatrix& matrix_b, InstructionSink& sink) {
+    matrix_a.validate();
+    matrix_b.validate();
+    if (matrix_a.cols != matrix_b.rows) {
+        throw std::runtime_error("Matrix dimensions mismatch: cols_a must equal rows_b.");
+    }
+    GemmShape shape{matrix_a.rows, matrix_a.cols, matrix_b.cols};
+    SparseOperands sparse{&matrix_a, &matrix_b, options_.sparse_density};
+    Matrix weights = options_.lut_values > 0 ? to_dense(matrix_b) : Matrix();
+    return compile_to_sink(shape, options_.sparse_density > 0 ? &sparse : nullptr, sink,
+                           options_.lut_values > 0 ? &weights : nullptr);
+}
+
+bool Compiler::parallel() const {
+    unsigned threads = options_.threads != 0 ? options_.threads : std::thread::hardware_concurrency();
+    return threads > 1;
+}
+
+std::vector<InstructionWord> Compiler::compile_program(const GemmShape& shape, const SparseOperands* sparse,
+                                                       const Matrix* weights) {
+    if (!sparse) {
+        if (const SpecializedProgram* program = find_specialized_program(shape, options_)) {
+            plan(shape.rows_a, shape.cols_a, shape.cols_b, true);
+            emit_specialized(*program, nullptr);
+            return std::vector<InstructionWord>(program->words, program->words + program->size);
+        }
+    }
+    if (parallel()) {
+        // The parallel path builds the program in place; no sink copy needed
+        plan(shape.rows_a, shape.cols_a, shape.cols_b, sparse == nullptr, weights);
+        std::vector<InstructionWord> program = compile_parallel(sparse);
+        finish_stats();
+        return program;
+    }
+    VectorSink sink;
+    compile_to_sink(shape, sparse, sink, weights);
+    return std::move(sink.words());
+}
+
+// Streams the program into sink. The serial path keeps memory bounded by
+// chunk_ops; the parallel one materializes the program and then writes it.
+size_t Compiler::compile_to_sink(const GemmShape& shape, const SparseOperands* sparse, InstructionSink& sink,
+                                 const Matrix* weights) {
+    plan(shape.rows_a, shape.cols_a, shape.cols_b, sparse == nullptr, weights);
+    if (!sparse) {
+        if (const SpecializedProgram* program = find_specialized_program(shape, options_)) {
+            emit_specialized(*program, &sink);
+            return report_.instructions;
+        }
+    }
+    return compile_planned(sparse, sink);
+}
+
+std::vector<InstructionWord> Compiler::compile_batch(const std::vector<GemmShape>& problems) {
+    if (options_.sparse_density > 0 || options_.lut_values > 0) {
+        throw std::runtime_error("Batched compilation supports the dense lowering only.");
+    }
+    plan_batch(problems);
+    if (parallel()) {
+        std::vector<InstructionWord> program = compile_parallel(nullptr);
+        finish_stats();
+        return program;
+    }
+    VectorSink sink;
+    compile_planned(nullptr, sink);
+    return std::move(sink.words());
+}
+
+size_t Compiler::compile_batch(const std::vector<GemmShape>& problems, InstructionSink& sink) {
+    if (options_.sparse_density > 0 || options_.lut_values > 0) {
+        throw std::runtime_error("Batched compilation supports the dense lowering only.");
+    }
+    plan_batch(problems);
+    return compile_planned(nullptr, sink);
+}
+
+size_t Compiler::compile_planned(const SparseOperands* sparse, InstructionSink& sink) {
+    if (!parallel()) {
+        for (const ProgramPhase& phase : phases()) {
+            compile_streaming(phase, sparse, sink);
+        }
+        {
+            StageTimer emit_timer(report_.stats.time.emit);
+            sink.finish();
+        }
+        finish_stats();
+        return report_.instructions;
+    }
+
+    std::vector<InstructionWord> program = compile_parallel(sparse);
+    {
+        StageTimer emit_timer(report_.stats.time.emit);
+        size_t chunk_words = std::max<size_t>(options_.chunk_ops, 1);
+        for (size_t base = 0; base < program.size(); base += chunk_words) {
+            sink.write(program.data() + base, std::min(chunk_words, program.size() - base));
+        }
+        sink.finish();
+    }
+    finish_stats();
+    return report_.instructions;
+}
+
+void Compiler::plan(size_t rows_a, size_t cols_a, size_t cols_b, bool dense, const Matrix* weights) {
+    if (rows_a == 0 || cols_a == 0 || cols_b == 0) {
+        throw std::runtime_error("Input matrices cannot be empty.");
+    }
+    if (!dense && options_.element_type != ElementType::INT32) {
+        throw std::runtime_error("The sparse lowering needs 32-bit elements.");
+    }
+    if (weights) {
+        // Tables hold whole products, and the lookups replace the triple loop's chains
+        if (options_.element_type != ElementType::INT32) {
+            throw std::runtime_error("The LUT lowering needs 32-bit elements.");
+        }
+        if (!dense) {
+            throw std::runtime_error("The LUT and sparse lowerings cannot be combined.");
+        }
+        if (options_.strassen_levels > 0) {
+            throw std::runtime_error("The LUT lowering cannot be combined with the Strassen lowering.");
+        }
+    }
+    compile_start_ = std::chrono::steady_clock::now();
+    strassen_.reset();
+    lut_.reset();
+    report_ = CompileReport();
+    StageTimer plan_timer(report_.stats.time.plan);
+
+    // --- Stage 1: Partition C into tiles, one or more per lane ---
+    report_.tiling = plan_replicable_tiles(options_.memory, rows_a, cols_a, cols_b, options_.num_cores,
+                                           options_.tile_rows, options_.tile_cols, options_.element_type);
+
+    // --- Stage 2: Place A, B and C in memory along the tiling ---
+    uint32_t levels = (dense && !weights) ? strassen_depth(GemmShape{rows_a, cols_a, cols_b}, options_) : 0;
+    if (levels > 0) {
+        // The elementwise sums address A, B and C directly, so keep one copy of each block
+        try {
+            report_.memory = MemoryPlan::build(options_.memory, rows_a, cols_a, cols_b, report_.tiling, 0,
+                                               PlacementMode::SPREAD);
+            strassen_.reset(new StrassenLowering(report_.memory, levels, options_.num_cores));
+            report_.strassen_levels = levels;
+        } catch (const std::runtime_error&) {
+            // An automatic choice falls back to the triple loop when the leaves do not fit
+            if (options_.strassen_levels >= 0) throw;
+            strassen_.reset();
+            levels = 0;
+        }
+    }
+    if (levels == 0) {
+        report_.memory = MemoryPlan::build(options_.memory, rows_a, cols_a, cols_b, report_.tiling, 0,
+                                           PlacementMode::REPLICATED, options_.element_type);
+    }
+    if (weights) {
+        lut_.reset(new LutLowering(report_.memory, report_.tiling, *weights, options_));
+        report_.lut_table_rows = lut_->table_rows();
+    }
+    report_.core_instructions.assign(NUM_CORES, 0);
+}
+
+void Compiler::plan_batch(const std::vector<GemmShape>& problems) {
+    if (problems.empty()) {
+        throw std::runtime_error("A batch needs at least one problem.");
+    }
+    compile_start_ = std::chrono::steady_clock::now();
+    strassen_.reset();
+    lut_.reset();
+    report_ = CompileReport();
+    StageTimer plan_timer(report_.stats.time.plan);
+
+    // --- Stage 1: One tiling over all lanes; every problem keeps its own view ---
+    std::vector<TilePlan> problem_tiling;
+    report_.tiling = plan_batch_tiles(problems, options_.num_cores, options_.tile_rows, options_.tile_cols,
+                                      problem_tiling);
+
+    // --- Stage 2: Place the problems one after another, all in the most
+    // conflict-free layout that lets the whole batch fit ---
+    report_.batch.resize(problems.size());
+    for (PlacementMode best : {PlacementMode::REPLICATED, PlacementMode::SPREAD, PlacementMode::PACKED}) {
+        try {
+            uint64_t base_row = 0;
+            for (size_t p = 0; p < problems.size(); ++p) {
+                const GemmShape& shape = problems[p];
+                report_.batch[p].memory = MemoryPlan::build(options_.memory, shape.rows_a, shape.cols_a,
+                                                            shape.cols_b, problem_tiling[p], base_row, best,
+                                                            options_.element_type);
+                base_row = report_.batch[p].memory.rows_used();
+            }
+            break;
+        } catch (const std::runtime_error&) {
+            if (best == PlacementMode::PACKED) throw;
+        }
+    }
+
+    size_t c_offset = 0;
+    for (size_t p = 0; p < problems.size(); ++p) {
+        BatchEntry& entry = report_.batch[p];
+        entry.shape = problems[p];
+        entry.c_offset = c_offset;
+        c_offset += problems[p].rows_a * problems[p].cols_b;
+    }
+    for (const auto& lane_tiles : report_.tiling.lane_tiles) {
+        for (const Tile& tile : lane_tiles) ++report_.batch[tile.problem].tiles;
+    }
+    report_.core_instructions.assign(NUM_CORES, 0);
+}
+
+std::vector<const MemoryPlan*> Compiler::memory_plans() const {
+    std::vector<const MemoryPlan*> plans;
+    if (report_.batch.empty()) {
+        plans.push_back(&report_.memory);
+    }
+    for (const BatchEntry& entry : report_.batch) {
+        plans.push_back(&entry.memory);
+    }
+    return plans;
+}
+
+std::vector<ProgramPhase> Compiler::phases() const {
+    if (strassen_) {
+        return strassen_->phases();
+    }
+    return {ProgramPhase{&report_.tiling, memory_plans(), nullptr, lut_.get()}};
+}
+
+// The words were generated at build time; only the report is filled in here.
+// plan() has already run, so tiling and memory describe the same layout.
+// Every word is one translated IR operation, so the per-type and per-pass
+// counts are recovered from the words and the generator's summary.
+void Compiler::emit_specialized(const SpecializedProgram& program, InstructionSink* sink) {
+    CompileStats& stats = report_.stats;
+    for (size_t n = 0; n < program.size; ++n) {
+        instr_format::UnpackedInstr unpacked = instr_format::unpack(program.words[n]);
+        ++report_.core_instructions[unpacked.core_ptr];
+        size_t kind = instruction_kind(unpacked);
+        ++stats.instructions_by_kind[kind];
+        IROpType type = IROpType::RESET_ACC;
+        switch (kind) {
+        case 0: type = unpacked.core_ptr % 2 == 0 ? IROpType::LOAD_A_ELEMENT : IROpType::LOAD_B_ELEMENT; break;
+        case 1: type = IROpType::STORE_C_ELEMENT; break;
+        case 3: type = IROpType::EXECUTE_MAC; break;
+        case 4: type = IROpType::SELECT_BANK; break;
+        case 5: type = IROpType::SELECT_SEGMENT; break;
+        default: break;
+        }
+        ++stats.ir_ops_by_type[static_cast<size_t>(type)];
+    }
+    stats.operand_reuse.ops_in = program.ir_ops;
+    stats.operand_reuse.ops_out = program.ir_ops - program.loads_eliminated;
+    stats.bank_select.ops_in = stats.operand_reuse.ops_out;
+    stats.bank_select.ops_out = stats.bank_select.ops_in + program.bank_selects;
+    if (sink) {
+        StageTimer emit_timer(report_.stats.time.emit);
+        size_t chunk_words = std::max<size_t>(options_.chunk_ops, 1);
+        for (size_t base = 0; base < program.size; base += chunk_words) {
+            sink->write(program.words + base, std::min(chunk_words, program.size - base));
+        }
+        sink->finish();
+    }
+    report_.instructions = program.size;
+    report_.ir_ops = program.ir_ops;
+    report_.operand_reuse.loads_before = program.loads_before;
+    report_.operand_reuse.loads_eliminated = program.loads_eliminated;
+    report_.bank_selects = program.bank_selects;
+    report_.specialized = true;
+    finish_stats();
+}
+
+// Streaming compilation: IR generation, passes and translation run lane by lane
+// in chunks, so memory stays bounded by chunk_ops rather than by M*N*K
+void Compiler::compile_streaming(const ProgramPhase& phase, const SparseOperands* sparse, InstructionSink& sink) {
+    // --- Stage 3: One IR stream per lane (generation + passes, chunk by chunk) ---
+    const std::vector<const MemoryPlan*>& plans = phase.plans;
+    std::vector<std::unique_ptr<IRArena>> arenas;
+    std::vector<std::unique_ptr<LaneStream>> lanes;
+    for (uint32_t lane = 0; lane < phase.tiling->lanes; ++lane) {
+        arenas.push_back(arenas_->acquire());
+        lanes.emplace_back(new LaneStream(phase.tiling->lane_tiles[lane], plans,
+                                          options_.operand_reuse, options_.chunk_ops,
+                                          options_.schedule ? &options_.machine : nullptr, sparse, phase.jobs,
+                                          phase.lut, arenas.back().get()));
+    }
+
+    // --- Stage 4: Interleave the lanes round-robin and translate into the sink ---
+    size_t chunk_words = std::max<size_t>(options_.chunk_ops, 1);
+    std::vector<InstructionWord> chunk;
+    chunk.reserve(chunk_words);
+    CompileStats& stats = report_.stats;
+    double emit_seconds = 0;
+    auto write_chunk = [&] {
+        StageTimer emit_timer(emit_seconds);
+        sink.write(chunk.data(), chunk.size());
+    };
+    auto loop_start = std::chrono::steady_clock::now();
+    if (phase.fence) {
+        append_phase_fences(phase, chunk);
+        if (chunk.size() >= chunk_words) {
+            write_chunk();
+            report_.instructions += chunk.size();
+            chunk.clear();
+        }
+    }
+
+    std::vector<size_t> active(lanes.size());
+    for (size_t lane = 0; lane < active.size(); ++lane) active[lane] = lane;
+    IROperation ir_op;
+    while (!active.empty()) {
+        size_t still_active = 0;
+        for (size_t lane : active) {
+            if (!lanes[lane]->next(ir_op)) {
+                continue; // Lane finished; drop it from later rounds
+            }
+            active[still_active++] = lane;
+
+            const Tile& tile = lanes[lane]->tile();
+            InstructionWord word;
+            if (!translate_ir_op(ir_op, tile.lane, *plans[tile.problem], word)) {
+                continue;
+            }
+            if (!report_.batch.empty()) {
+                BatchEntry& entry = report_.batch[tile.problem];
+                size_t index = report_.instructions + chunk.size();
+                if (entry.end_word == 0) entry.first_word = index;
+                entry.end_word = index + 1;
+            }
+            chunk.push_back(word);
+            instr_format::UnpackedInstr unpacked = instr_format::unpack(word);
+            ++report_.core_instructions[unpacked.core_ptr];
+            ++stats.instructions_by_kind[instruction_kind(unpacked)];
+            if (chunk.size() == chunk_words) {
+                write_chunk();
+                report_.instructions += chunk.size();
+                chunk.clear();
+            }
+        }
+        active.resize(still_active);
+    }
+    if (!chunk.empty()) {
+        write_chunk();
+        report_.instructions += chunk.size();
+    }
+    double loop_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - loop_start).count();
+
+    // The loop pulls IR out of the lanes as it translates; what the lanes spent
+    // generating and the sink spent writing is booked to those stages
+    double refill_seconds = 0;
+    size_t buffer_bytes = chunk.capacity() * sizeof(InstructionWord);
+    ScheduleStats schedule;
+    for (const auto& lane : lanes) {
+        const PipelineStats& lane_stats = lane->stats();
+        report_.ir_ops += lane_stats.ir_ops;
+        report_.operand_reuse.loads_before += lane_stats.operand_reuse.loads_before;
+        report_.operand_reuse.loads_eliminated += lane_stats.operand_reuse.loads_eliminated;
+        report_.bank_selects += lane_stats.bank_selects;
+        report_.sparse_tiles += lane_stats.sparse_tiles;
+        report_.lut_tiles += lane_stats.lut_tiles;
+        add_lane_schedule(schedule, lane_stats.schedule);
+        add_pipeline_stats(lane_stats);
+        refill_seconds += lane_stats.refill_seconds;
+        buffer_bytes += lane->buffer_bytes();
+    }
+    lanes.clear();
+    for (auto& arena : arenas) arenas_->release(std::move(arena));
+    // Phases run one after another: their estimates add up, their buffers do not
+    report_.schedule.windows += schedule.windows;
+    report_.schedule.cycles_before += schedule.cycles_before;
+    report_.schedule.cycles_after += schedule.cycles_after;
+    stats.buffer_bytes = std::max(stats.buffer_bytes, buffer_bytes);
+    stats.time.emit += emit_seconds;
+    stats.time.translate += std::max(0.0, loop_seconds - refill_seconds - emit_seconds);
+}
+
+// Parallel compilation
+//
+// Passes restart at every tile, so each tile's words depend only on the tile.
+// Stage 3 generates every tile on the pool into its own buffer. A lane's
+// stream is its tiles back to back, so once the lane lengths are known the
+// round-robin position of every word has a closed form. Stage 4 splits the
+// output into blocks of rounds and lets each worker fill its own contiguous
+// part of the program.
+std::vector<InstructionWord> Compiler::compile_parallel(const SparseOperands* sparse) {
+    if (!pool_ || (options_.threads != 0 && pool_->size() != options_.threads)) {
+        pool_.reset(new ThreadPool(options_.threads));
+    }
+    std::vector<InstructionWord> program;
+    for (const ProgramPhase& phase : phases()) {
+        compile_parallel(phase, sparse, program);
+    }
+    report_.instructions = program.size();
+    return program;
+}
+
+void Compiler::compile_parallel(const ProgramPhase& phase, const SparseOperands* sparse,
+                                std::vector<InstructionWord>& program) {
+    const TilePlan& tiling = *phase.tiling;
+    const std::vector<const MemoryPlan*>& plans = phase.plans;
+
+    // --- Stage 3: Generate and translate every tile independently ---
+    struct TileOutput {
+        std::vector<InstructionWord> words;
+        PipelineStats stats;
+        double seconds = 0;      // Whole tile, generation and passes included
+        size_t stream_bytes = 0; // Its stream's chunk buffer
+    };
+    std::vector<const Tile*> tiles;
+    std::vector<size_t> lane_first_tile; // Index of each lane's first tile in tiles
+    for (const auto& lane_tiles : tiling.lane_tiles) {
+        lane_first_tile.push_back(tiles.size());
+        for (const Tile& tile : lane_tiles) tiles.push_back(&tile);
+    }
+    lane_first_tile.push_back(tiles.size());
+
+    std::vector<TileOutput> outputs(tiles.size());
+    pool_->parallel_for(tiles.size(), [&](size_t index) {
+        std::vector<Tile> single(1, *tiles[index]);
+        const MemoryPlan& memory_plan = *plans[single[0].problem];
+        std::unique_ptr<IRArena> arena = arenas_->acquire();
+        LaneStream stream(single, plans, options_.operand_reuse, options_.chunk_ops,
+                          options_.schedule ? &options_.machine : nullptr, sparse, phase.jobs, phase.lut,
+                          arena.get());
+        TileOutput& output = outputs[index];
+        StageTimer tile_timer(output.seconds);
+        if (!sparse && !phase.jobs && !(phase.lut && phase.lut->job(single[0]))) {
+            output.words.reserve(single[0].rows() * single[0].cols() * (3 * memory_plan.k_rows() + 2));
+        }
+        IROperation ir_op;
+        uint32_t lane = single[0].lane;
+        while (stream.next(ir_op)) {
+            InstructionWord word;
+            if (translate_ir_op(ir_op, lane, memory_plan, word)) {
+                output.words.push_back(word);
+            }
+        }
+        output.stats = stream.stats();
+        output.stream_bytes = stream.buffer_bytes();
+        arenas_->release(std::move(arena));
+    });
+
+    // --- Stage 4: Gather the lanes round-robin into the program ---
+    StageTimer gather_timer(report_.stats.time.emit);
+    size_t lane_count = tiling.lane_tiles.size();
+    std::vector<size_t> lane_length(lane_count, 0);
+    size_t total = 0;
+    size_t rounds = 0;
+    for (size_t lane = 0; lane < lane_count; ++lane) {
+        for (size_t t = lane_first_tile[lane]; t < lane_first_tile[lane + 1]; ++t) {
+            lane_length[lane] += outputs[t].words.size();
+        }
+        total += lane_length[lane];
+        rounds = std::max(rounds, lane_length[lane]);
+    }
+
+    if (phase.fence) {
+        append_phase_fences(phase, program);
+    }
+    size_t offset = program.size(); // Earlier phases and the fences
+    program.resize(offset + total);
+    constexpr size_t ROUNDS_PER_BLOCK = 1 << 14;
+    size_t blocks = (rounds + ROUNDS_PER_BLOCK - 1) / ROUNDS_PER_BLOCK;
+    std::vector<std::vector<size_t>> block_core_counts(blocks, std::vector<size_t>(NUM_CORES, 0));
+    std::vector<std::array<size_t, INSTRUCTION_KINDS>> block_kind_counts(blocks);
+    pool_->parallel_for(blocks, [&](size_t block) {
+        size_t first_round = block * ROUNDS_PER_BLOCK;
+        size_t last_round = std::min(rounds, first_round + ROUNDS_PER_BLOCK);
+
+        // Words before first_round: every lane contributed min(length, first_round)
+        size_t position = offset;
+        for (size_t lane = 0; lane < lane_count; ++lane) {
+            position += std::min(lane_length[lane], first_round);
+        }
+
+        // Per-lane cursor at first_round: current tile and offset within it
+        struct Cursor {
+            size_t tile;
+            size_t offset;
+        };
+        std::vector<Cursor> cursors(lane_count);
+        for (size_t lane = 0; lane < lane_count; ++lane) {
+            size_t tile = lane_first_tile[lane];
+            size_t offset = first_round;
+            while (tile < lane_first_tile[lane + 1] && offset >= outputs[tile].words.size()) {
+                offset -= outputs[tile].words.size();
+                ++tile;
+            }
+            cursors[lane] = Cursor{tile, offset};
+        }
+
+        std::vector<size_t>& core_counts = block_core_counts[block];
+        std::array<size_t, INSTRUCTION_KINDS>& kind_counts = block_kind_counts[block];
+        kind_counts.fill(0);
+        for (size_t round = first_round; round < last_round; ++round) {
+            for (size_t lane = 0; lane < lane_count; ++lane) {
+                if (round >= lane_length[lane]) continue;
+                Cursor& cursor = cursors[lane];
+                while (cursor.offset == outputs[cursor.tile].words.size()) {
+                    ++cursor.tile;
+                    cursor.offset = 0;
+                }
+                InstructionWord word = outputs[cursor.tile].words[cursor.offset++];
+                program[position++] = word;
+                instr_format::UnpackedInstr unpacked = instr_format::unpack(word);
+                ++core_counts[unpacked.core_ptr];
+                ++kind_counts[instruction_kind(unpacked)];
+            }
+        }
+    });
+
+    for (const auto& core_counts : block_core_counts) {
+        for (uint32_t core = 0; core < NUM_CORES; ++core) {
+            report_.core_instructions[core] += core_counts[core];
+        }
+    }
+    CompileStats& stats = report_.stats;
+    for (const auto& kind_counts : block_kind_counts) {
+        for (size_t kind = 0; kind < INSTRUCTION_KINDS; ++kind) {
+            stats.instructions_by_kind[kind] += kind_counts[kind];
+        }
+    }
+    size_t stream_bytes = 0;
+    size_t buffer_bytes = program.capacity() * sizeof(InstructionWord);
+    for (const TileOutput& output : outputs) {
+        add_pipeline_stats(output.stats);
+        stats.time.translate += std::max(0.0, output.seconds - output.stats.refill_seconds);
+        buffer_bytes += output.words.capacity() * sizeof(InstructionWord);
+        stream_bytes = std::max(stream_bytes, output.stream_bytes);
+        report_.ir_ops += output.stats.ir_ops;
+        report_.operand_reuse.loads_before += output.stats.operand_reuse.loads_before;
+        report_.operand_reuse.loads_eliminated += output.stats.operand_reuse.loads_eliminated;
+        report_.bank_selects += output.stats.bank_selects;
+        report_.sparse_tiles += output.stats.sparse_tiles;
+        report_.lut_tiles += output.stats.lut_tiles;
+    }
+    ScheduleStats schedule;
+    for (size_t lane = 0; lane < lane_count; ++lane) {
+        ScheduleStats lane_schedule;
+        for (size_t t = lane_first_tile[lane]; t < lane_first_tile[lane + 1]; ++t) {
+            lane_schedule.windows += outputs[t].stats.schedule.windows;
+            lane_schedule.cycles_before += outputs[t].stats.schedule.cycles_before;
+            lane_schedule.cycles_after += outputs[t].stats.schedule.cycles_after;
+        }
+        add_lane_schedule(schedule, lane_schedule);
+    }
+    // Phases run one after another: their estimates add up, their buffers do not
+    report_.schedule.windows += schedule.windows;
+    report_.schedule.cycles_before += schedule.cycles_before;
+    report_.schedule.cycles_after += schedule.cycles_after;
+    buffer_bytes += stream_bytes * pool_->size(); // One stream live per worker at a time
+    stats.buffer_bytes = std::max(stats.buffer_bytes, buffer_bytes);
+
+    // Batch table: a word issued by a lane at round r lands after min(length, r)
+    // words of every lane and after the lanes before it that are still running
+    if (!report_.batch.empty()) {
+        auto position = [&](size_t lane, size_t round) {
+            size_t before = offset;
+            for (size_t other = 0; other < lane_count; ++other) {
+                before += std::min(lane_length[other], round) + (other < lane && lane_length[other] > round);
+            }
+            return before;
+        };
+        for (size_t lane = 0; lane < lane_count; ++lane) {
+            size_t round = 0;
+            for (size_t t = lane_first_tile[lane]; t < lane_first_tile[lane + 1]; ++t) {
+                size_t length = outputs[t].words.size();
+                if (length > 0) {
+                    BatchEntry& entry = report_.batch[tiles[t]->problem];
+                    size_t first = position(lane, round);
+                    size_t last = position(lane, round + length - 1);
+                    if (entry.end_word == 0 || first < entry.first_word) entry.first_word = first;
+                    entry.end_word = std::max(entry.end_word, last + 1);
+                }
+                round += length;
+            }
+        }
+    }
+}
+
+void Compiler::append_phase_fences(const ProgramPhase& phase, std::vector<InstructionWord>& words) {
+    CompileStats& stats = report_.stats;
+    for (uint32_t lane = 0; lane < phase.tiling->lanes; ++lane) {
+        if (phase.tiling->lane_tiles[lane].empty()) continue;
+        for (uint8_t buffer = 0; buffer < 2; ++buffer) {
+            InstructionWord word;
+            translate_ir_op(IROperation(IROpType::FENCE, 0, 0, buffer), lane, *phase.plans.front(), word);
+            words.push_back(word);
+            instr_format::UnpackedInstr unpacked = instr_format::unpack(word);
+            ++report_.core_instructions[unpacked.core_ptr];
+            ++stats.instructions_by_kind[instruction_kind(unpacked)];
+            ++stats.ir_ops_by_type[static_cast<size_t>(IROpType::FENCE)];
+            ++report_.ir_ops;
+        }
+    }
+}
+
+// Lanes run side by side, so a phase takes the slowest lane's estimate
+void Compiler::add_lane_schedule(ScheduleStats& phase, const ScheduleStats& lane) {
+    phase.windows += lane.windows;
+    phase.cycles_before = std::max(phase.cycles_before, lane.cycles_before);
+    phase.cycles_after = std::max(phase.cycles_after, lane.cycles_after);
+}
+
+void Compiler::add_pipeline_stats(const PipelineStats& pipeline) {
+    CompileStats& stats = report_.stats;
+    stats.time.ir_generation += pipeline.generate_seconds;
+    for (auto [total, pass] : {std::make_pair(&stats.operand_reuse, &pipeline.reuse_pass),
+                               std::make_pair(&stats.schedule, &pipeline.schedule_pass),
+                               std::make_pair(&stats.bank_select, &pipeline.bank_pass)}) {
+        total->seconds += pass->seconds;
+        total->ops_in += pass->ops_in;
+        total->ops_out += pass->ops_out;
+    }
+    for (size_t type = 0; type < IR_OP_TYPES; ++type) {
+        stats.ir_ops_by_type[type] += pipeline.ops_by_type[type];
+    }
+}
+
+void Compiler::finish_stats() {
+    report_.stats.time.total = std::chrono::duration<double>(std::chrono::steady_clock::now() - compile_start_).count();
+    if (stats_callback_) {
+        stats_callback_(report_);
+    }
+}
+
+// The IR-to-ISA translator: one IR operation to at most one instruction word
+bool Compiler::translate_ir_op(const IROperation& ir_op, uint32_t lane, const MemoryPlan& memory_plan,
+                               InstructionWord& word) {
+    Opcode opcode_val;
+    uint32_t core_ptr_val = 2u * lane; // Even core of the lane
+    bool rd_flag = false;
+    bool wr_flag = false;
+    uint32_t row_addr_val = 0;
+
+    switch (ir_op.type()) {
+        case IROpType::RESET_ACC:
+            opcode_val = Opcode::COMPUTE_SETUP;
+            // Flags and address remain 0
+            break;
+
+        case IROpType::LOAD_A_ELEMENT:
+            opcode_val = Opcode::MEM_LOAD;
+            rd_flag = true;
+            wr_flag = (ir_op.latch() != 0); // WR selects the core's second latch
+            // Buffer 1 lives on the odd core of the lane
+            core_ptr_val += static_cast<uint32_t>(ir_op.target_buffer());
+            // Row within the bank selected by the bank-select pass
+            row_addr_val = memory_plan.row_of(memory_plan.address_a(lane, ir_op.row(), ir_op.col()));
+            break;
+
+        case IROpType::LOAD_B_ELEMENT:
+            opcode_val = Opcode::MEM_LOAD;
+            rd_flag = true;
+            wr_flag = (ir_op.latch() != 0); // WR selects the core's second latch
+            // Buffer 1 lives on the odd core of the lane
+            core_ptr_val += static_cast<uint32_t>(ir_op.target_buffer());
+            // Row within the bank selected by the bank-select pass
+            row_addr_val = memory_plan.row_of(memory_plan.address_b(lane, ir_op.row(), ir_op.col()));
+            break;
+
+        case IROpType::EXECUTE_MAC:
+            opcode_val = Opcode::COMPUTE_EXEC;
+            // RD / WR pick the latches of buffer 0 / buffer 1; the address gives the element type
+            rd_flag = (ir_op.latch() & 1) != 0;
+            wr_flag = (ir_op.latch() & 2) != 0;
+            row_addr_val = static_cast<uint32_t>(memory_plan.element_type());
+            break;
+
+        case IROpType::STORE_C_ELEMENT:
+            opcode_val = Opcode::MEM_STORE;
+            rd_flag = false;
+            wr_flag = true;
+             // Stores read the accumulator on the even core of the lane
+            // Row within the bank selected by the bank-select pass
+            row_addr_val = memory_plan.row_of(memory_plan.address_c(ir_op.row(), ir_op.col()));
+            break;
+
+        case IROpType::LOAD_ELEMENT:
+            opcode_val = Opcode::MEM_LOAD;
+            rd_flag = true;
+            wr_flag = (ir_op.latch() != 0);
+            core_ptr_val += static_cast<uint32_t>(ir_op.target_buffer());
+            row_addr_val = memory_plan.row_of(ir_op.row()); // row is the global row
+            break;
+
+        case IROpType::STORE_ELEMENT:
+            opcode_val = Opcode::MEM_STORE;
+            wr_flag = true;
+            row_addr_val = memory_plan.row_of(ir_op.row());
+            break;
+
+        case IROpType::FENCE:
+            // MEM_STORE with RD set stores nothing; it holds the core until earlier stores land
+            opcode_val = Opcode::MEM_STORE;
+            core_ptr_val += static_cast<uint32_t>(ir_op.target_buffer());
+            rd_flag = true;
+            break;
+
+        case IROpType::SELECT_BANK:
+        case IROpType::SELECT_SEGMENT:
+            // COMPUTE_SETUP with RD set writes the bank register; WR picks the half
+            opcode_val = Opcode::COMPUTE_SETUP;
+            core_ptr_val += static_cast<uint32_t>(ir_op.target_buffer());
+            rd_flag = true;
+            wr_flag = (ir_op.type() == IROpType::SELECT_SEGMENT);
+            row_addr_val = static_cast<uint32_t>(ir_op.row());
+            break;
+
+        default:
+             std::cerr << "Warning: Unknown IR operation type encountered during translation: "
+                       << static_cast<int>(ir_op.type()) << ". Skipping." << std::endl;
+             return false; // Skip this IR operation
+    }
+
+    // Pack the fields into a single instruction word
+    word = instr_format::pack(opcode_val, core_ptr_val, rd_flag, wr_flag, row_addr_val);
+    return true;
+}
 
 } // namespace pim 
\ No newline at end of file
@@ -0,0 +1,332 @@
+#include "compressed_program.hpp"
+#include "mapped_file.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+namespace pim {
+
+namespace {
+
+constexpr size_t COUNTS_BYTES = 16;
+constexpr size_t RUN_BYTES = 16;
+constexpr size_t BLOCK_BYTES = 8;
+
+// Same increments and length, so copies of the two runs can share a block slot
+bool same_shape(const WordRun& a, const WordRun& b) {
+    return a.delta == b.delta && a.count == b.count;
+}
+
+} // namespace
+
+CompressedProgram::CompressedProgram(std::vector<WordRun> runs, std::vector<RunBlock> blocks)
+    : runs_(std::move(runs)), blocks_(std::move(blocks))
+{
+    size_t first = 0;
+    for (const RunBlock& block : blocks_) {
+        if (block.repeat == 0 || block.runs == 0 || block.runs > runs_.size() - first) {
+            throw std::runtime_error("Compressed program has an empty or overlong block.");
+        }
+        size_t words = 0;
+        for (size_t r = first; r < first + block.runs; ++r) {
+            if (runs_[r].count == 0) {
+                throw std::runtime_error("Compressed program has an empty run.");
+            }
+            words += runs_[r].count;
+        }
+        size_ += words * block.repeat;
+        first += block.runs;
+    }
+    if (first != runs_.size()) {
+        throw std::runtime_error("Compressed program has runs outside every block.");
+    }
+}
+
+size_t CompressedProgram::file_bytes() const {
+    return PROGRAM_HEADER_BYTES + COUNTS_BYTES + runs_.size() * RUN_BYTES + blocks_.size() * BLOCK_BYTES;
+}
+
+size_t CompressedProgram::Reader::read(InstructionWord* out, size_t max) {
+    const std::vector<WordRun>& runs = program_.runs_;
+    const std::vector<RunBlock>& blocks = program_.blocks_;
+    size_t written = 0;
+    while (written < max && block_ < blocks.size()) {
+        const RunBlock& block = blocks[block_];
+        const WordRun& run = runs[first_run_ + run_];
+        size_t take = std::min<size_t>(run.count - word_, max - written);
+        uint32_t word = run.start + copy_ * run.stride + word_ * run.delta;
+        for (size_t n = 0; n < take; ++n, word += run.delta) {
+            out[written + n] = word;
+        }
+        written += take;
+        word_ += static_cast<uint32_t>(take);
+
+        if (word_ == run.count) {
+            word_ = 0;
+            if (++run_ == block.runs) {
+                run_ = 0;
+                if (++copy_ == block.repeat) {
+                    copy_ = 0;
+                    first_run_ += block.runs;
+                    ++block_;
+                }
+            }
+        }
+    }
+    return written;
+}
+
+std::vector<InstructionWord> CompressedProgram::expand() const {
+    std::vector<InstructionWord> words(size_);
+    Reader reader(*this);
+    reader.read(words.data(), words.size());
+    return words;
+}
+
+uint64_t CompressedProgram::checksum() const {
+    ProgramChecksum checksum;
+    InstructionWord batch[4096];
+    Reader reader(*this);
+    while (size_t count = reader.read(batch, 4096)) {
+        checksum.update(batch, count);
+    }
+    return checksum.value();
+}
+
+void CompressingSink::write(const InstructionWord* words, size_t count) {
+    checksum_.update(words, count);
+    for (size_t n = 0; n < count; ++n) {
+        InstructionWord word = words[n];
+        if (run_.count == 1) {
+            run_.delta = word - run_.start;
+            run_.count = 2;
+        } else if (run_.count > 1 && word - last_ == run_.delta && run_.count < UINT32_MAX) {
+            ++run_.count;
+        } else {
+            if (run_.count > 0) push_run(run_);
+            run_ = WordRun{word, 0, 1, 0};
+        }
+        last_ = word;
+    }
+}
+
+void CompressingSink::finish() {
+    if (run_.count > 0) {
+        push_run(run_);
+        run_ = WordRun();
+    }
+    fold(true);
+}
+
+void CompressingSink::push_run(const WordRun& run) {
+    if (run.count == 2) {
+        // Two words make a run whatever they are. Where lanes drift out of
+        // phase, such pairs straddle a round boundary and change delta every
+        // round; as two single words they still fold with a stride each.
+        pending_.push_back(WordRun{run.start, 0, 1, 0});
+        pending_.push_back(WordRun{run.start + run.delta, 0, 1, 0});
+    } else {
+        pending_.push_back(run);
+    }
+    if (pending_.size() >= FOLD_WINDOW) {
+        fold(false);
+    }
+}
+
+void CompressingSink::fold(bool final) {
+    size_t at = 0;
+    size_t end = pending_.size();
+    while (at < end && (final || end - at >= 2 * MAX_PERIOD)) {
+        if (size_t absorbed = extend_last_block(at, end)) {
+            at += absorbed;
+            continue;
+        }
+
+        // Period whose repetitions cover the most runs; the shortest one on ties
+        size_t best_period = 0;
+        size_t best_coverage = 0;
+        for (size_t period = 1; period <= MAX_PERIOD && at + 2 * period <= end; ++period) {
+            size_t covered = coverage(at, end, period);
+            if (covered > best_coverage) {
+                best_coverage = covered;
+                best_period = period;
+            }
+        }
+        if (best_period > 0) {
+            append_block(at, best_period, best_coverage / best_period);
+            at += best_coverage;
+        } else {
+            append_block(at, 1, 1);
+            ++at;
+        }
+    }
+    pending_.erase(pending_.begin(), pending_.begin() + at);
+}
+
+size_t CompressingSink::extend_last_block(size_t at, size_t end) {
+    if (program_.blocks_.empty() || program_.blocks_.back().repeat < 2) {
+        return 0;
+    }
+    RunBlock& block = program_.blocks_.back();
+    const WordRun* body = program_.runs_.data() + program_.runs_.size() - block.runs;
+    size_t words = 0;
+    for (size_t r = 0; r < block.runs; ++r) words += body[r].count;
+
+    size_t absorbed = 0;
+    while (at + absorbed + block.runs <= end && block.repeat < UINT32_MAX) {
+        const WordRun* next = pending_.data() + at + absorbed;
+        for (size_t r = 0; r < block.runs; ++r) {
+            if (!same_shape(next[r], body[r]) || next[r].start != body[r].start + block.repeat * body[r].stride) {
+                return absorbed;
+            }
+        }
+        ++block.repeat;
+        absorbed += block.runs;
+        program_.size_ += words;
+    }
+    return absorbed;
+}
+
+size_t CompressingSink::coverage(size_t at, size_t end, size_t period) const {
+    const WordRun* body = pending_.data() + at;
+    size_t repeat = 1;
+    while (at + (repeat + 1) * period <= end && repeat < UINT32_MAX) {
+        const WordRun* next = body + repeat * period;
+        for (size_t r = 0; r < period; ++r) {
+            uint32_t stride = body[period + r].start - body[r].start;
+            if (!same_shape(next[r], body[r]) || next[r].start != body[r].start + static_cast<uint32_t>(repeat) * stride) {
+                return repeat > 1 ? repeat * period : 0;
+            }
+        }
+        ++repeat;
+    }
+    return repeat > 1 ? repeat * period : 0;
+}
+
+void CompressingSink::append_block(size_t at, size_t period, size_t repeat) {
+    std::vector<WordRun>& runs = program_.runs_;
+    std::vector<RunBlock>& blocks = program_.blocks_;
+    size_t words = 0;
+    for (size_t r = 0; r < period; ++r) {
+        WordRun run = pending_[at + r];
+        run.stride = repeat > 1 ? pending_[at + period + r].start - run.start : 0;
+        runs.push_back(run);
+        words += run.count;
+    }
+    program_.size_ += words * repeat;
+
+    // Loose runs accumulate in one single-pass block
+    if (repeat == 1 && !blocks.empty() && blocks.back().repeat == 1 && blocks.back().runs < UINT32_MAX - period) {
+        blocks.back().runs += static_cast<uint32_t>(period);
+    } else {
+        blocks.push_back(RunBlock{static_cast<uint32_t>(repeat), static_cast<uint32_t>(period)});
+    }
+}
+
+CompressedProgramVerifier::CompressedProgramVerifier(const CompressedProgram& program) : reader_(program) {}
+
+void CompressedProgramVerifier::write(const InstructionWord* words, size_t count) {
+    if (mismatch_ != SIZE_MAX) {
+        return;
+    }
+    expected_.resize(count);
+    size_t available = reader_.read(expected_.data(), count);
+    for (size_t n = 0; n < available; ++n) {
+        if (words[n] != expected_[n]) {
+            mismatch_ = compared_ + n;
+            return;
+        }
+    }
+    compared_ += available;
+    if (available < count) {
+        mismatch_ = compared_; // The compressed program ended first
+    }
+}
+
+void CompressedProgramVerifier::finish() {
+    if (mismatch_ == SIZE_MAX && !reader_.done()) {
+        mismatch_ = compared_; // The stream ended first
+    }
+    finished_ = true;
+}
+
+void write_compressed_program(const std::string& path, const ProgramHeader& header,
+                              const CompressedProgram& program)
+{
+    std::vector<unsigned char> bytes(program.file_bytes());
+    unsigned char* p = bytes.data();
+    encode_program_header(header, COMPRESSED_PROGRAM_MAGIC, p);
+    p += PROGRAM_HEADER_BYTES;
+    put_u64(p, program.runs().size());
+    put_u64(p + 8, program.blocks().size());
+    p += COUNTS_BYTES;
+    for (const WordRun& run : program.runs()) {
+        put_u32(p, run.start);
+        put_u32(p + 4, run.delta);
+        put_u32(p + 8, run.count);
+        put_u32(p + 12, run.stride);
+        p += RUN_BYTES;
+    }
+    for (const RunBlock& block : program.blocks()) {
+        put_u32(p, block.repeat);
+        put_u32(p + 4, block.runs);
+        p += BLOCK_BYTES;
+    }
+
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        throw std::runtime_error("Could not open output file: " + path);
+    }
+    bool ok = std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+    if (std::fclose(file) != 0 || !ok) {
+        throw std::runtime_error("Failed to write " + path + ".");
+    }
+}
+
+CompressedProgram read_compressed_program(const std::string& path, ProgramHeader& header) {
+    MappedFile file(path);
+    const unsigned char* p = file.data();
+    if (file.size() < PROGRAM_HEADER_BYTES + COUNTS_BYTES) {
+        throw std::runtime_error("Compressed program file is truncated: " + path);
+    }
+    header = decode_program_header(p, COMPRESSED_PROGRAM_MAGIC);
+    p += PROGRAM_HEADER_BYTES;
+    uint64_t run_count = get_u64(p);
+    uint64_t block_count = get_u64(p + 8);
+    p += COUNTS_BYTES;
+    uint64_t available = file.size() - PROGRAM_HEADER_BYTES - COUNTS_BYTES;
+    if (run_count > available / RUN_BYTES || block_count > (available - run_count * RUN_BYTES) / BLOCK_BYTES) {
+        throw std::runtime_error("Compressed program file is truncated: " + path);
+    }
+
+    std::vector<WordRun> runs(static_cast<size_t>(run_count));
+    for (WordRun& run : runs) {
+        run = WordRun{get_u32(p), get_u32(p + 4), get_u32(p + 8), get_u32(p + 12)};
+        p += RUN_BYTES;
+    }
+    std::vector<RunBlock> blocks(static_cast<size_t>(block_count));
+    for (RunBlock& block : blocks) {
+        block = RunBlock{get_u32(p), get_u32(p + 4)};
+        p += BLOCK_BYTES;
+    }
+    CompressedProgram program(std::move(runs), std::move(blocks));
+    if (program.size() != header.word_count) {
+        throw std::runtime_error("Compressed program " + path + " expands to " + std::to_string(program.size()) +
+                                 " words, but its header says " + std::to_string(header.word_count) + ".");
+    }
+    return program;
+}
+
+bool is_compressed_program_file(const std::string& path) {
+    unsigned char magic[4] = {};
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    bool match = std::fread(magic, 1, 4, file) == 4 && std::memcmp(magic, COMPRESSED_PROGRAM_MAGIC, 4) == 0;
+    std::fclose(file);
+    return match;
+}
+
+} // namespace pim
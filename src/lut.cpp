@@ -0,0 +1,243 @@
+#include "lut.hpp"
+#include "autotune.hpp"
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+namespace pim {
+
+namespace {
+
+// Index of value in values, appending it when it is new
+uint32_t value_index(std::vector<int32_t>& values, int32_t value) {
+    auto found = std::find(values.begin(), values.end(), value);
+    if (found == values.end()) {
+        values.push_back(value);
+        return static_cast<uint32_t>(values.size() - 1);
+    }
+    return static_cast<uint32_t>(found - values.begin());
+}
+
+// Groups columns [col_begin, col_end) of B; false when the block has more than
+// max_values distinct nonzero values. values collects the constants the
+// entries refer to.
+bool group_block(const Matrix& matrix_b, size_t col_begin, size_t col_end, size_t max_values,
+                 std::vector<int32_t>& values, LutBlock& block) {
+    size_t inner = matrix_b.rows();
+    size_t width = col_end - col_begin;
+
+    std::vector<int32_t> distinct;
+    for (size_t k = 0; k < inner; ++k) {
+        const int32_t* row = matrix_b.row(k) + col_begin;
+        for (size_t c = 0; c < width; ++c) {
+            if (row[c] != 0 && std::find(distinct.begin(), distinct.end(), row[c]) == distinct.end()) {
+                if (distinct.size() == max_values) return false;
+                distinct.push_back(row[c]);
+            }
+        }
+    }
+
+    // --- Rows: equal ones form a group, rows of zeros none ---
+    auto row_of = [&](uint32_t k) { return matrix_b.row(k) + col_begin; };
+    std::vector<uint32_t> order(inner);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t x, uint32_t y) {
+        return std::lexicographical_compare(row_of(x), row_of(x) + width, row_of(y), row_of(y) + width);
+    });
+    std::vector<std::vector<uint32_t>> groups;
+    for (size_t n = 0; n < order.size(); ++n) {
+        const int32_t* row = row_of(order[n]);
+        if (n > 0 && std::equal(row, row + width, row_of(order[n - 1]))) {
+            if (!groups.empty() && groups.back()[0] != UINT32_MAX) groups.back().push_back(order[n]);
+        } else if (std::all_of(row, row + width, [](int32_t v) { return v == 0; })) {
+            groups.push_back({UINT32_MAX}); // Placeholder that swallows the zero rows
+        } else {
+            groups.push_back({order[n]});
+        }
+    }
+    groups.erase(std::remove_if(groups.begin(), groups.end(),
+                                [](const std::vector<uint32_t>& g) { return g[0] == UINT32_MAX; }),
+                 groups.end());
+    std::sort(groups.begin(), groups.end()); // By first k; each group is ascending already
+
+    block.group_begin.assign(1, 0);
+    std::vector<uint32_t> entry_begin(1, 0);
+    for (const std::vector<uint32_t>& group : groups) {
+        block.group_k.insert(block.group_k.end(), group.begin(), group.end());
+        block.group_begin.push_back(static_cast<uint32_t>(block.group_k.size()));
+        std::vector<int32_t> row(row_of(group[0]), row_of(group[0]) + width);
+        std::sort(row.begin(), row.end());
+        row.erase(std::unique(row.begin(), row.end()), row.end());
+        for (int32_t v : row) {
+            if (v != 0) {
+                uint32_t g = static_cast<uint32_t>(block.group_begin.size() - 2);
+                block.entries.push_back(LutBlock::Entry{g, value_index(values, v)});
+            }
+        }
+        entry_begin.push_back(static_cast<uint32_t>(block.entries.size()));
+    }
+
+    // --- Columns: equal over the group rows means equal everywhere ---
+    auto value_at = [&](size_t g, size_t c) { return matrix_b(block.group_k[block.group_begin[g]], col_begin + c); };
+    std::vector<uint32_t> columns(width);
+    std::iota(columns.begin(), columns.end(), 0);
+    auto column_less = [&](uint32_t x, uint32_t y) {
+        for (size_t g = 0; g < groups.size(); ++g) {
+            if (value_at(g, x) != value_at(g, y)) return value_at(g, x) < value_at(g, y);
+        }
+        return false;
+    };
+    std::stable_sort(columns.begin(), columns.end(), column_less);
+    std::vector<std::vector<uint32_t>> runs;
+    for (size_t n = 0; n < columns.size(); ++n) {
+        if (n > 0 && !column_less(columns[n - 1], columns[n])) runs.back().push_back(columns[n]);
+        else runs.push_back({columns[n]});
+    }
+    std::sort(runs.begin(), runs.end());
+
+    block.column_begin.assign(1, 0);
+    block.copy_begin.assign(1, 0);
+    for (const std::vector<uint32_t>& run : runs) {
+        for (size_t g = 0; g < groups.size(); ++g) {
+            int32_t v = value_at(g, run[0]);
+            if (v == 0) continue;
+            for (uint32_t e = entry_begin[g]; e < entry_begin[g + 1]; ++e) {
+                if (values[block.entries[e].constant] == v) block.column_entries.push_back(e);
+            }
+        }
+        block.column_begin.push_back(static_cast<uint32_t>(block.column_entries.size()));
+        for (uint32_t c : run) block.copies.push_back(static_cast<uint32_t>(col_begin + c));
+        block.copy_begin.push_back(static_cast<uint32_t>(block.copies.size()));
+    }
+    return true;
+}
+
+// Estimated cycles of tile under the LUT lowering with its table at row
+// table, in the terms tiling_cost uses for the MAC lowering. A chain costs a
+// step per MAC, like the triple loop's, plus the store and reset around it
+// and the bank selects of the even core, which walks between A or C and the
+// table. A table chain whose first A element is still in its latch skips
+// that load; it then costs only the store, the reset and the MAC.
+uint64_t lut_tile_cycles(const LutBlock& block, const Tile& tile, const MemoryPlan& plan, uint64_t table,
+                         const CompileOptions& options)
+{
+    const MachineModel& machine = options.machine;
+    double step = step_cycles(machine, options.schedule, 1);
+    double boundary = step + machine.setup_latency + 1.0;
+    double held = machine.mac_latency + machine.setup_latency + 1.0;
+    size_t entries = block.entries.size();
+    uint64_t selects = 0;
+    bool known = false;
+    uint32_t current = 0;
+    auto select = [&](uint64_t row) {
+        uint32_t bank = plan.bank_of(row);
+        if (!known || (current >> BANK_SELECT_BITS) != (bank >> BANK_SELECT_BITS)) ++selects;
+        if (!known || (current & BANK_SELECT_MASK) != (bank & BANK_SELECT_MASK)) ++selects;
+        known = true;
+        current = bank;
+    };
+
+    double cycles = machine.store_latency; // The fence between the tables and the lookups
+    size_t chain = 0;
+    for (size_t r = 0; r < tile.rows(); ++r, chain = 0) {
+        size_t i = tile.row_begin + r;
+        uint64_t row_table = table + static_cast<uint64_t>(r) * entries;
+        for (size_t e = 0; e < entries; ++e, ++chain) {
+            uint32_t group = block.entries[e].group;
+            uint32_t first = block.group_begin[group];
+            uint32_t count = block.group_begin[group + 1] - first;
+            bool reversed = chain % 2 == 1;
+            bool shares = options.operand_reuse && e > 0 && block.entries[e - 1].group == group;
+            cycles += (shares ? held : boundary) + step * (count - 1);
+            for (uint32_t n = shares ? 1 : 0; n < count; ++n) {
+                select(plan.address_a(tile.lane, i, block.group_k[first + (reversed ? count - 1 - n : n)]));
+            }
+            select(row_table + e);
+        }
+        for (size_t u = 0; u < block.columns(); ++u, ++chain) {
+            uint32_t first = block.column_begin[u];
+            uint32_t count = block.column_begin[u + 1] - first;
+            bool reversed = chain % 2 == 1;
+            cycles += boundary + step * (count - 1);
+            for (uint32_t n = 0; n < count; ++n) {
+                select(row_table + block.column_entries[first + (reversed ? count - 1 - n : n)]);
+            }
+            for (uint32_t c = block.copy_begin[u]; c < block.copy_begin[u + 1]; ++c) {
+                select(plan.address_c(i, block.copies[c]));
+            }
+            cycles += machine.bank_cycles * (block.copy_begin[u + 1] - block.copy_begin[u] - 1);
+        }
+    }
+    return static_cast<uint64_t>(std::ceil(cycles)) + selects + machine.load_latency + machine.mac_latency +
+           machine.store_latency;
+}
+
+} // namespace
+
+LutLowering::LutLowering(MemoryPlan& plan, const TilePlan& tiling, const Matrix& matrix_b,
+                         const CompileOptions& options)
+    : tile_rows_(tiling.tile_rows), tile_cols_(tiling.tile_cols)
+{
+    if (matrix_b.rows() != plan.cols_a() || matrix_b.cols() != plan.cols_b()) {
+        throw std::runtime_error("B does not match the shape of the memory plan.");
+    }
+    size_t grid_rows = (plan.rows_a() + tile_rows_ - 1) / tile_rows_;
+    grid_cols_ = (plan.cols_b() + tile_cols_ - 1) / tile_cols_;
+    jobs_.assign(grid_rows * grid_cols_, LutJob());
+
+    // --- Group every column block with few enough values; +1 is constant 0 ---
+    std::vector<int32_t> values{1};
+    std::vector<bool> eligible(grid_cols_, false);
+    blocks_.resize(grid_cols_);
+    for (size_t col = 0; col < grid_cols_; ++col) {
+        size_t col_begin = col * tile_cols_;
+        size_t col_end = std::min(plan.cols_b(), col_begin + tile_cols_);
+        eligible[col] = group_block(matrix_b, col_begin, col_end, options.lut_values, values, blocks_[col]);
+        if (!eligible[col]) blocks_[col] = LutBlock();
+    }
+
+    // --- Tiles in grid order: LUT where it is estimated faster and its rows fit ---
+    std::vector<const Tile*> grid(jobs_.size(), nullptr);
+    for (const auto& lane_tiles : tiling.lane_tiles) {
+        for (const Tile& tile : lane_tiles) {
+            grid[(tile.row_begin / tile_rows_) * grid_cols_ + tile.col_begin / tile_cols_] = &tile;
+        }
+    }
+    std::vector<uint64_t> constants(tiling.lanes, UINT64_MAX);
+    for (size_t index = 0; index < grid.size(); ++index) {
+        const Tile* tile = grid[index];
+        const LutBlock& block = blocks_[index % grid_cols_];
+        if (!tile || !eligible[index % grid_cols_]) continue;
+        TilePlan single{1, tile->rows(), tile->cols(), {{*tile}}};
+        uint64_t mac_cycles = tiling_cost(single, plan.k_rows(), plan.mode(), options).cycles;
+        // The table goes on the next free bank, after the lane's constants if they are still to be placed
+        uint64_t bank_rows = plan.geometry().rows_per_bank;
+        uint64_t table = (plan.rows_used() + bank_rows - 1) / bank_rows * bank_rows;
+        if (constants[tile->lane] == UINT64_MAX) table += (values.size() + bank_rows - 1) / bank_rows * bank_rows;
+        uint64_t lut_cycles = lut_tile_cycles(block, *tile, plan, table, options);
+        if (lut_cycles >= mac_cycles) continue;
+
+        try {
+            // The lane's constants, read by its odd core, on a bank of their own
+            if (constants[tile->lane] == UINT64_MAX) {
+                constants[tile->lane] = plan.append_scratch(values.size());
+                for (size_t v = 0; v < values.size(); ++v) {
+                    plan.add_constant(constants[tile->lane] + v, values[v]);
+                }
+            }
+            LutJob& job = jobs_[index];
+            uint64_t rows = static_cast<uint64_t>(tile->rows()) * block.entries.size();
+            if (rows > 0) job.table = plan.append_scratch(rows);
+            job.block = &block;
+            job.constants = constants[tile->lane];
+            job.one = 0;
+            ++tile_count_;
+            table_rows_ += rows;
+        } catch (const std::runtime_error&) {
+            continue; // No room: the tile keeps the MAC lowering
+        }
+    }
+}
+
+} // namespace pim
@@ -1,200 +1,346 @@
+#include "autotune.hpp"
+#include "cli.hpp"
 #include "compiler.hpp"
+#include "compressed_program.hpp"
 #include "instruction.hpp" // Make sure this includes the new format
-// #include "simulator.hpp" // No longer needed
+#include "matrix_io.hpp"
+#include "memory_image.hpp"
+#include "program_file.hpp"
+#include "sink.hpp"
 #include <iostream>
-#include <iomanip> // Include for std::setw, std::hex, std::setfill, std::left, std::right
+#include <iomanip> // Include for std::setw, std::setprecision
+#include <cstdio>
 #include <vector>
+#include <algorithm>
+#include <chrono>
+#include <memory>
 #include <string>
-#include <fstream>  // For file input
-#include <sstream>  // For parsing lines
 #include <stdexcept> // For exceptions
 
 using namespace pim;
 
-// Simple parser for matrix data from a file
-// Expects lines like: std::vector<std::vector<int>> matrix_a = {{1, 2}, {3, 4}};
-// Returns a pair containing matrix_a and matrix_b
-std::pair<std::vector<std::vector<int>>, std::vector<std::vector<int>>> 
-parse_matrix_file(const std::string& filename) {
-    std::ifstream infile(filename);
-    if (!infile.is_open()) {
-        throw std::runtime_error("Could not open file: " + filename);
-    }
-
-    std::vector<std::vector<int>> matrix_a, matrix_b;
-    std::string line;
-    bool found_a = false, found_b = false;
-
-    while (getline(infile, line)) {
-        std::string matrix_name; // "matrix_a" or "matrix_b"
-        if (line.find("std::vector<std::vector<int>> matrix_a") != std::string::npos) {
-            matrix_name = "matrix_a";
-        } else if (line.find("std::vector<std::vector<int>> matrix_b") != std::string::npos) {
-            matrix_name = "matrix_b";
-        } else {
-            continue; // Skip lines not defining our matrices
-        }
-
-        size_t start_pos = line.find("{{"); // Find start of data {{
-        if (start_pos == std::string::npos) {
-             std::cerr << "Warning: Could not find matrix start pattern '{{' in line: " << line << std::endl;
-             continue;
-        }
-        size_t end_pos = line.rfind("}}"); // Find end of data }};
-        if (end_pos == std::string::npos || end_pos <= start_pos) {
-             std::cerr << "Warning: Could not find matrix end pattern '}};' in line: " << line << std::endl;
-             continue;
-        }
-
-        std::string data_str = line.substr(start_pos + 1, end_pos - start_pos -1); // Get content between {{ and }}
-
-        std::vector<std::vector<int>> current_matrix;
-        std::stringstream ss_rows(data_str);
-        std::string segment;
-
-        // Check for empty matrix definition like {{}}
-         bool isEmptyMatrix = true;
-         for(char c : data_str) {
-             if (!isspace(c) && c != '{' && c != '}') {
-                 isEmptyMatrix = false;
-                 break;
-             }
-         }
-         if (isEmptyMatrix && data_str.find('{') == std::string::npos) { // Ensure it's not just whitespace between {}
-             current_matrix = {}; // Assign empty matrix
-         } else {
-            // Existing parsing logic for non-empty matrices
-            while(getline(ss_rows, segment, '}')) { // Split by rows "{...}, {..."
-                 size_t row_start = segment.find('{');
-                 if(row_start == std::string::npos) continue; // Skip segments without '{'
-
-                 std::string row_data = segment.substr(row_start + 1);
-
-                 std::vector<int> row;
-                 std::stringstream ss_cols(row_data);
-                 std::string val_str;
-                 while(getline(ss_cols, val_str, ',')) {
-                     // Trim whitespace from val_str
-                     size_t first = val_str.find_first_not_of(" \t\n\r");
-                     if (std::string::npos == first) continue; // Skip empty segments
-                     size_t last = val_str.find_last_not_of(" \t\n\r");
-                     val_str = val_str.substr(first, (last - first + 1));
-
-                     if (val_str.empty()) continue; // Skip if becomes empty after trim
+int main(int argc, char* argv[]) {
+    std::vector<std::string> inputs; // One C++ source file, or two .npy or .mtx files
+    std::string batch_manifest;      // Compile every problem listed here instead (--batch)
+    std::string program_output; // Program container (-o)
+    std::string raw_output;     // Raw 32-bit words (--emit-raw)
+    std::string compressed_output; // Loop-compressed container (--compress)
+    std::string image_output;   // Memory initialization image (--emit-image)
+    bool verify_compressed = false; // Check the compressed form against a fresh compile (--verify)
+    bool disassemble = false;   // Print the instruction table
+    std::string stats_format;   // Per-stage breakdown: "json" on stdout or "text" in the log (--stats=)
+    CompileOptions options;
 
-                     try {
-                         row.push_back(std::stoi(val_str));
-                     } catch (const std::invalid_argument& ia) {
-                         std::cerr << "Warning: Invalid integer format: '" << val_str << "' in line: " << line << std::endl;
-                     } catch (const std::out_of_range& oor) {
-                         std::cerr << "Warning: Integer out of range: '" << val_str << "' in line: " << line << std::endl;
-                     }
-                 }
-                 if (!row.empty()) {
-                    current_matrix.push_back(row);
-                 }
+    try {
+        for (int arg = 1; arg < argc; ++arg) {
+            if (parse_compile_option(argc, argv, arg, options)) continue;
+            if (std::string(argv[arg]) == "-o" && arg + 1 < argc) {
+                program_output = argv[++arg];
+                continue;
             }
-         }
-
-        if (!current_matrix.empty() || isEmptyMatrix) { // Accept empty matrix if parsed as such
-             if (matrix_name == "matrix_a") {
-                 matrix_a = current_matrix;
-                 found_a = true;
-             } else if (matrix_name == "matrix_b") {
-                 matrix_b = current_matrix;
-                 found_b = true;
-             }
+            if (std::string(argv[arg]) == "--emit-raw" && arg + 1 < argc) {
+                raw_output = argv[++arg];
+                continue;
+            }
+            if (std::string(argv[arg]) == "--compress" && arg + 1 < argc) {
+                compressed_output = argv[++arg];
+                continue;
+            }
+            if (std::string(argv[arg]) == "--emit-image" && arg + 1 < argc) {
+                image_output = argv[++arg];
+                continue;
+            }
+            if (std::string(argv[arg]) == "--verify") {
+                verify_compressed = true;
+                continue;
+            }
+            if (std::string(argv[arg]).compare(0, 8, "--stats=") == 0) {
+                stats_format = std::string(argv[arg]).substr(8);
+                if (stats_format != "json" && stats_format != "text") {
+                    throw std::runtime_error("--stats takes json or text, not " + stats_format);
+                }
+                continue;
+            }
+            if (std::string(argv[arg]) == "--disasm") {
+                disassemble = true;
+                continue;
+            }
+            if (std::string(argv[arg]) == "--batch" && arg + 1 < argc) {
+                batch_manifest = argv[++arg];
+                continue;
+            }
+            if (argv[arg][0] == '-' || inputs.size() == 2) {
+                throw std::runtime_error(std::string("Unexpected argument: ") + argv[arg]);
+            }
+            inputs.push_back(argv[arg]);
         }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        inputs.clear();
     }
-
-    if (!found_a || !found_b) {
-        throw std::runtime_error("Could not find valid definitions for both matrix_a and matrix_b in file.");
+    bool batch = !batch_manifest.empty();
+    if (batch && !inputs.empty()) {
+        std::cerr << "Error: --batch takes the place of the input files\n";
+        inputs.clear();
+        batch = false;
     }
-
-    return {matrix_a, matrix_b};
-}
-
-int main(int argc, char* argv[]) {
-    if (argc != 2) { // Only expect input file now
-        std::cerr << "Usage: " << argv[0] << " <input_cpp_file>\n";
+    if (batch && (!program_output.empty() || !compressed_output.empty())) {
+        std::cerr << "Error: a program container holds one problem; use --emit-raw with --batch\n";
+        batch = false;
+    }
+    if (batch && options.autotune) {
+        std::cerr << "Error: --tune picks a configuration per shape; it cannot tune a batch\n";
+        batch = false;
+    }
+    if (options.lut_values > 0 && (!program_output.empty() || !compressed_output.empty())) {
+        // A container's header rebuilds the memory plan from the shape, but the tables depend on B
+        std::cerr << "Error: a LUT program's memory plan depends on B's values; use --emit-raw and --emit-image\n";
+        inputs.clear();
+        batch = false;
+    }
+    if (verify_compressed && compressed_output.empty()) {
+        std::cerr << "Error: --verify checks the output of --compress\n";
+        inputs.clear();
+        batch = false;
+    }
+    if ((batch || !inputs.empty()) && disassemble && raw_output == "-") {
+        std::cerr << "Error: --disasm and --emit-raw - both write to stdout\n";
+        inputs.clear();
+        batch = false;
+    }
+    if ((batch || !inputs.empty()) && stats_format == "json" && (disassemble || raw_output == "-")) {
+        std::cerr << "Error: --stats=json writes to stdout; it cannot be combined with --disasm or --emit-raw -\n";
+        inputs.clear();
+        batch = false;
+    }
+    if (inputs.empty() && !batch) {
+        std::cerr << "Usage: " << argv[0] << " <input_cpp_file | a.npy b.npy | a.mtx b.mtx | --batch FILE> [-o FILE] [--compress FILE [--verify]] [--emit-raw FILE|-] [--emit-image FILE] [--disasm] [--stats=json|text] [options]\n"
+                  << "  --batch FILE    Compile every problem listed in FILE (one input per line) into one program\n"
+                  << "  -o FILE         Write the packed program container\n"
+                  << "  --compress FILE Write the loop-compressed program container (.pimz)\n"
+                  << "  --verify        Recompile and check the compressed program expands to the same words\n"
+                  << "  --emit-raw FILE Write raw 32-bit words (- for stdout)\n"
+                  << "  --emit-image FILE  Write the initial memory contents (.pimi): A and B as placed and packed\n"
+                  << "  --disasm        Print the instruction table\n"
+                  << "  --stats=json    Print per-stage times and counts as JSON on stdout (the log moves to stderr)\n"
+                  << "  --stats=text    Add the same breakdown to the log\n"
+                  << compile_options_usage();
         return 1;
     }
-    std::string input_filename = argv[1];
 
-    try {
-        // Parse matrices from the input file
-        std::cout << "Parsing matrices from " << input_filename << "...\n";
-        auto [matrix_a, matrix_b] = parse_matrix_file(input_filename);
-        
-        // --- Print Parsed Matrices (Optional Debug) ---
-        std::cout << "Parsed Matrix A: " << matrix_a.size() << "x" << (matrix_a.empty() ? 0 : matrix_a[0].size()) << "\n";
-        std::cout << "Parsed Matrix B: " << matrix_b.size() << "x" << (matrix_b.empty() ? 0 : matrix_b[0].size()) << "\n\n";
-        // ---------------------------------------------
+    // The table can run to millions of rows; batch it into large writes
+    static char stdout_buffer[1 << 20];
+    if (disassemble) {
+        std::setvbuf(stdout, stdout_buffer, _IOFBF, sizeof(stdout_buffer));
+    }
 
-        // Create compiler and generate instructions
-        std::cout << "Compiling matrix multiplication...\n";
-        Compiler compiler;
-        std::vector<InstructionWord> instructions = compiler.compile_matrix_mult(matrix_a, matrix_b);
-        std::cout << "Generated " << instructions.size() << " instructions (19-bit format packed in uint32_t)\n\n";
+    // Status goes to stderr when the program or the stats are piped to stdout
+    std::ostream& log = (raw_output == "-" || stats_format == "json") ? std::cerr : std::cout;
 
-        // *** Print generated instructions in a new table format ***
-        const int idx_w = 5;
-        const int op_txt_w = 15;
-        const int core_ptr_w = 8;
-        const int rd_w = 3;
-        const int wr_w = 3;
-        const int row_addr_w = 10;
-        const int hex_w = 10; // For the final packed hex output
+    try {
+        // Parse matrices from the input file (or every file of the batch)
+        std::vector<std::pair<Matrix, Matrix>> problems;
+        std::vector<GemmShape> shapes;
+        auto parse_start = std::chrono::steady_clock::now();
+        if (batch) {
+            log << "Parsing batch " << batch_manifest << "...\n";
+            problems = read_batch_inputs(batch_manifest);
+            for (const auto& problem : problems) shapes.push_back(gemm_shape(problem.first, problem.second));
+            log << "Parsed " << problems.size() << " problems\n\n";
+        } else {
+            log << "Parsing matrices from " << inputs[0] << (inputs.size() > 1 ? " and " + inputs[1] : "") << "...\n";
+            problems.push_back(read_matrix_inputs(inputs));
 
-        // Print Header
-        std::cout << std::left
-                  << std::setw(idx_w) << "Idx" << " | "
-                  << std::setw(op_txt_w) << "Opcode" << " | "
-                  << std::right // Right align numeric fields
-                  << std::setw(core_ptr_w) << "CorePtr" << " | "
-                  << std::setw(rd_w) << "Rd" << " | "
-                  << std::setw(wr_w) << "Wr" << " | "
-                  << std::setw(row_addr_w) << "Row Addr" << " | "
-                  << std::setw(hex_w) << "PackedHex" << std::endl;
+            // --- Print Parsed Matrices (Optional Debug) ---
+            log << "Parsed Matrix A: " << problems[0].first.rows() << "x" << problems[0].first.cols() << "\n";
+            log << "Parsed Matrix B: " << problems[0].second.rows() << "x" << problems[0].second.cols() << "\n\n";
+            // ---------------------------------------------
+        }
+        double parse_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - parse_start).count();
 
-        // Print Separator Line
-        std::cout << std::string(idx_w, '-') << "-|-"
-                  << std::string(op_txt_w, '-') << "-|-"
-                  << std::string(core_ptr_w, '-') << "-|-"
-                  << std::string(rd_w, '-') << "-|-"
-                  << std::string(wr_w, '-') << "-|-"
-                  << std::string(row_addr_w, '-') << "-|-"
-                  << std::string(hex_w, '-') << std::endl;
+        if (options.autotune) {
+            // Before the sinks are created, since the container header records the options
+            TuningDatabase database(options.tuning_database);
+            TuneResult tuned = autotune(gemm_shape(problems[0].first, problems[0].second), options, &database);
+            log << "Autotune: " << tune_summary(tuned) << "\n\n";
+        }
 
-        // Print Instruction Rows
-        for (size_t i = 0; i < instructions.size(); ++i) {
-            InstructionWord packed_instr = instructions[i];
-            // Unpack the instruction for display
-            instr_format::UnpackedInstr unpacked = instr_format::unpack(packed_instr);
+        // Create compiler and stream instructions into the sink
+        log << "Compiling matrix multiplication...\n";
+        Compiler compiler(options);
+        TeeSink sink;
+        std::unique_ptr<ProgramFileSink> program_sink;
+        std::unique_ptr<FileSink> raw_sink;
+        CompressingSink compressing_sink;
+        if (!compressed_output.empty()) {
+            sink.add(compressing_sink);
+        }
+        if (!program_output.empty()) {
+            program_sink.reset(new ProgramFileSink(program_output, options, compiler.report()));
+            sink.add(*program_sink);
+        }
+        if (!raw_output.empty()) {
+            raw_sink.reset(new FileSink(raw_output));
+            sink.add(*raw_sink);
+        }
+        size_t listed = 0;
+        CallbackSink listing([&](const InstructionWord* words, size_t count) {
+            if (listed == 0) write_disassembly_header(stdout);
+            write_disassembly(stdout, words, count, listed);
+            listed += count;
+        });
+        if (disassemble) {
+            log.flush();
+            sink.add(listing);
+        }
+        size_t word_count = batch ? compiler.compile_batch(shapes, sink)
+                                  : compiler.compile_matrix_mult(problems[0].first, problems[0].second, sink);
+        if (listed > 0) {
+            write_disassembly_footer(stdout);
+            std::fputc('\n', stdout);
+        }
+        log << "Generated " << word_count << " instructions (19-bit format packed in uint32_t)"
+            << (compiler.report().specialized ? ", built-in program" : "") << "\n";
+        const OperandReuseStats& reuse = compiler.report().operand_reuse;
+        log << "Operand reuse: eliminated " << reuse.loads_eliminated << " of "
+                  << reuse.loads_before << " loads\n";
 
-            std::cout << std::left // Left align index and opcode text
-                      << std::setw(idx_w) << i << " | "
-                      << std::setw(op_txt_w) << instr_format::opcode_to_string(unpacked.opcode) << " | "
-                      << std::right << std::setfill(' ') // Right align numbers, space fill
-                      << std::setw(core_ptr_w) << unpacked.core_ptr << " | "
-                      << std::setw(rd_w) << (unpacked.rd ? "1" : "0") << " | "
-                      << std::setw(wr_w) << (unpacked.wr ? "1" : "0") << " | "
-                      << std::setw(row_addr_w) << unpacked.row_addr << " | "
-                      << std::hex << std::setfill('0') // Hex output, zero fill
-                      << std::setw(8) << packed_instr // Print the whole packed word as hex
-                      << std::dec << std::setfill(' ') // Reset to decimal and space fill
-                      << std::endl;
+        // Per-core instruction counts; the busiest lane bounds the critical path
+        const TilePlan& tiling = compiler.report().tiling;
+        const std::vector<size_t>& per_core = compiler.report().core_instructions;
+        size_t busiest = 0;
+        if (batch) {
+            size_t tiles = 0;
+            for (const auto& lane : tiling.lane_tiles) tiles += lane.size();
+            log << "Tiling: " << tiles << " tiles from " << problems.size() << " problems over "
+                << tiling.lanes << " lanes (" << 2 * tiling.lanes << " cores)\n";
+        } else {
+            log << "Tiling: " << tiling.tile_rows << "x" << tiling.tile_cols << " tiles over "
+                      << tiling.lanes << " lanes (" << 2 * tiling.lanes << " cores)\n";
+        }
+        if (uint32_t levels = compiler.report().strassen_levels) {
+            const MemoryPlan& top = compiler.report().memory;
+            size_t scale = size_t(1) << levels;
+            size_t leaves = 1;
+            for (uint32_t level = 0; level < levels; ++level) leaves *= 7;
+            log << "Strassen: " << levels << (levels == 1 ? " level, " : " levels, ") << leaves << " leaf products of "
+                << (top.rows_a() + scale - 1) / scale << "x" << (top.cols_a() + scale - 1) / scale << "x"
+                << (top.cols_b() + scale - 1) / scale << " (the tiling above places A, B and C)\n";
+        }
+        log << "Instructions per core:";
+        for (uint32_t core = 0; core < 2 * tiling.lanes; ++core) {
+            log << (core % 8 == 0 ? "\n  " : " ") << std::setw(8) << per_core[core];
+            if (core % 2 == 1) {
+                busiest = std::max(busiest, per_core[core - 1] + per_core[core]);
+            }
         }
+        double average = static_cast<double>(word_count) / tiling.lanes;
+        log << "\nLane imbalance (max/avg): " << std::fixed << std::setprecision(2)
+                  << (average > 0 ? busiest / average : 0.0) << "\n";
 
-         // Print Footer Separator Line
-        std::cout << std::string(idx_w, '-') << "-|-"
-                  << std::string(op_txt_w, '-') << "-|-"
-                  << std::string(core_ptr_w, '-') << "-|-"
-                  << std::string(rd_w, '-') << "-|-"
-                  << std::string(wr_w, '-') << "-|-"
-                  << std::string(row_addr_w, '-') << "-|-"
-                  << std::string(hex_w, '-') << std::endl;
+        // Memory plan: where each operand landed
+        auto mode_name = [](PlacementMode mode) {
+            return mode == PlacementMode::REPLICATED ? "per-lane copies"
+                   : mode == PlacementMode::SPREAD ? "one bank per block" : "packed";
+        };
+        if (batch) {
+            // Offset table: memory region, place in the concatenated C output and
+            // instruction span of every problem
+            log << "Batch table:\n"
+                << "  problem       shape  tiles        memory rows   C offset        instruction span  placement\n";
+            for (size_t p = 0; p < compiler.report().batch.size(); ++p) {
+                const BatchEntry& entry = compiler.report().batch[p];
+                std::string shape = std::to_string(entry.shape.rows_a) + "x" + std::to_string(entry.shape.cols_a) +
+                                    "x" + std::to_string(entry.shape.cols_b);
+                std::string rows = "[" + std::to_string(entry.memory.base_row()) + ", " +
+                                   std::to_string(entry.memory.rows_used()) + ")";
+                std::string span = "[" + std::to_string(entry.first_word) + ", " +
+                                   std::to_string(entry.end_word) + ")";
+                log << "  " << std::setw(7) << p << " " << std::setw(11) << shape << " " << std::setw(6)
+                    << entry.tiles << " " << std::setw(18) << rows << " " << std::setw(10) << entry.c_offset
+                    << " " << std::setw(23) << span << "  " << mode_name(entry.memory.mode()) << "\n";
+            }
+        }
+        const MemoryPlan& memory_plan = batch ? compiler.report().batch.back().memory : compiler.report().memory;
+        if (!batch) {
+            log << "Memory plan (" << memory_plan.geometry().num_banks << " banks x "
+                << memory_plan.geometry().rows_per_bank << " rows, " << mode_name(memory_plan.mode());
+            if (memory_plan.elements_per_row() > 1) {
+                log << ", " << memory_plan.elements_per_row() << " " << element_type_name(memory_plan.element_type())
+                    << " per row";
+            }
+            log << "):";
+            for (const auto& region : memory_plan.usage()) {
+                log << " " << region.name << "=" << region.rows << " rows/" << region.banks << " banks";
+            }
+        } else {
+            log << "Memory used: " << memory_plan.rows_used() << " of " << memory_plan.geometry().total_rows()
+                << " rows (" << memory_plan.geometry().num_banks << " banks x "
+                << memory_plan.geometry().rows_per_bank << " rows)";
+        }
+        log << "\nBank selects inserted: " << compiler.report().bank_selects << "\n";
+        if (options.schedule) {
+            const ScheduleStats& schedule = compiler.report().schedule;
+            log << "Schedule: " << schedule.windows << " windows, slowest lane estimated at "
+                << schedule.cycles_before << " -> " << schedule.cycles_after << " cycles\n";
+        }
+        if (options.sparse_density > 0) {
+            size_t tiles = 0;
+            for (const auto& lane : tiling.lane_tiles) tiles += lane.size();
+            log << "Sparse lowering: " << compiler.report().sparse_tiles << " of " << tiles << " tiles\n";
+        }
+        if (options.lut_values > 0) {
+            size_t tiles = 0;
+            for (const auto& lane : tiling.lane_tiles) tiles += lane.size();
+            log << "LUT lowering: " << compiler.report().lut_tiles << " of " << tiles << " tiles ("
+                << compiler.report().lut_table_rows << " table rows)\n";
+        }
+        if (stats_format == "text") {
+            write_stats_text(log, compiler.report(), parse_seconds);
+        }
+        if (!program_output.empty()) {
+            uint64_t payload = (static_cast<uint64_t>(word_count) * instr_format::INSTRUCTION_BITS + 7) / 8;
+            log << "Wrote " << program_output << " ("
+                << PROGRAM_HEADER_BYTES + payload + PROGRAM_PADDING_BYTES << " bytes)\n";
+        }
+        if (!image_output.empty()) {
+            MemoryImage image(options.memory);
+            for (size_t p = 0; p < problems.size(); ++p) {
+                image.add(batch ? compiler.report().batch[p].memory : compiler.report().memory,
+                          problems[p].first, problems[p].second);
+            }
+            image.write(image_output);
+            log << "Wrote " << image_output << " (" << image.row_count() << " rows in " << image.segments().size()
+                << " segments, " << image.file_bytes() << " bytes)\n";
+        }
+        if (!compressed_output.empty()) {
+            const CompressedProgram& compressed = compressing_sink.program();
+            ProgramHeader header = make_program_header(options, compiler.report());
+            header.word_count = compressed.size();
+            header.checksum = compressing_sink.checksum();
+            write_compressed_program(compressed_output, header, compressed);
+            uint64_t payload = (static_cast<uint64_t>(word_count) * instr_format::INSTRUCTION_BITS + 7) / 8;
+            log << "Wrote " << compressed_output << " (" << compressed.runs().size() << " runs in "
+                << compressed.blocks().size() << " blocks, "
+                << compressed.file_bytes() << " bytes; packed payload "
+                << payload << " bytes)\n";
 
+            if (verify_compressed) {
+                // The compiler is deterministic, so a second compile reproduces the unrolled stream
+                Compiler reference(options);
+                CompressedProgramVerifier verifier(compressed);
+                reference.compile_matrix_mult(problems[0].first, problems[0].second, verifier);
+                if (!verifier.matches()) {
+                    throw std::runtime_error("Compressed program differs from the unrolled stream at word " +
+                                             std::to_string(verifier.mismatch()) + ".");
+                }
+                log << "Verified: compressed program expands to the " << verifier.compared()
+                    << " unrolled words\n";
+            }
+        }
+        if (stats_format == "json") {
+            write_stats_json(std::cout, compiler.report(), parse_seconds);
+        }
         return 0;
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << "\n";
@@ -0,0 +1,60 @@
+#include "mapped_file.hpp"
+#include <cstdio>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define PIM_HAVE_MMAP 1
+#endif
+
+namespace pim {
+
+MappedFile::MappedFile(const std::string& path) {
+#ifdef PIM_HAVE_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Could not open file: " + path);
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Could not stat file: " + path);
+    }
+    length_ = static_cast<size_t>(info.st_size);
+    if (length_ > 0) {
+        void* mapping = ::mmap(nullptr, length_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            data_ = static_cast<const unsigned char*>(mapping);
+            mapped_ = true;
+        }
+    }
+    ::close(fd);
+#endif
+    if (!mapped_) {
+        std::FILE* file = std::fopen(path.c_str(), "rb");
+        if (!file) {
+            throw std::runtime_error("Could not open file: " + path);
+        }
+        unsigned char block[1 << 16];
+        size_t got;
+        while ((got = std::fread(block, 1, sizeof(block), file)) > 0) {
+            copy_.insert(copy_.end(), block, block + got);
+        }
+        std::fclose(file);
+        data_ = copy_.data();
+        length_ = copy_.size();
+    }
+}
+
+MappedFile::~MappedFile() {
+#ifdef PIM_HAVE_MMAP
+    if (mapped_) {
+        ::munmap(const_cast<unsigned char*>(data_), length_);
+    }
+#endif
+}
+
+} // namespace pim
@@ -0,0 +1,408 @@
+#include "matrix_io.hpp"
+#include "mapped_file.hpp"
+#include "sparse.hpp"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+
+namespace pim {
+
+Matrix::Matrix(size_t rows, size_t cols, std::vector<int32_t> elements) : rows_(rows), cols_(cols) {
+    if (elements.size() != rows * cols) {
+        throw std::runtime_error("Matrix needs " + std::to_string(rows * cols) + " elements, got " +
+                                 std::to_string(elements.size()) + ".");
+    }
+    auto buffer = std::make_shared<std::vector<int32_t>>(std::move(elements));
+    data_ = buffer->data();
+    owner_ = buffer;
+}
+
+Matrix Matrix::from_rows(const std::vector<std::vector<int>>& rows) {
+    size_t cols = rows.empty() ? 0 : rows[0].size();
+    std::vector<int32_t> elements;
+    elements.reserve(rows.size() * cols);
+    for (const auto& row : rows) {
+        if (row.size() != cols) throw std::runtime_error("Matrix rows must all have the same length.");
+        elements.insert(elements.end(), row.begin(), row.end());
+    }
+    return Matrix(rows.size(), cols, std::move(elements));
+}
+
+bool Matrix::operator==(const Matrix& other) const {
+    return rows_ == other.rows_ && cols_ == other.cols_ &&
+           (data_ == other.data_ || std::equal(data_, data_ + rows_ * cols_, other.data_));
+}
+
+namespace {
+
+// Single forward pass over a C++ source buffer looking for the matrix literals
+class SourceScanner {
+public:
+    SourceScanner(const char* begin, const char* end, const std::string& filename)
+        : begin_(begin), p_(begin), end_(end), filename_(filename) {}
+
+    // Advances to the next identifier outside comments and string literals;
+    // returns false at the end of the buffer
+    bool next_identifier(const char*& ident_begin, const char*& ident_end) {
+        while (p_ != end_) {
+            char c = *p_;
+            if (c == '/' && skip_comment()) continue;
+            if (c == '"' || c == '\'') {
+                skip_literal(c);
+                continue;
+            }
+            if (is_ident_start(c)) {
+                ident_begin = p_;
+                while (p_ != end_ && is_ident_char(*p_)) ++p_;
+                ident_end = p_;
+                return true;
+            }
+            ++p_;
+        }
+        return false;
+    }
+
+    void skip_space() {
+        while (p_ != end_) {
+            char c = *p_;
+            if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+                ++p_;
+            } else if (c != '/' || !skip_comment()) {
+                return;
+            }
+        }
+    }
+
+    bool accept(char c) {
+        skip_space();
+        if (p_ != end_ && *p_ == c) {
+            ++p_;
+            return true;
+        }
+        return false;
+    }
+
+    void expect(char c) {
+        if (!accept(c)) fail(std::string("expected '") + c + "'");
+    }
+
+    // True if the next character (after whitespace) is c; does not consume it
+    bool peek(char c) {
+        skip_space();
+        return p_ != end_ && *p_ == c;
+    }
+
+    // Parses a brace-enclosed list of equally long brace-enclosed rows.
+    // Elements go straight into one row-major buffer.
+    Matrix parse_matrix(const std::string& name) {
+        std::vector<int32_t> elements;
+        size_t rows = 0;
+        size_t cols = 0;
+        expect('{');
+        while (!accept('}')) {
+            if (rows > 0) {
+                expect(',');
+                if (accept('}')) break; // Trailing comma
+            }
+            expect('{');
+            size_t row_length = 0;
+            while (!accept('}')) {
+                if (row_length > 0) {
+                    expect(',');
+                    if (accept('}')) break;
+                }
+                elements.push_back(parse_int());
+                ++row_length;
+            }
+            if (rows == 0) {
+                cols = row_length;
+            } else if (row_length != cols) {
+                fail(name + " rows must all have the same length");
+            }
+            ++rows;
+        }
+        if (cols == 0) rows = 0; // {{}} is empty too
+        return Matrix(rows, cols, std::move(elements));
+    }
+
+private:
+    static bool is_ident_start(char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+    }
+    static bool is_ident_char(char c) { return is_ident_start(c) || (c >= '0' && c <= '9'); }
+
+    // Skips a comment starting at p_; false if p_ does not start one
+    bool skip_comment() {
+        if (end_ - p_ < 2) return false;
+        if (p_[1] == '/') {
+            const char* newline = static_cast<const char*>(std::memchr(p_, '\n', end_ - p_));
+            p_ = newline ? newline + 1 : end_;
+            return true;
+        }
+        if (p_[1] == '*') {
+            for (const char* q = p_ + 2; q + 1 < end_; ++q) {
+                if (q[0] == '*' && q[1] == '/') {
+                    p_ = q + 2;
+                    return true;
+                }
+            }
+            p_ = end_;
+            return true;
+        }
+        return false;
+    }
+
+    void skip_literal(char quote) {
+        for (++p_; p_ != end_ && *p_ != quote && *p_ != '\n'; ++p_) {
+            if (*p_ == '\\' && p_ + 1 != end_) ++p_;
+        }
+        if (p_ != end_) ++p_;
+    }
+
+    int32_t parse_int() {
+        skip_space();
+        if (p_ != end_ && *p_ == '+') ++p_;
+        int32_t value = 0;
+        std::from_chars_result result = std::from_chars(p_, end_, value);
+        if (result.ec == std::errc::result_out_of_range) fail("integer out of range");
+        if (result.ec != std::errc()) fail("expected an integer");
+        p_ = result.ptr;
+        return value;
+    }
+
+    [[noreturn]] void fail(const std::string& what) const {
+        size_t line = 1 + std::count(begin_, p_, '\n');
+        throw std::runtime_error(filename_ + ":" + std::to_string(line) + ": " + what + ".");
+    }
+
+    const char* begin_;
+    const char* p_;
+    const char* end_;
+    const std::string& filename_;
+};
+
+bool host_is_little_endian() {
+    const uint16_t probe = 1;
+    unsigned char first;
+    std::memcpy(&first, &probe, 1);
+    return first == 1;
+}
+
+// Value of key in a .npy header dict, e.g. "'<i4'" for 'descr'
+std::string npy_field(const std::string& header, const std::string& key, const std::string& filename) {
+    size_t at = header.find("'" + key + "'");
+    if (at == std::string::npos) throw std::runtime_error(filename + ": .npy header has no '" + key + "'.");
+    size_t begin = header.find_first_not_of(' ', header.find(':', at) + 1);
+    size_t end = std::string::npos;
+    if (begin != std::string::npos) {
+        end = (header[begin] == '(') ? header.find(')', begin) : header.find_first_of(",}", begin);
+    }
+    if (end == std::string::npos) throw std::runtime_error(filename + ": malformed .npy header.");
+    return header.substr(begin, end - begin + (header[begin] == '(' ? 1 : 0));
+}
+
+} // namespace
+
+std::pair<Matrix, Matrix> parse_matrix_file(const std::string& filename) {
+    MappedFile file(filename);
+    const char* begin = reinterpret_cast<const char*>(file.data());
+    SourceScanner scanner(begin, begin + file.size(), filename);
+
+    Matrix matrix_a, matrix_b;
+    bool found_a = false, found_b = false;
+    const char* ident_begin;
+    const char* ident_end;
+    while (scanner.next_identifier(ident_begin, ident_end)) {
+        std::string_view ident(ident_begin, ident_end - ident_begin);
+        if (ident != "matrix_a" && ident != "matrix_b") continue;
+
+        // Declaration: name [=] { ... }; any other use of the name is ignored
+        scanner.accept('=');
+        if (!scanner.peek('{')) continue;
+        if (ident == "matrix_a") {
+            matrix_a = scanner.parse_matrix("Matrix A");
+            found_a = true;
+        } else {
+            matrix_b = scanner.parse_matrix("Matrix B");
+            found_b = true;
+        }
+    }
+
+    if (!found_a || !found_b) {
+        throw std::runtime_error("Could not find valid definitions for both matrix_a and matrix_b in file.");
+    }
+    return {matrix_a, matrix_b};
+}
+
+Matrix read_npy(const std::string& filename) {
+    auto file = std::make_shared<MappedFile>(filename);
+    const unsigned char* data = file->data();
+    static const unsigned char magic[6] = {0x93, 'N', 'U', 'M', 'P', 'Y'};
+    if (file->size() < 10 || std::memcmp(data, magic, sizeof(magic)) != 0) {
+        throw std::runtime_error(filename + ": not a .npy file.");
+    }
+
+    // Version 1.x has a 16-bit header length, 2.x and 3.x a 32-bit one
+    uint8_t major = data[6];
+    size_t header_offset = (major == 1) ? 10 : 12;
+    if (major < 1 || major > 3 || file->size() < header_offset) {
+        throw std::runtime_error(filename + ": unsupported .npy version " + std::to_string(major) + ".");
+    }
+    size_t header_length = data[8] | (static_cast<size_t>(data[9]) << 8);
+    if (major > 1) {
+        header_length |= (static_cast<size_t>(data[10]) << 16) | (static_cast<size_t>(data[11]) << 24);
+    }
+    size_t data_offset = header_offset + header_length;
+    if (file->size() < data_offset) {
+        throw std::runtime_error(filename + ": truncated .npy header.");
+    }
+    std::string header(reinterpret_cast<const char*>(data) + header_offset, header_length);
+
+    std::string descr = npy_field(header, "descr", filename);
+    bool fortran_order = npy_field(header, "fortran_order", filename) == "True";
+    std::string shape = npy_field(header, "shape", filename);
+    unsigned long long dims[2] = {0, 0};
+    char tail = 0;
+    if (std::sscanf(shape.c_str(), "(%llu, %llu%c", &dims[0], &dims[1], &tail) != 3 || tail != ')') {
+        throw std::runtime_error(filename + ": expected a 2-D array, got shape " + shape + ".");
+    }
+
+    size_t item_size;
+    if (descr == "'<i4'") {
+        item_size = 4;
+    } else if (descr == "'<i2'") {
+        item_size = 2;
+    } else if (descr == "'|i1'" || descr == "'<i1'") {
+        item_size = 1;
+    } else {
+        throw std::runtime_error(filename + ": unsupported dtype " + descr + " (expected int32, int16 or int8).");
+    }
+    size_t rows = static_cast<size_t>(dims[0]);
+    size_t cols = static_cast<size_t>(dims[1]);
+    size_t count = rows * cols;
+    if ((file->size() - data_offset) / item_size < count) {
+        throw std::runtime_error(filename + ": truncated .npy data.");
+    }
+    const unsigned char* elements = data + data_offset;
+
+    // Zero copy: C-ordered int32 in host byte order, suitably aligned
+    if (item_size == 4 && !fortran_order && host_is_little_endian() &&
+        reinterpret_cast<uintptr_t>(elements) % alignof(int32_t) == 0) {
+        Matrix matrix;
+        matrix.rows_ = rows;
+        matrix.cols_ = cols;
+        matrix.data_ = reinterpret_cast<const int32_t*>(elements);
+        matrix.owner_ = file;
+        return matrix;
+    }
+
+    std::vector<int32_t> converted(count);
+    for (size_t n = 0; n < count; ++n) {
+        const unsigned char* e = elements + n * item_size;
+        int32_t value;
+        if (item_size == 4) {
+            value = static_cast<int32_t>(e[0] | (static_cast<uint32_t>(e[1]) << 8) |
+                                         (static_cast<uint32_t>(e[2]) << 16) | (static_cast<uint32_t>(e[3]) << 24));
+        } else if (item_size == 2) {
+            value = static_cast<int16_t>(e[0] | (e[1] << 8));
+        } else {
+            value = static_cast<int8_t>(e[0]);
+        }
+        // Fortran order stores column after column
+        size_t target = fortran_order ? (n % rows) * cols + n / rows : n;
+        converted[target] = value;
+    }
+    return Matrix(rows, cols, std::move(converted));
+}
+
+void write_npy(const std::string& filename, const Matrix& matrix) {
+    std::string header = "{'descr': '<i4', 'fortran_order': False, 'shape': (" +
+                         std::to_string(matrix.rows()) + ", " + std::to_string(matrix.cols()) + "), }";
+    // Pad with spaces so the data starts on a 64-byte boundary; the header ends in '\n'
+    size_t total = 10 + header.size() + 1;
+    header.append((64 - total % 64) % 64, ' ');
+    header.push_back('\n');
+
+    std::FILE* file = std::fopen(filename.c_str(), "wb");
+    if (!file) {
+        throw std::runtime_error("Could not open output file: " + filename);
+    }
+    unsigned char preamble[10] = {0x93, 'N', 'U', 'M', 'P', 'Y', 1, 0,
+                                  static_cast<unsigned char>(header.size()),
+                                  static_cast<unsigned char>(header.size() >> 8)};
+    bool ok = std::fwrite(preamble, 1, sizeof(preamble), file) == sizeof(preamble) &&
+              std::fwrite(header.data(), 1, header.size(), file) == header.size();
+
+    unsigned char bytes[1 << 14];
+    size_t count = matrix.rows() * matrix.cols();
+    for (size_t base = 0; ok && base < count; base += sizeof(bytes) / 4) {
+        size_t batch = std::min(count - base, sizeof(bytes) / 4);
+        for (size_t n = 0; n < batch; ++n) {
+            uint32_t value = static_cast<uint32_t>(matrix.data()[base + n]);
+            for (int b = 0; b < 4; ++b) bytes[4 * n + b] = static_cast<unsigned char>(value >> (8 * b));
+        }
+        ok = std::fwrite(bytes, 4, batch, file) == batch;
+    }
+    if (std::fclose(file) != 0 || !ok) {
+        throw std::runtime_error("Failed to write " + filename + ".");
+    }
+}
+
+std::pair<Matrix, Matrix> read_matrix_inputs(const std::vector<std::string>& paths) {
+    auto has_extension = [](const std::string& path, const char* extension) {
+        return path.size() >= 4 && path.compare(path.size() - 4, 4, extension) == 0;
+    };
+    auto is_npy = [&](const std::string& path) { return has_extension(path, ".npy"); };
+    auto is_mtx = [&](const std::string& path) { return has_extension(path, ".mtx"); };
+    if (paths.size() == 1 && !is_npy(paths[0]) && !is_mtx(paths[0])) {
+        return parse_matrix_file(paths[0]);
+    }
+    if (paths.size() == 2 && is_npy(paths[0]) && is_npy(paths[1])) {
+        return {read_npy(paths[0]), read_npy(paths[1])};
+    }
+    if (paths.size() == 2 && is_mtx(paths[0]) && is_mtx(paths[1])) {
+        return {to_dense(read_matrix_market(paths[0])), to_dense(read_matrix_market(paths[1]))};
+    }
+    throw std::runtime_error("Expected one C++ input file, or two .npy or two .mtx files (A and B).");
+}
+
+std::vector<std::pair<Matrix, Matrix>> read_batch_inputs(const std::string& manifest) {
+    MappedFile file(manifest);
+    const char* p = reinterpret_cast<const char*>(file.data());
+    const char* end = p + file.size();
+    size_t slash = manifest.find_last_of('/');
+    std::string directory = (slash == std::string::npos) ? "" : manifest.substr(0, slash + 1);
+
+    std::vector<std::pair<Matrix, Matrix>> problems;
+    for (size_t line = 1; p < end; ++line) {
+        const char* newline = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        const char* line_end = newline ? newline : end;
+        std::vector<std::string> paths;
+        while (p < line_end && *p != '#') {
+            const char* word = p;
+            while (p < line_end && !std::isspace(static_cast<unsigned char>(*p)) && *p != '#') ++p;
+            if (p > word) {
+                std::string path(word, p);
+                paths.push_back(path[0] == '/' ? path : directory + path);
+            }
+            while (p < line_end && std::isspace(static_cast<unsigned char>(*p))) ++p;
+        }
+        p = newline ? newline + 1 : end;
+        if (paths.empty()) continue;
+        try {
+            problems.push_back(read_matrix_inputs(paths));
+        } catch (const std::exception& e) {
+            throw std::runtime_error(manifest + ":" + std::to_string(line) + ": " + e.what());
+        }
+    }
+    if (problems.empty()) {
+        throw std::runtime_error(manifest + ": no problems listed.");
+    }
+    return problems;
+}
+
+} // namespace pim
@@ -0,0 +1,175 @@
+#include "memory_image.hpp"
+#include "mapped_file.hpp"
+#include "program_file.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+namespace pim {
+
+namespace {
+
+constexpr size_t SEGMENT_HEADER_BYTES = 16;
+
+void check_elements(const Matrix& matrix, char name, ElementType type) {
+    if (type == ElementType::INT32) return;
+    for (size_t i = 0; i < matrix.rows(); ++i) {
+        for (size_t j = 0; j < matrix.cols(); ++j) {
+            if (!element_fits(type, matrix(i, j))) {
+                throw std::runtime_error(std::string(1, name) + "[" + std::to_string(i) + "][" + std::to_string(j) +
+                                         "] = " + std::to_string(matrix(i, j)) + " does not fit in " +
+                                         element_type_name(type) + ".");
+            }
+        }
+    }
+}
+
+// Packs the cols_a values element(k) of one A row or B column into k_rows rows at out
+template <typename Element>
+void pack_operand(const MemoryPlan& plan, Element element, int32_t* out) {
+    uint32_t bits = element_bits(plan.element_type());
+    uint32_t mask = bits == 32 ? ~0u : (1u << bits) - 1;
+    size_t per_row = plan.elements_per_row();
+    for (size_t r = 0; r < plan.k_rows(); ++r) {
+        uint32_t row = 0;
+        for (size_t t = 0; t < per_row && r * per_row + t < plan.cols_a(); ++t) {
+            row |= (static_cast<uint32_t>(element(r * per_row + t)) & mask) << (t * bits);
+        }
+        out[r] = static_cast<int32_t>(row);
+    }
+}
+
+} // namespace
+
+std::vector<int32_t>& MemoryImage::segment_at(uint64_t first_row) {
+    if (segments_.empty() || segments_.back().first_row + segments_.back().rows.size() != first_row) {
+        segments_.push_back(Segment{first_row, {}});
+    }
+    return segments_.back().rows;
+}
+
+void MemoryImage::add(const MemoryPlan& memory_plan, const Matrix& matrix_a, const Matrix& matrix_b) {
+    if (matrix_a.rows() != memory_plan.rows_a() || matrix_a.cols() != memory_plan.cols_a() ||
+        matrix_b.rows() != memory_plan.cols_a() || matrix_b.cols() != memory_plan.cols_b()) {
+        throw std::runtime_error("Matrices do not match the shape of the memory plan.");
+    }
+    check_elements(matrix_a, 'A', memory_plan.element_type());
+    check_elements(matrix_b, 'B', memory_plan.element_type());
+
+    // Every copy the planner placed: A row blocks row-major, B column blocks column-major
+    size_t k_rows = memory_plan.k_rows();
+    for (const MemoryPlan::BlockCopy& copy : memory_plan.a_copies()) {
+        size_t row_begin = copy.block * memory_plan.tile_rows();
+        size_t rows = std::min(memory_plan.tile_rows(), memory_plan.rows_a() - row_begin);
+        std::vector<int32_t>& out = segment_at(copy.base);
+        size_t used = out.size();
+        out.resize(used + rows * k_rows);
+        for (size_t i = 0; i < rows; ++i) {
+            const int32_t* row = matrix_a.row(row_begin + i);
+            pack_operand(memory_plan, [&](size_t k) { return row[k]; }, out.data() + used + i * k_rows);
+        }
+    }
+    for (const MemoryPlan::BlockCopy& copy : memory_plan.b_copies()) {
+        size_t col_begin = copy.block * memory_plan.tile_cols();
+        size_t cols = std::min(memory_plan.tile_cols(), memory_plan.cols_b() - col_begin);
+        std::vector<int32_t>& out = segment_at(copy.base);
+        size_t used = out.size();
+        out.resize(used + cols * k_rows);
+        for (size_t j = 0; j < cols; ++j) {
+            pack_operand(memory_plan, [&](size_t k) { return matrix_b(k, col_begin + j); },
+                         out.data() + used + j * k_rows);
+        }
+    }
+    for (const MemoryPlan::ConstantRow& constant : memory_plan.constants()) {
+        segment_at(constant.row).push_back(constant.value);
+    }
+}
+
+uint64_t MemoryImage::row_count() const {
+    uint64_t rows = 0;
+    for (const Segment& segment : segments_) rows += segment.rows.size();
+    return rows;
+}
+
+uint64_t MemoryImage::file_bytes() const {
+    return MEMORY_IMAGE_HEADER_BYTES + segments_.size() * SEGMENT_HEADER_BYTES + row_count() * 4;
+}
+
+void MemoryImage::write(const std::string& path) const {
+    std::vector<unsigned char> bytes(static_cast<size_t>(file_bytes()));
+    unsigned char* p = bytes.data();
+    std::memcpy(p, MEMORY_IMAGE_MAGIC, 4);
+    put_u32(p + 4, MEMORY_IMAGE_FORMAT_VERSION);
+    put_u32(p + 8, geometry_.rows_per_bank);
+    put_u32(p + 12, geometry_.num_banks);
+    put_u64(p + 16, segments_.size());
+    put_u64(p + 24, row_count());
+    p += MEMORY_IMAGE_HEADER_BYTES;
+    for (const Segment& segment : segments_) {
+        put_u64(p, segment.first_row);
+        put_u64(p + 8, segment.rows.size());
+        p += SEGMENT_HEADER_BYTES;
+        for (int32_t row : segment.rows) {
+            put_u32(p, static_cast<uint32_t>(row));
+            p += 4;
+        }
+    }
+
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        throw std::runtime_error("Could not open output file: " + path);
+    }
+    bool ok = std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+    if (std::fclose(file) != 0 || !ok) {
+        throw std::runtime_error("Failed to write " + path + ".");
+    }
+}
+
+MemoryImage MemoryImage::read(const std::string& path) {
+    MappedFile file(path);
+    const unsigned char* p = file.data();
+    if (file.size() < MEMORY_IMAGE_HEADER_BYTES || std::memcmp(p, MEMORY_IMAGE_MAGIC, 4) != 0) {
+        throw std::runtime_error("Not a PIM memory image: " + path);
+    }
+    uint32_t version = get_u32(p + 4);
+    if (version != MEMORY_IMAGE_FORMAT_VERSION) {
+        throw std::runtime_error("Unsupported PIM memory image version " + std::to_string(version) + ".");
+    }
+    MemoryGeometry geometry;
+    geometry.rows_per_bank = get_u32(p + 8);
+    geometry.num_banks = get_u32(p + 12);
+    geometry.validate();
+    MemoryImage image(geometry);
+    uint64_t segment_count = get_u64(p + 16);
+    uint64_t row_count = get_u64(p + 24);
+    uint64_t available = file.size() - MEMORY_IMAGE_HEADER_BYTES;
+    if (segment_count > available / SEGMENT_HEADER_BYTES ||
+        row_count > (available - segment_count * SEGMENT_HEADER_BYTES) / 4) {
+        throw std::runtime_error("PIM memory image is truncated: " + path);
+    }
+    p += MEMORY_IMAGE_HEADER_BYTES;
+
+    uint64_t rows_left = row_count;
+    image.segments_.resize(static_cast<size_t>(segment_count));
+    for (Segment& segment : image.segments_) {
+        segment.first_row = get_u64(p);
+        uint64_t rows = get_u64(p + 8);
+        p += SEGMENT_HEADER_BYTES;
+        if (rows > rows_left || segment.first_row > geometry.total_rows() - rows) {
+            throw std::runtime_error("PIM memory image has a segment outside its memory: " + path);
+        }
+        rows_left -= rows;
+        segment.rows.resize(static_cast<size_t>(rows));
+        for (int32_t& row : segment.rows) {
+            row = static_cast<int32_t>(get_u32(p));
+            p += 4;
+        }
+    }
+    if (rows_left != 0) {
+        throw std::runtime_error("PIM memory image row count does not match its segments: " + path);
+    }
+    return image;
+}
+
+} // namespace pim
@@ -0,0 +1,252 @@
+#include "memory_plan.hpp"
+#include <algorithm>
+#include <set>
+#include <stdexcept>
+
+namespace pim {
+
+void MemoryGeometry::validate() const {
+    if (rows_per_bank == 0 || rows_per_bank > instr_format::ROW_ADDR_MASK + 1) {
+        throw std::runtime_error("Rows per bank must be between 1 and " +
+                                 std::to_string(instr_format::ROW_ADDR_MASK + 1) + ".");
+    }
+    if (num_banks == 0 || num_banks > MAX_BANKS) {
+        throw std::runtime_error("Bank count must be between 1 and " + std::to_string(MAX_BANKS) + ".");
+    }
+}
+
+MemoryPlan MemoryPlan::build(const MemoryGeometry& geometry,
+                             size_t rows_a, size_t cols_a, size_t cols_b,
+                             const TilePlan& tiling, uint64_t base_row, PlacementMode best,
+                             ElementType element_type)
+{
+    geometry.validate();
+
+    MemoryPlan plan;
+    plan.geometry_ = geometry;
+    plan.rows_a_ = rows_a;
+    plan.cols_a_ = cols_a;
+    plan.cols_b_ = cols_b;
+    plan.element_type_ = element_type;
+    plan.k_rows_ = (cols_a + plan.elements_per_row() - 1) / plan.elements_per_row();
+    plan.tile_rows_ = tiling.tile_rows;
+    plan.tile_cols_ = tiling.tile_cols;
+    plan.base_row_ = base_row;
+
+    size_t grid_rows = (rows_a + plan.tile_rows_ - 1) / plan.tile_rows_;
+    plan.grid_cols_ = (cols_b + plan.tile_cols_ - 1) / plan.tile_cols_;
+
+    // A block, B block or C tile, placed contiguously with the rest of its group
+    struct Item {
+        char operand;  // 'A', 'B' or 'C'
+        size_t index;  // Block index (A, B) or tile index (C)
+        uint32_t lane; // Owning lane when replicated
+        uint64_t rows;
+    };
+    using Group = std::vector<Item>;
+
+    auto a_item = [&](size_t block, uint32_t lane) {
+        return Item{'A', block, lane, static_cast<uint64_t>(plan.a_block_rows(block)) * plan.k_rows_};
+    };
+    auto b_item = [&](size_t block, uint32_t lane) {
+        return Item{'B', block, lane, static_cast<uint64_t>(plan.b_block_cols(block)) * plan.k_rows_};
+    };
+    auto c_item = [&](size_t block_row, size_t block_col, uint32_t lane) {
+        return Item{'C', block_row * plan.grid_cols_ + block_col, lane,
+                    static_cast<uint64_t>(plan.a_block_rows(block_row)) * plan.b_block_cols(block_col)};
+    };
+
+    // --- Shared layout: each A block with its row of C tiles, then each B block ---
+    std::vector<Group> shared_groups;
+    for (size_t r = 0; r < grid_rows; ++r) {
+        Group group{a_item(r, 0)};
+        for (size_t c = 0; c < plan.grid_cols_; ++c) {
+            group.push_back(c_item(r, c, 0));
+        }
+        shared_groups.push_back(group);
+    }
+    for (size_t c = 0; c < plan.grid_cols_; ++c) {
+        shared_groups.push_back(Group{b_item(c, 0)});
+    }
+
+    // --- Replicated layout: per lane, its A blocks and C tiles, then its B blocks ---
+    std::vector<Group> lane_groups;
+    for (uint32_t lane = 0; lane < tiling.lane_tiles.size(); ++lane) {
+        Group even_core, odd_core;
+        std::vector<bool> has_a(grid_rows, false), has_b(plan.grid_cols_, false);
+        for (const Tile& tile : tiling.lane_tiles[lane]) {
+            size_t r = tile.row_begin / plan.tile_rows_;
+            size_t c = tile.col_begin / plan.tile_cols_;
+            if (!has_a[r]) { has_a[r] = true; even_core.push_back(a_item(r, lane)); }
+            if (!has_b[c]) { has_b[c] = true; odd_core.push_back(b_item(c, lane)); }
+        }
+        for (const Tile& tile : tiling.lane_tiles[lane]) {
+            even_core.push_back(c_item(tile.row_begin / plan.tile_rows_, tile.col_begin / plan.tile_cols_, lane));
+        }
+        if (!even_core.empty()) lane_groups.push_back(even_core);
+        if (!odd_core.empty()) lane_groups.push_back(odd_core);
+    }
+
+    // --- Pick the most conflict-free layout that fits ---
+    uint64_t bank_rows = geometry.rows_per_bank;
+    auto group_rows = [](const Group& group) {
+        uint64_t rows = 0;
+        for (const Item& item : group) rows += item.rows;
+        return rows;
+    };
+    auto aligned_banks = [&](const std::vector<Group>& groups) {
+        uint64_t banks = 0;
+        for (const Group& group : groups) banks += (group_rows(group) + bank_rows - 1) / bank_rows;
+        return banks;
+    };
+    uint64_t free_rows = geometry.total_rows() - std::min(base_row, geometry.total_rows());
+    uint64_t free_banks = geometry.num_banks - std::min<uint64_t>((base_row + bank_rows - 1) / bank_rows,
+                                                                  geometry.num_banks);
+    uint64_t packed_rows = 0;
+    for (const Group& group : shared_groups) packed_rows += group_rows(group);
+    if (packed_rows > free_rows) {
+        throw std::runtime_error("Operands need " + std::to_string(packed_rows) + " rows but memory has " +
+                                 std::to_string(free_rows) + (base_row ? " free" : "") + " (" +
+                                 std::to_string(geometry.num_banks) + " banks x " +
+                                 std::to_string(geometry.rows_per_bank) + " rows).");
+    }
+
+    const std::vector<Group>* groups = &shared_groups;
+    if (best == PlacementMode::REPLICATED && aligned_banks(lane_groups) <= free_banks) {
+        plan.mode_ = PlacementMode::REPLICATED;
+        groups = &lane_groups;
+    } else if (best != PlacementMode::PACKED && aligned_banks(shared_groups) <= free_banks) {
+        plan.mode_ = PlacementMode::SPREAD;
+    } else {
+        plan.mode_ = PlacementMode::PACKED;
+    }
+
+    bool replicated = (plan.mode_ == PlacementMode::REPLICATED);
+    size_t lanes = replicated ? tiling.lane_tiles.size() : 1;
+    plan.a_lane_stride_ = replicated ? grid_rows : 0;
+    plan.b_lane_stride_ = replicated ? plan.grid_cols_ : 0;
+    plan.a_blocks_.assign(lanes * grid_rows, 0);
+    plan.b_blocks_.assign(lanes * plan.grid_cols_, 0);
+    plan.c_tiles_.assign(grid_rows * plan.grid_cols_, 0);
+
+    // --- Assign base rows ---
+    uint64_t next = base_row;
+    for (const Group& group : *groups) {
+        if (plan.mode_ != PlacementMode::PACKED && next % bank_rows != 0) {
+            next += bank_rows - next % bank_rows; // Start the group on a fresh bank
+        }
+        for (const Item& item : group) {
+            size_t lane = replicated ? item.lane : 0;
+            if (item.operand == 'A') {
+                plan.a_blocks_[lane * grid_rows + item.index] = next;
+                plan.a_copies_.push_back({item.index, next});
+            } else if (item.operand == 'B') {
+                plan.b_blocks_[lane * plan.grid_cols_ + item.index] = next;
+                plan.b_copies_.push_back({item.index, next});
+            } else {
+                plan.c_tiles_[item.index] = next;
+            }
+            next += item.rows;
+        }
+    }
+    plan.rows_used_ = next;
+
+    // Packed: rows_used == packed_rows. Otherwise each group ends inside the banks
+    // counted by aligned_banks. Either way every address is below total_rows(),
+    // so bank_of() < num_banks and row_of() < rows_per_bank.
+    if (plan.rows_used_ > geometry.total_rows()) {
+        throw std::runtime_error("Memory plan exceeds the configured geometry.");
+    }
+    return plan;
+}
+
+TilePlan plan_replicable_tiles(const MemoryGeometry& geometry, size_t rows_a, size_t cols_a, size_t cols_b,
+                               uint32_t num_cores, size_t tile_rows, size_t tile_cols, ElementType element_type)
+{
+    TilePlan tiling = plan_tiles(rows_a, cols_b, num_cores, tile_rows, tile_cols);
+    if (tile_rows != 0 || tile_cols != 0) {
+        return tiling;
+    }
+    auto replicable = [&](const TilePlan& candidate) {
+        try {
+            return MemoryPlan::build(geometry, rows_a, cols_a, cols_b, candidate, 0, PlacementMode::REPLICATED,
+                                     element_type).mode() == PlacementMode::REPLICATED;
+        } catch (const std::runtime_error&) {
+            return false;
+        }
+    };
+    if (replicable(tiling)) {
+        return tiling;
+    }
+    std::vector<std::pair<size_t, size_t>> sizes = automatic_tile_sizes(rows_a, cols_b, num_cores);
+    for (size_t n = 1; n < sizes.size(); ++n) {
+        TilePlan candidate = plan_tiles(rows_a, cols_b, num_cores, sizes[n].first, sizes[n].second);
+        if (replicable(candidate)) {
+            return candidate;
+        }
+    }
+    return tiling;
+}
+
+void MemoryPlan::copies_of_a(size_t i, size_t k, std::vector<uint64_t>& rows) const {
+    size_t block = i / tile_rows_;
+    for (const BlockCopy& copy : a_copies_) {
+        if (copy.block == block) rows.push_back(copy.base + (i - block * tile_rows_) * k_rows_ + k);
+    }
+}
+
+void MemoryPlan::copies_of_b(size_t k, size_t j, std::vector<uint64_t>& rows) const {
+    size_t block = j / tile_cols_;
+    for (const BlockCopy& copy : b_copies_) {
+        if (copy.block == block) rows.push_back(copy.base + (j - block * tile_cols_) * k_rows_ + k);
+    }
+}
+
+uint64_t MemoryPlan::append_scratch(uint64_t rows) {
+    uint64_t bank_rows = geometry_.rows_per_bank;
+    uint64_t begin = (rows_used_ + bank_rows - 1) / bank_rows * bank_rows;
+    if (rows > geometry_.total_rows() || begin > geometry_.total_rows() - rows) {
+        throw std::runtime_error("Scratch space of " + std::to_string(rows) + " rows does not fit after row " +
+                                 std::to_string(rows_used_) + " (" + std::to_string(geometry_.num_banks) +
+                                 " banks x " + std::to_string(geometry_.rows_per_bank) + " rows).");
+    }
+    if (scratch_rows_ == 0) scratch_begin_ = begin;
+    rows_used_ = begin + rows;
+    scratch_rows_ = rows_used_ - scratch_begin_;
+    return begin;
+}
+
+std::vector<MemoryPlan::RegionUsage> MemoryPlan::usage() const {
+    RegionUsage a_usage{"A"}, b_usage{"B"}, c_usage{"C"};
+    std::set<uint32_t> a_banks, b_banks, c_banks;
+    auto add_range = [&](RegionUsage& region, std::set<uint32_t>& banks, uint64_t base, uint64_t rows) {
+        region.rows += rows;
+        if (rows == 0) return;
+        for (uint32_t bank = bank_of(base); bank <= bank_of(base + rows - 1); ++bank) {
+            banks.insert(bank);
+        }
+    };
+
+    for (const BlockCopy& copy : a_copies_) {
+        add_range(a_usage, a_banks, copy.base, static_cast<uint64_t>(a_block_rows(copy.block)) * k_rows_);
+    }
+    for (const BlockCopy& copy : b_copies_) {
+        add_range(b_usage, b_banks, copy.base, static_cast<uint64_t>(b_block_cols(copy.block)) * k_rows_);
+    }
+    for (size_t t = 0; t < c_tiles_.size(); ++t) {
+        uint64_t rows = static_cast<uint64_t>(a_block_rows(t / grid_cols_)) * b_block_cols(t % grid_cols_);
+        add_range(c_usage, c_banks, c_tiles_[t], rows);
+    }
+    a_usage.banks = static_cast<uint32_t>(a_banks.size());
+    b_usage.banks = static_cast<uint32_t>(b_banks.size());
+    c_usage.banks = static_cast<uint32_t>(c_banks.size());
+    std::vector<RegionUsage> regions{a_usage, b_usage, c_usage};
+    if (scratch_rows_ > 0) {
+        RegionUsage scratch{"scratch", scratch_rows_};
+        scratch.banks = bank_of(rows_used_ - 1) - bank_of(scratch_begin_) + 1;
+        regions.push_back(scratch);
+    }
+    return regions;
+}
+
+} // namespace pim
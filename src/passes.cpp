@@ -0,0 +1,302 @@
+#include "passes.hpp"
+#include <algorithm>
+
+namespace pim {
+
+LoopSchedule OperandReusePass::schedule(size_t rows_a, size_t cols_b) {
+    LoopSchedule loop_schedule;
+    // With the serpentine nest every chain boundary shares one operand (A within
+    // a pass over the middle loop, B or A across the turn), so either order
+    // saves rows_a * cols_b - 1 loads. Keep the longer dimension in the middle
+    // loop so consecutive stores to C stay close together.
+    loop_schedule.order = (cols_b >= rows_a) ? LoopOrder::IJK : LoopOrder::JIK;
+    loop_schedule.serpentine = true;
+    return loop_schedule;
+}
+
+void OperandReusePass::run(std::vector<IROperation>& ir_code) {
+    IROperation* out = ir_code.data();
+    for (const IROperation& ir_op : ir_code) {
+        if (ir_op.is_load()) {
+            ++stats_.loads_before;
+            // Same type, element and buffer: the buffer already holds this value
+            uint64_t key = ir_op.bits & IROperation::KEY_MASK;
+            uint64_t& held = held_[ir_op.target_buffer()];
+            if (held == key) {
+                ++stats_.loads_eliminated;
+                continue;
+            }
+            held = key;
+        }
+        *out++ = ir_op;
+    }
+    ir_code.resize(static_cast<size_t>(out - ir_code.data()));
+}
+
+void BankSelectPass::run(std::vector<IROperation>& ir_code) {
+    std::vector<IROperation>& out = scratch_;
+    out.clear();
+    out.reserve(ir_code.size() + ir_code.size() / 8);
+
+    for (const IROperation& ir_op : ir_code) {
+        uint64_t address = 0;
+        uint8_t side = 0; // Core of the lane performing the access
+        switch (ir_op.type()) {
+            case IROpType::LOAD_A_ELEMENT:
+                address = plan_.address_a(lane_, ir_op.row(), ir_op.col());
+                side = ir_op.target_buffer();
+                break;
+            case IROpType::LOAD_B_ELEMENT:
+                address = plan_.address_b(lane_, ir_op.row(), ir_op.col());
+                side = ir_op.target_buffer();
+                break;
+            case IROpType::STORE_C_ELEMENT:
+                address = plan_.address_c(ir_op.row(), ir_op.col());
+                break;
+            case IROpType::LOAD_ELEMENT:
+                address = ir_op.row();
+                side = ir_op.target_buffer();
+                break;
+            case IROpType::STORE_ELEMENT:
+                address = ir_op.row();
+                break;
+            default:
+                out.push_back(ir_op);
+                continue;
+        }
+
+        uint32_t bank = plan_.bank_of(address);
+        uint32_t current = core_bank_[side];
+        bool known = core_known_[side];
+
+        auto emit_select = [&](IROpType type, uint32_t value) {
+            out.emplace_back(type, value, 0, side);
+            ++selects_inserted_;
+        };
+        if (!known || (current >> BANK_SELECT_BITS) != (bank >> BANK_SELECT_BITS)) {
+            emit_select(IROpType::SELECT_SEGMENT, bank >> BANK_SELECT_BITS);
+        }
+        if (!known || (current & BANK_SELECT_MASK) != (bank & BANK_SELECT_MASK)) {
+            emit_select(IROpType::SELECT_BANK, bank & BANK_SELECT_MASK);
+        }
+        core_bank_[side] = bank;
+        core_known_[side] = true;
+        out.push_back(ir_op);
+    }
+
+    ir_code.swap(out);
+}
+
+void SchedulePass::rename(IROperation& ir_op) {
+    if (ir_op.is_load()) {
+        uint8_t side = ir_op.target_buffer();
+        ir_op.set_latch(next_latch_[side]);
+        held_latch_[side] = next_latch_[side];
+        next_latch_[side] ^= 1;
+    } else if (ir_op.type() == IROpType::EXECUTE_MAC) {
+        ir_op.set_latch(static_cast<uint8_t>(held_latch_[0] | (held_latch_[1] << 1)));
+    }
+}
+
+void SchedulePass::run(std::vector<IROperation>& ir_code) {
+    for (IROperation& ir_op : ir_code) {
+        rename(ir_op);
+        pending_.push_back(ir_op);
+    }
+    ir_code.clear();
+
+    size_t done = 0;
+    while (pending_.size() - done >= WINDOW_OPS) {
+        schedule_window(done, done + WINDOW_OPS, ir_code);
+        done += WINDOW_OPS;
+    }
+    pending_.erase(pending_.begin(), pending_.begin() + done);
+}
+
+void SchedulePass::flush(std::vector<IROperation>& ir_code) {
+    if (!pending_.empty()) {
+        schedule_window(0, pending_.size(), ir_code);
+        pending_.clear();
+    }
+}
+
+void SchedulePass::schedule_window(size_t begin, size_t end, std::vector<IROperation>& out) {
+    uint32_t count = static_cast<uint32_t>(end - begin);
+    nodes_.assign(count, Node());
+    succs_.resize(std::max<size_t>(succs_.size(), count));
+    for (uint32_t n = 0; n < count; ++n) succs_[n].clear();
+    rows_.clear();
+
+    // --- Dependency DAG ---
+    Resource latches[2][2];
+    Resource accumulator;
+    std::vector<uint32_t> stores; // Of the window so far
+    std::vector<uint32_t> fences;
+    auto depend = [&](int64_t from, uint32_t to, uint32_t latency) {
+        if (from < 0 || static_cast<uint32_t>(from) == to) return;
+        succs_[from].push_back(Edge{to, latency});
+        ++nodes_[to].preds;
+    };
+    auto read = [&](Resource& resource, uint32_t n) {
+        if (resource.writer >= 0) depend(resource.writer, n, nodes_[resource.writer].latency); // RAW
+        resource.readers.push_back(n);
+    };
+    auto write = [&](Resource& resource, uint32_t n) {
+        depend(resource.writer, n, 0); // WAW
+        for (uint32_t reader : resource.readers) depend(reader, n, 0); // WAR
+        resource.writer = n;
+        resource.readers.clear();
+    };
+
+    for (uint32_t n = 0; n < count; ++n) {
+        const IROperation& ir_op = pending_[begin + n];
+        Node& node = nodes_[n];
+        switch (ir_op.type()) {
+            case IROpType::LOAD_A_ELEMENT:
+            case IROpType::LOAD_B_ELEMENT:
+            case IROpType::LOAD_ELEMENT:
+                node.side = ir_op.target_buffer();
+                node.memory = true;
+                node.address = (ir_op.type() == IROpType::LOAD_A_ELEMENT) ? plan_.address_a(lane_, ir_op.row(), ir_op.col())
+                             : (ir_op.type() == IROpType::LOAD_B_ELEMENT) ? plan_.address_b(lane_, ir_op.row(), ir_op.col())
+                             : ir_op.row();
+                node.latency = machine_.load_latency;
+                for (uint32_t fence : fences) depend(fence, n, 1);
+                read(rows_[node.address], n);
+                write(latches[node.side][ir_op.latch() & 1], n);
+                break;
+            case IROpType::EXECUTE_MAC:
+                node.latency = machine_.mac_latency;
+                read(latches[0][ir_op.latch() & 1], n);
+                read(latches[1][(ir_op.latch() >> 1) & 1], n);
+                read(accumulator, n);
+                write(accumulator, n);
+                break;
+            case IROpType::RESET_ACC:
+                node.latency = machine_.setup_latency;
+                write(accumulator, n);
+                break;
+            case IROpType::STORE_C_ELEMENT:
+            case IROpType::STORE_ELEMENT:
+                node.memory = true;
+                node.address = (ir_op.type() == IROpType::STORE_C_ELEMENT) ? plan_.address_c(ir_op.row(), ir_op.col())
+                                                                           : ir_op.row();
+                node.latency = machine_.store_latency;
+                read(accumulator, n);
+                write(rows_[node.address], n);
+                stores.push_back(n);
+                break;
+            case IROpType::FENCE:
+                // Issues once every earlier store has landed; later loads follow it
+                node.side = ir_op.target_buffer();
+                for (uint32_t store : stores) depend(store, n, machine_.store_latency);
+                fences.push_back(n);
+                break;
+            default:
+                break; // Bank selects are only inserted after scheduling
+        }
+        if (node.memory) node.bank = plan_.bank_of(node.address);
+        node.latency = std::max<uint32_t>(node.latency, 1);
+    }
+
+    // Longest latency path from each operation; edges only point forward
+    for (uint32_t n = count; n-- > 0;) {
+        uint64_t height = nodes_[n].latency;
+        for (const Edge& edge : succs_[n]) {
+            height = std::max(height, edge.latency + nodes_[edge.to].height);
+        }
+        nodes_[n].height = height;
+    }
+
+    // --- Estimate for the generation order (in-order issue per core) ---
+    {
+        std::vector<uint64_t> earliest(count, 0);
+        uint64_t core_next[2] = {0, 0};
+        uint64_t finish = 0;
+        bank_free_.clear();
+        for (uint32_t n = 0; n < count; ++n) {
+            const Node& node = nodes_[n];
+            uint64_t start = std::max(earliest[n], core_next[node.side]);
+            if (node.memory) {
+                uint64_t& free_at = bank_free_[node.bank];
+                start = std::max(start, free_at);
+                free_at = start + machine_.bank_cycles;
+            }
+            core_next[node.side] = start + 1;
+            finish = std::max(finish, start + node.latency);
+            for (const Edge& edge : succs_[n]) {
+                earliest[edge.to] = std::max(earliest[edge.to], start + edge.latency);
+            }
+        }
+        stats_.cycles_before += finish;
+    }
+
+    // --- List scheduling: each cycle, each core issues its most critical ready operation ---
+    ready_.clear();
+    for (uint32_t n = 0; n < count; ++n) {
+        if (nodes_[n].preds == 0) ready_.push_back(n);
+    }
+    bank_free_.clear();
+    auto available_at = [&](const Node& node) {
+        uint64_t at = node.earliest;
+        if (node.memory) {
+            auto found = bank_free_.find(node.bank);
+            if (found != bank_free_.end()) at = std::max(at, found->second);
+        }
+        return at;
+    };
+
+    uint64_t cycle = 0;
+    uint64_t finish = 0;
+    uint32_t scheduled = 0;
+    while (scheduled < count) {
+        bool issued = false;
+        for (uint8_t side = 0; side < 2; ++side) {
+            size_t best = ready_.size();
+            for (size_t r = 0; r < ready_.size(); ++r) {
+                const Node& node = nodes_[ready_[r]];
+                if (node.side != side || available_at(node) > cycle) continue;
+                if (best == ready_.size() || node.height > nodes_[ready_[best]].height ||
+                    (node.height == nodes_[ready_[best]].height && ready_[r] < ready_[best])) {
+                    best = r;
+                }
+            }
+            if (best == ready_.size()) continue;
+
+            uint32_t n = ready_[best];
+            ready_[best] = ready_.back();
+            ready_.pop_back();
+            Node& node = nodes_[n];
+            node.cycle = cycle;
+            if (node.memory) bank_free_[node.bank] = cycle + machine_.bank_cycles;
+            finish = std::max(finish, cycle + node.latency);
+            for (const Edge& edge : succs_[n]) {
+                Node& succ = nodes_[edge.to];
+                succ.earliest = std::max(succ.earliest, cycle + edge.latency);
+                if (--succ.preds == 0) ready_.push_back(edge.to);
+            }
+            ++scheduled;
+            issued = true;
+        }
+
+        // Skip ahead to the next cycle anything can issue
+        uint64_t next = cycle + 1;
+        if (!issued && !ready_.empty()) {
+            next = UINT64_MAX;
+            for (uint32_t n : ready_) next = std::min(next, available_at(nodes_[n]));
+            next = std::max(next, cycle + 1);
+        }
+        cycle = next;
+    }
+    stats_.cycles_after += finish;
+    ++stats_.windows;
+
+    // --- Emit in issue order; ties keep generation order, which every edge follows ---
+    order_.resize(count);
+    for (uint32_t n = 0; n < count; ++n) order_[n] = n;
+    std::stable_sort(order_.begin(), order_.end(),
+                     [&](uint32_t x, uint32_t y) { return nodes_[x].cycle < nodes_[y].cycle; });
+    for (uint32_t n : order_) out.push_back(pending_[begin + n]);
+}
+
+} // namespace pim
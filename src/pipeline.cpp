@@ -0,0 +1,307 @@
+#include "pipeline.hpp"
+#include "lut.hpp"
+#include <algorithm>
+
+namespace pim {
+
+TileIRGenerator::TileIRGenerator(const Tile& tile, size_t cols_a, const LoopSchedule& loop_schedule,
+                                 const SparseOperands* sparse)
+    : tile_(tile), cols_a_(cols_a), loop_schedule_(loop_schedule), sparse_(sparse)
+{
+    middle_count_ = (loop_schedule_.order == LoopOrder::IJK) ? tile_.cols() : tile_.rows();
+    chain_count_ = tile_.rows() * tile_.cols();
+}
+
+size_t TileIRGenerator::generate(std::vector<IROperation>& out, size_t max_ops) {
+    bool ijk = (loop_schedule_.order == LoopOrder::IJK);
+    size_t emitted = 0;
+
+    while (emitted < max_ops && chain_ < chain_count_) {
+        // Indices of the current chain; odd outer passes and odd chains run backwards
+        size_t outer = chain_ / middle_count_;
+        size_t m = chain_ % middle_count_;
+        bool middle_reversed = loop_schedule_.serpentine && (outer % 2 == 1);
+        size_t middle = middle_reversed ? middle_count_ - 1 - m : m;
+        size_t i = tile_.row_begin + (ijk ? outer : middle);
+        size_t j = tile_.col_begin + (ijk ? middle : outer);
+        bool k_reversed = loop_schedule_.serpentine && (chain_ % 2 == 1);
+        if (sparse_ && prepared_chain_ != chain_) {
+            chain_k_.clear();
+            sparse_->common_k(i, j, chain_k_);
+            prepared_chain_ = chain_;
+        }
+        size_t k_count = sparse_ ? chain_k_.size() : cols_a_;
+        size_t chain_length = 3 * k_count + 2;
+
+        for (; step_ < chain_length && emitted < max_ops; ++step_, ++emitted) {
+            if (step_ == 0) {
+                // Reset accumulator for calculating C[i][j]
+                out.emplace_back(IROpType::RESET_ACC, i, j);
+            } else if (step_ == chain_length - 1) {
+                // Store result from Accumulator to C[i][j]
+                out.emplace_back(IROpType::STORE_C_ELEMENT, i, j);
+            } else {
+                size_t k_step = (step_ - 1) / 3; // cols_a is the inner dimension
+                size_t k_index = k_reversed ? k_count - 1 - k_step : k_step;
+                size_t k = sparse_ ? chain_k_[k_index] : k_index;
+                switch ((step_ - 1) % 3) {
+                    case 0: // Load A[i][k] into buffer 0
+                        out.emplace_back(IROpType::LOAD_A_ELEMENT, i, k, 0);
+                        break;
+                    case 1: // Load B[k][j] into buffer 1
+                        out.emplace_back(IROpType::LOAD_B_ELEMENT, k, j, 1);
+                        break;
+                    default: // Execute MAC (Accumulator += Buffer0 * Buffer1)
+                        out.emplace_back(IROpType::EXECUTE_MAC);
+                        break;
+                }
+            }
+        }
+
+        if (step_ == chain_length) {
+            step_ = 0;
+            ++chain_;
+        }
+    }
+    return emitted;
+}
+
+ElementwiseIRGenerator::ElementwiseIRGenerator(const Tile& tile, const ElementwiseJob& job)
+    : tile_(tile), job_(job)
+{
+    chain_count_ = tile_.rows() * tile_.cols();
+}
+
+size_t ElementwiseIRGenerator::generate(std::vector<IROperation>& out, size_t max_ops) {
+    size_t emitted = 0;
+
+    while (emitted < max_ops && chain_ < chain_count_) {
+        size_t i = tile_.row_begin + chain_ / tile_.cols();
+        size_t j = tile_.col_begin + chain_ % tile_.cols();
+        if (prepared_chain_ != chain_) {
+            chain_terms_.clear();
+            for (const ElementwiseJob::Term& term : job_.terms) {
+                if (term.source.contains(i, j)) chain_terms_.push_back(&term);
+            }
+            if (chain_ % 2 == 1) std::reverse(chain_terms_.begin(), chain_terms_.end());
+            chain_outputs_.clear();
+            if (job_.out.contains(i, j)) job_.out.copies(i, j, chain_outputs_);
+            prepared_chain_ = chain_;
+        }
+        // Elements outside the output only pad the sources; nothing to compute
+        size_t mac_steps = 3 * chain_terms_.size();
+        size_t chain_length = chain_outputs_.empty() ? 0 : 1 + mac_steps + chain_outputs_.size();
+
+        for (; step_ < chain_length && emitted < max_ops; ++step_, ++emitted) {
+            if (step_ == 0) {
+                out.emplace_back(IROpType::RESET_ACC, i, j);
+            } else if (step_ > mac_steps) {
+                out.emplace_back(IROpType::STORE_ELEMENT, chain_outputs_[step_ - mac_steps - 1]);
+            } else {
+                const ElementwiseJob::Term& term = *chain_terms_[(step_ - 1) / 3];
+                switch ((step_ - 1) % 3) {
+                    case 0: // Source element into buffer 0
+                        out.emplace_back(IROpType::LOAD_ELEMENT, term.source.address(i, j));
+                        break;
+                    case 1: // Its sign into buffer 1
+                        out.emplace_back(IROpType::LOAD_ELEMENT,
+                                         job_.constants + 2 * tile_.lane + (term.negate ? 1 : 0), 0, 1);
+                        break;
+                    default:
+                        out.emplace_back(IROpType::EXECUTE_MAC);
+                        break;
+                }
+            }
+        }
+
+        if (step_ == chain_length) {
+            step_ = 0;
+            ++chain_;
+        }
+    }
+    return emitted;
+}
+
+LutIRGenerator::LutIRGenerator(const Tile& tile, const LutJob& job)
+    : tile_(tile), job_(job)
+{
+    table_chains_ = tile_.rows() * job_.block->entries.size();
+    product_chains_ = tile_.rows() * job_.block->columns();
+}
+
+void LutIRGenerator::prepare_chain() {
+    const LutBlock& block = *job_.block;
+    size_t entries = block.entries.size();
+    // Odd chains run backwards, so neighbours can share the operand they meet on
+    bool reversed = (chain_ % 2 == 1);
+    chain_ops_.clear();
+    if (chain_ < table_chains_) {
+        // Table row: the entry's constant times each A element of its group
+        size_t r = chain_ / entries;
+        size_t e = chain_ % entries;
+        size_t i = tile_.row_begin + r;
+        const LutBlock::Entry& entry = block.entries[e];
+        uint32_t first = block.group_begin[entry.group];
+        uint32_t count = block.group_begin[entry.group + 1] - first;
+        chain_ops_.emplace_back(IROpType::RESET_ACC, i, 0);
+        for (uint32_t n = 0; n < count; ++n) {
+            uint32_t k = block.group_k[first + (reversed ? count - 1 - n : n)];
+            chain_ops_.emplace_back(IROpType::LOAD_A_ELEMENT, i, k, 0);
+            chain_ops_.emplace_back(IROpType::LOAD_ELEMENT, job_.constants + entry.constant, 0, 1);
+            chain_ops_.emplace_back(IROpType::EXECUTE_MAC);
+        }
+        chain_ops_.emplace_back(IROpType::STORE_ELEMENT, job_.table + r * entries + e);
+    } else {
+        // C[i][j]: the table rows of the column's entries, each times +1
+        size_t product = chain_ - table_chains_;
+        if (product == 0 && table_chains_ > 0) {
+            // The lookups read rows the table chains just stored
+            chain_ops_.emplace_back(IROpType::FENCE, 0, 0, 0);
+            chain_ops_.emplace_back(IROpType::FENCE, 0, 0, 1);
+        }
+        size_t r = product / block.columns();
+        size_t u = product % block.columns();
+        size_t i = tile_.row_begin + r;
+        uint32_t first = block.column_begin[u];
+        uint32_t count = block.column_begin[u + 1] - first;
+        chain_ops_.emplace_back(IROpType::RESET_ACC, i, block.copies[block.copy_begin[u]]);
+        for (uint32_t n = 0; n < count; ++n) {
+            uint32_t e = block.column_entries[first + (reversed ? count - 1 - n : n)];
+            chain_ops_.emplace_back(IROpType::LOAD_ELEMENT, job_.table + r * entries + e, 0, 0);
+            chain_ops_.emplace_back(IROpType::LOAD_ELEMENT, job_.constants + job_.one, 0, 1);
+            chain_ops_.emplace_back(IROpType::EXECUTE_MAC);
+        }
+        for (uint32_t c = block.copy_begin[u]; c < block.copy_begin[u + 1]; ++c) {
+            chain_ops_.emplace_back(IROpType::STORE_C_ELEMENT, i, block.copies[c]);
+        }
+    }
+    prepared_chain_ = chain_;
+}
+
+size_t LutIRGenerator::generate(std::vector<IROperation>& out, size_t max_ops) {
+    size_t emitted = 0;
+    while (emitted < max_ops && !done()) {
+        if (prepared_chain_ != chain_) {
+            prepare_chain();
+        }
+        size_t count = std::min(max_ops - emitted, chain_ops_.size() - step_);
+        out.insert(out.end(), chain_ops_.begin() + step_, chain_ops_.begin() + step_ + count);
+        step_ += count;
+        emitted += count;
+        if (step_ == chain_ops_.size()) {
+            step_ = 0;
+            ++chain_;
+        }
+    }
+    return emitted;
+}
+
+LaneStream::LaneStream(const std::vector<Tile>& tiles, const std::vector<const MemoryPlan*>& memory_plans,
+                       bool operand_reuse, size_t chunk_ops, const MachineModel* machine,
+                       const SparseOperands* sparse, const std::vector<ElementwiseJob>* jobs,
+                       const LutLowering* lut, IRArena* arena)
+    : tiles_(tiles), memory_plans_(memory_plans),
+      operand_reuse_(operand_reuse), chunk_ops_(chunk_ops == 0 ? 1 : chunk_ops), machine_(machine),
+      sparse_(sparse), jobs_(jobs), lut_(lut), own_arena_(arena ? nullptr : new IRArena()),
+      arena_(arena ? *arena : *own_arena_), chunk_(arena_.chunk)
+{
+    chunk_.reserve(chunk_ops_ + chunk_ops_ / 4);
+}
+
+void LaneStream::start_tile() {
+    const Tile& tile = tiles_[tile_index_];
+    const MemoryPlan& memory_plan = *memory_plans_[tile.problem];
+    size_t k_rows = memory_plan.k_rows(); // Loads per operand of a dense chain
+    LoopSchedule loop_schedule;
+    if (operand_reuse_) {
+        loop_schedule = OperandReusePass::schedule(tile.rows(), tile.cols());
+        // Buffer tracking restarts with each tile so tiles stay independent
+        reuse_pass_.reset(new OperandReusePass());
+    }
+    if (jobs_) {
+        generator_.reset(new ElementwiseIRGenerator(tile, (*jobs_)[tile.problem]));
+    } else if (const LutJob* lut_job = lut_ ? lut_->job(tile) : nullptr) {
+        generator_.reset(new LutIRGenerator(tile, *lut_job));
+        ++stats_.lut_tiles;
+    } else {
+        // Dense tiles keep the full chains; the sparse lowering pays off once enough products vanish
+        const SparseOperands* tile_sparse = nullptr;
+        if (sparse_ && sparse_->product_density(tile) <= sparse_->threshold) {
+            tile_sparse = sparse_;
+            ++stats_.sparse_tiles;
+        }
+        generator_.reset(new TileIRGenerator(tile, k_rows, loop_schedule, tile_sparse));
+    }
+    if (machine_) {
+        schedule_pass_.reset(new SchedulePass(memory_plan, tile.lane, *machine_, arena_.pending));
+    }
+    bank_pass_.reset(new BankSelectPass(memory_plan, tile.lane, arena_.scratch));
+}
+
+void LaneStream::finish_tile() {
+    if (reuse_pass_) {
+        stats_.operand_reuse.loads_before += reuse_pass_->stats().loads_before;
+        stats_.operand_reuse.loads_eliminated += reuse_pass_->stats().loads_eliminated;
+        reuse_pass_.reset();
+    }
+    if (schedule_pass_) {
+        stats_.schedule.windows += schedule_pass_->stats().windows;
+        stats_.schedule.cycles_before += schedule_pass_->stats().cycles_before;
+        stats_.schedule.cycles_after += schedule_pass_->stats().cycles_after;
+        schedule_pass_.reset();
+    }
+    stats_.bank_selects += bank_pass_->selects_inserted();
+    bank_pass_.reset();
+    generator_.reset();
+    ++tile_index_;
+}
+
+bool LaneStream::refill() {
+    StageTimer refill_timer(stats_.refill_seconds);
+    chunk_.clear();
+    cursor_ = 0;
+    auto run_pass = [this](PassStats& pass, auto&& run) {
+        StageTimer timer(pass.seconds);
+        pass.ops_in += chunk_.size();
+        run();
+        pass.ops_out += chunk_.size();
+    };
+
+    // Passes can remove every operation of a chunk, so keep going until something survives
+    while (chunk_.empty()) {
+        if (!generator_) {
+            if (tile_index_ == tiles_.size()) {
+                return false;
+            }
+            start_tile();
+        }
+        chunk_tile_ = tile_index_;
+
+        {
+            StageTimer timer(stats_.generate_seconds);
+            stats_.ir_ops += generator_->generate(chunk_, chunk_ops_);
+        }
+        if (reuse_pass_) {
+            run_pass(stats_.reuse_pass, [&] { reuse_pass_->run(chunk_); });
+        }
+        if (schedule_pass_) {
+            run_pass(stats_.schedule_pass, [&] {
+                schedule_pass_->run(chunk_);
+                if (generator_->done()) {
+                    schedule_pass_->flush(chunk_);
+                }
+            });
+        }
+        run_pass(stats_.bank_pass, [&] { bank_pass_->run(chunk_); });
+        for (const IROperation& ir_op : chunk_) {
+            ++stats_.ops_by_type[static_cast<size_t>(ir_op.type())];
+        }
+
+        if (generator_->done()) {
+            finish_tile();
+        }
+    }
+    return true;
+}
+
+} // namespace pim
@@ -0,0 +1,200 @@
+#include "program_cache.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace pim {
+
+namespace fs = std::filesystem;
+
+ProgramCache::ProgramCache(const std::string& directory, const ProgramCacheLimits& limits)
+    : directory_(directory), limits_(limits)
+{
+    if (!directory_.empty()) {
+        std::error_code error;
+        fs::create_directories(directory_, error);
+        if (error) {
+            throw std::runtime_error("Could not create cache directory " + directory_ + ": " + error.message());
+        }
+    }
+}
+
+std::string ProgramCache::key(const GemmShape& shape, const CompileOptions& options) {
+    // Only options that change the generated words; chunk_ops and threads do not
+    return "r" + std::to_string(COMPILER_REVISION) + "-f" + std::to_string(PROGRAM_FORMAT_VERSION) +
+           "-" + std::to_string(shape.rows_a) + "x" + std::to_string(shape.cols_a) + "x" + std::to_string(shape.cols_b) +
+           "-c" + std::to_string(options.num_cores) +
+           "-t" + std::to_string(options.tile_rows) + "x" + std::to_string(options.tile_cols) +
+           "-g" + std::to_string(options.memory.num_banks) + "x" + std::to_string(options.memory.rows_per_bank) +
+           "-" + element_type_name(options.element_type) +
+           (options.operand_reuse ? "-reuse" : "-noreuse") +
+           "-st" + (options.strassen_levels >= 0 ? std::to_string(options.strassen_levels)
+                                                 : "a" + std::to_string(options.strassen_cutoff)) +
+           (options.schedule ? "-s" + std::to_string(options.machine.load_latency) + "." +
+                               std::to_string(options.machine.store_latency) + "." +
+                               std::to_string(options.machine.mac_latency) + "." +
+                               std::to_string(options.machine.setup_latency) + "." +
+                               std::to_string(options.machine.bank_cycles)
+                             : std::string());
+}
+
+std::string ProgramCache::path_for(const std::string& key) const {
+    return (fs::path(directory_) / (key + ".pimb")).string();
+}
+
+std::shared_ptr<const ProgramImage> ProgramCache::get(const GemmShape& shape, const CompileOptions& options,
+                                                      Compiler* compiler)
+{
+    if (options.sparse_density > 0) {
+        throw std::runtime_error("Sparse programs depend on the matrix values and cannot be cached by shape.");
+    }
+    if (options.lut_values > 0) {
+        throw std::runtime_error("LUT programs depend on the matrix values and cannot be cached by shape.");
+    }
+    std::string cache_key = key(shape, options);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto found = index_.find(cache_key);
+        if (found != index_.end()) {
+            lru_.splice(lru_.begin(), lru_, found->second);
+            ++stats_.memory_hits;
+            return found->second->program;
+        }
+    }
+
+    // Disk lookups and compilation run unlocked; a concurrent miss on the same
+    // key only costs a duplicate compile
+    std::shared_ptr<const ProgramImage> program;
+    if (!directory_.empty()) {
+        program = load_from_disk(cache_key, shape);
+    }
+    bool from_disk = static_cast<bool>(program);
+    if (!program) {
+        program = compile(cache_key, shape, options, compiler);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++(from_disk ? stats_.disk_hits : stats_.misses);
+    insert(cache_key, program);
+    return program;
+}
+
+std::shared_ptr<const ProgramImage> ProgramCache::load_from_disk(const std::string& key, const GemmShape& shape) {
+    std::string path = path_for(key);
+    std::error_code error;
+    if (!fs::is_regular_file(path, error)) {
+        return nullptr;
+    }
+    std::shared_ptr<const ProgramImage> program;
+    try {
+        program = std::make_shared<const ProgramImage>(path);
+    } catch (const std::exception&) {
+        fs::remove(path, error); // Truncated or from another format; recompile
+        return nullptr;
+    }
+    const GemmShape& stored = program->header().shape;
+    if (stored.rows_a != shape.rows_a || stored.cols_a != shape.cols_a || stored.cols_b != shape.cols_b) {
+        fs::remove(path, error);
+        return nullptr;
+    }
+    fs::last_write_time(path, fs::file_time_type::clock::now(), error); // Mark as recently used
+    return program;
+}
+
+std::shared_ptr<const ProgramImage> ProgramCache::compile(const std::string& key, const GemmShape& shape,
+                                                          const CompileOptions& options, Compiler* warm)
+{
+    std::unique_ptr<Compiler> own;
+    if (warm) {
+        warm->set_options(options);
+    } else {
+        own.reset(new Compiler(options));
+    }
+    Compiler& compiler = warm ? *warm : *own;
+    if (directory_.empty()) {
+        ProgramBufferSink sink(options, compiler.report());
+        compiler.compile_matrix_mult(shape.rows_a, shape.cols_a, shape.cols_b, sink);
+        return std::make_shared<const ProgramImage>(std::move(sink.bytes()));
+    }
+
+    // Write under a private name and rename, so readers never see a partial file
+    static std::atomic<uint64_t> sequence{0};
+    std::string path = path_for(key);
+    std::string temporary = path + ".tmp" +
+        std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()) ^
+                       static_cast<size_t>(std::chrono::steady_clock::now().time_since_epoch().count())) +
+        "-" + std::to_string(sequence++);
+    try {
+        {
+            ProgramFileSink sink(temporary, options, compiler.report());
+            compiler.compile_matrix_mult(shape.rows_a, shape.cols_a, shape.cols_b, sink);
+        }
+        fs::rename(temporary, path);
+    } catch (...) {
+        std::error_code error;
+        fs::remove(temporary, error);
+        throw;
+    }
+    trim_disk();
+    return std::make_shared<const ProgramImage>(path);
+}
+
+// Caller holds mutex_
+void ProgramCache::insert(const std::string& key, std::shared_ptr<const ProgramImage> program) {
+    auto found = index_.find(key);
+    if (found != index_.end()) {
+        memory_bytes_ -= found->second->program->byte_size();
+        lru_.erase(found->second);
+        index_.erase(found);
+    }
+    memory_bytes_ += program->byte_size();
+    lru_.push_front(Entry{key, std::move(program)});
+    index_[key] = lru_.begin();
+
+    // Evict from the cold end, but always keep the program just inserted
+    while (memory_bytes_ > limits_.memory_bytes && lru_.size() > 1) {
+        Entry& victim = lru_.back();
+        memory_bytes_ -= victim.program->byte_size();
+        index_.erase(victim.key);
+        lru_.pop_back();
+        ++stats_.evictions;
+    }
+}
+
+void ProgramCache::trim_disk() {
+    struct CachedFile {
+        fs::path path;
+        fs::file_time_type used;
+        uint64_t bytes;
+    };
+    std::vector<CachedFile> files;
+    uint64_t total = 0;
+    std::error_code error;
+    for (const fs::directory_entry& entry : fs::directory_iterator(directory_, error)) {
+        if (!entry.is_regular_file(error) || entry.path().extension() != ".pimb") continue;
+        CachedFile file{entry.path(), entry.last_write_time(error), entry.file_size(error)};
+        total += file.bytes;
+        files.push_back(file);
+    }
+    if (total <= limits_.disk_bytes) return;
+
+    // Oldest first; the newest file (just written) is never deleted
+    std::sort(files.begin(), files.end(),
+              [](const CachedFile& a, const CachedFile& b) { return a.used < b.used; });
+    for (size_t n = 0; n + 1 < files.size() && total > limits_.disk_bytes; ++n) {
+        // Mapped images stay valid after the file is unlinked
+        if (fs::remove(files[n].path, error)) {
+            total -= files[n].bytes;
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++stats_.evictions;
+        }
+    }
+}
+
+} // namespace pim
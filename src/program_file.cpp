@@ -0,0 +1,276 @@
+#include "program_file.hpp"
+#include "strassen.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace pim {
+
+namespace {
+
+constexpr size_t FILE_BUFFER_BYTES = 1 << 20;
+
+} // namespace
+
+void put_u32(unsigned char* p, uint32_t value) {
+    for (int b = 0; b < 4; ++b) p[b] = static_cast<unsigned char>(value >> (8 * b));
+}
+void put_u64(unsigned char* p, uint64_t value) {
+    for (int b = 0; b < 8; ++b) p[b] = static_cast<unsigned char>(value >> (8 * b));
+}
+uint32_t get_u32(const unsigned char* p) {
+    uint32_t value = 0;
+    for (int b = 0; b < 4; ++b) value |= static_cast<uint32_t>(p[b]) << (8 * b);
+    return value;
+}
+uint64_t get_u64(const unsigned char* p) {
+    uint64_t value = 0;
+    for (int b = 0; b < 8; ++b) value |= static_cast<uint64_t>(p[b]) << (8 * b);
+    return value;
+}
+
+void encode_program_header(const ProgramHeader& header, const char* magic, unsigned char* out) {
+    std::memset(out, 0, PROGRAM_HEADER_BYTES);
+    std::memcpy(out, magic, 4);
+    put_u32(out + 4, header.version);
+    put_u64(out + 8, header.shape.rows_a);
+    put_u64(out + 16, header.shape.cols_a);
+    put_u64(out + 24, header.shape.cols_b);
+    put_u32(out + 32, header.num_cores);
+    put_u32(out + 36, static_cast<uint32_t>(header.placement));
+    put_u64(out + 40, header.tile_rows);
+    put_u64(out + 48, header.tile_cols);
+    put_u32(out + 56, header.memory.rows_per_bank);
+    put_u32(out + 60, header.memory.num_banks);
+    put_u64(out + 64, header.rows_used);
+    put_u64(out + 72, header.word_count);
+    put_u64(out + 80, header.checksum);
+    put_u32(out + 88, header.strassen_levels);
+    put_u32(out + 92, static_cast<uint32_t>(header.element_type));
+}
+
+ProgramHeader decode_program_header(const unsigned char* in, const char* magic) {
+    if (std::memcmp(in, magic, 4) != 0) {
+        throw std::runtime_error("Not a PIM program file (bad magic).");
+    }
+    ProgramHeader header;
+    header.version = get_u32(in + 4);
+    if (header.version != PROGRAM_FORMAT_VERSION) {
+        throw std::runtime_error("Unsupported PIM program format version " + std::to_string(header.version) + ".");
+    }
+    header.shape.rows_a = static_cast<size_t>(get_u64(in + 8));
+    header.shape.cols_a = static_cast<size_t>(get_u64(in + 16));
+    header.shape.cols_b = static_cast<size_t>(get_u64(in + 24));
+    header.num_cores = get_u32(in + 32);
+    uint32_t placement = get_u32(in + 36);
+    if (placement > static_cast<uint32_t>(PlacementMode::PACKED)) {
+        throw std::runtime_error("PIM program file has an unknown placement mode.");
+    }
+    header.placement = static_cast<PlacementMode>(placement);
+    header.tile_rows = get_u64(in + 40);
+    header.tile_cols = get_u64(in + 48);
+    header.memory.rows_per_bank = get_u32(in + 56);
+    header.memory.num_banks = get_u32(in + 60);
+    header.rows_used = get_u64(in + 64);
+    header.word_count = get_u64(in + 72);
+    header.checksum = get_u64(in + 80);
+    header.strassen_levels = get_u32(in + 88);
+    uint32_t element_type = get_u32(in + 92);
+    if (element_type > static_cast<uint32_t>(ElementType::INT8)) {
+        throw std::runtime_error("PIM program file has an unknown element type.");
+    }
+    header.element_type = static_cast<ElementType>(element_type);
+    return header;
+}
+
+ProgramHeader make_program_header(const CompileOptions& options, const CompileReport& report) {
+    ProgramHeader header;
+    header.shape.rows_a = report.memory.rows_a();
+    header.shape.cols_a = report.memory.cols_a();
+    header.shape.cols_b = report.memory.cols_b();
+    header.num_cores = options.num_cores;
+    header.placement = report.memory.mode();
+    header.tile_rows = options.tile_rows;
+    header.tile_cols = options.tile_cols;
+    header.memory = report.memory.geometry();
+    header.rows_used = report.memory.rows_used();
+    header.strassen_levels = report.strassen_levels;
+    header.element_type = report.memory.element_type();
+    return header;
+}
+
+MemoryPlan program_memory_plan(const ProgramHeader& header) {
+    const GemmShape& shape = header.shape;
+    TilePlan tiling = plan_replicable_tiles(header.memory, shape.rows_a, shape.cols_a, shape.cols_b, header.num_cores,
+                                            static_cast<size_t>(header.tile_rows),
+                                            static_cast<size_t>(header.tile_cols), header.element_type);
+    MemoryPlan plan;
+    if (header.strassen_levels > 0) {
+        // Same steps as Compiler::plan(): single-copy operands, then the leaves and constants
+        plan = MemoryPlan::build(header.memory, shape.rows_a, shape.cols_a, shape.cols_b, tiling, 0,
+                                 PlacementMode::SPREAD);
+        StrassenLowering lowering(plan, header.strassen_levels, header.num_cores);
+    } else {
+        plan = MemoryPlan::build(header.memory, shape.rows_a, shape.cols_a, shape.cols_b, tiling, 0,
+                                 PlacementMode::REPLICATED, header.element_type);
+    }
+    if (plan.mode() != header.placement || plan.rows_used() != header.rows_used) {
+        throw std::runtime_error("Program file memory plan does not match this compiler's planner.");
+    }
+    return plan;
+}
+
+ProgramFileSink::ProgramFileSink(const std::string& path, const CompileOptions& options, const CompileReport& report)
+    : PackedProgramSink(options, report), buffer_(FILE_BUFFER_BYTES)
+{
+    if (path == "-") {
+        throw std::runtime_error("Program files need a seekable output; use --emit-raw for pipes.");
+    }
+    file_ = std::fopen(path.c_str(), "wb");
+    if (!file_) {
+        throw std::runtime_error("Could not open output file: " + path);
+    }
+    std::setvbuf(file_, buffer_.data(), _IOFBF, buffer_.size());
+
+    // Placeholder; finish() rewrites it once the counts are known
+    unsigned char header[PROGRAM_HEADER_BYTES] = {};
+    put_bytes(header, sizeof(header));
+}
+
+ProgramFileSink::~ProgramFileSink() {
+    if (file_) std::fclose(file_);
+}
+
+void ProgramFileSink::put_bytes(const unsigned char* bytes, size_t count) {
+    if (std::fwrite(bytes, 1, count, file_) != count) {
+        throw std::runtime_error("Failed to write program file.");
+    }
+}
+
+void ProgramFileSink::put_header(const unsigned char* header) {
+    if (std::fseek(file_, 0, SEEK_SET) != 0) {
+        throw std::runtime_error("Failed to seek in program file.");
+    }
+    put_bytes(header, PROGRAM_HEADER_BYTES);
+}
+
+void ProgramFileSink::finish() {
+    PackedProgramSink::finish();
+    if (std::fflush(file_) != 0) {
+        throw std::runtime_error("Failed to flush program file.");
+    }
+}
+
+ProgramBufferSink::ProgramBufferSink(const CompileOptions& options, const CompileReport& report)
+    : PackedProgramSink(options, report), bytes_(PROGRAM_HEADER_BYTES, 0) {}
+
+void PackedProgramSink::write(const InstructionWord* words, size_t count) {
+    checksum_.update(words, count);
+
+    unsigned char bytes[4096];
+    size_t used = 0;
+    uint64_t bits = bits_;
+    uint32_t bit_count = bit_count_;
+    for (size_t n = 0; n < count; ++n) {
+        if (words[n] > instr_format::INSTRUCTION_MASK) {
+            throw std::runtime_error("Instruction word " + std::to_string(words_written_ + n) +
+                                     " does not fit in " + std::to_string(instr_format::INSTRUCTION_BITS) + " bits.");
+        }
+        bits |= static_cast<uint64_t>(words[n]) << bit_count;
+        bit_count += instr_format::INSTRUCTION_BITS;
+        if (bit_count >= 32) {
+            put_u32(bytes + used, static_cast<uint32_t>(bits));
+            used += 4;
+            bits >>= 32;
+            bit_count -= 32;
+            if (used == sizeof(bytes)) {
+                put_bytes(bytes, used);
+                used = 0;
+            }
+        }
+    }
+    put_bytes(bytes, used);
+    bits_ = bits;
+    bit_count_ = bit_count;
+    words_written_ += count;
+}
+
+void PackedProgramSink::finish() {
+    // Tail bits, then the zero padding readers rely on
+    unsigned char tail[8 + PROGRAM_PADDING_BYTES] = {};
+    size_t tail_bytes = (bit_count_ + 7) / 8;
+    put_u64(tail, bits_);
+    put_bytes(tail, tail_bytes + PROGRAM_PADDING_BYTES);
+
+    ProgramHeader header = make_program_header(options_, report_);
+    header.word_count = words_written_;
+    header.checksum = checksum_.value();
+
+    unsigned char encoded[PROGRAM_HEADER_BYTES];
+    encode_program_header(header, PROGRAM_MAGIC, encoded);
+    put_header(encoded);
+}
+
+ProgramImage::ProgramImage(const std::string& path) : file_(new MappedFile(path)) {
+    attach(file_->data(), file_->size(), path);
+}
+
+ProgramImage::ProgramImage(std::vector<unsigned char> bytes) : bytes_(std::move(bytes)) {
+    attach(bytes_.data(), bytes_.size(), "In-memory program");
+}
+
+void ProgramImage::attach(const unsigned char* data, size_t size, const std::string& name) {
+    if (size < PROGRAM_HEADER_BYTES) {
+        throw std::runtime_error("Program file is truncated: " + name);
+    }
+    header_ = decode_program_header(data, PROGRAM_MAGIC);
+    if (size < PROGRAM_HEADER_BYTES + header_.payload_bytes() + PROGRAM_PADDING_BYTES) {
+        throw std::runtime_error("Program file is truncated: " + name);
+    }
+    payload_ = data + PROGRAM_HEADER_BYTES;
+    byte_size_ = size;
+}
+
+void ProgramImage::decode(size_t first, size_t count, InstructionWord* out) const {
+    for (size_t n = 0; n < count; ++n) {
+        out[n] = word(first + n);
+    }
+}
+
+bool ProgramImage::verify() const {
+    ProgramChecksum checksum;
+    InstructionWord batch[4096];
+    for (size_t base = 0; base < size(); base += 4096) {
+        size_t count = std::min<size_t>(4096, size() - base);
+        decode(base, count, batch);
+        checksum.update(batch, count);
+    }
+    return checksum.value() == header_.checksum;
+}
+
+MemoryPlan ProgramImage::memory_plan() const {
+    return program_memory_plan(header_);
+}
+
+void write_disassembly_header(std::FILE* out) {
+    std::fprintf(out, "%-5s | %-15s | %8s | %3s | %3s | %10s | %10s\n",
+                 "Idx", "Opcode", "CorePtr", "Rd", "Wr", "Row Addr", "PackedHex");
+    write_disassembly_footer(out);
+}
+
+void write_disassembly_footer(std::FILE* out) {
+    // Column widths 5, 15, 8, 3, 3, 10, 10 joined by "-|-"
+    std::fputs("------|-----------------|----------|-----|-----|------------|-----------\n", out);
+}
+
+void write_disassembly(std::FILE* out, const InstructionWord* words, size_t count, size_t first_index) {
+    for (size_t n = 0; n < count; ++n) {
+        instr_format::UnpackedInstr unpacked = instr_format::unpack(words[n]);
+        std::fprintf(out, "%-5zu | %-15s | %8u | %3d | %3d | %10u | %08x\n",
+                     first_index + n, instr_format::mnemonic(unpacked).c_str(),
+                     unpacked.core_ptr, unpacked.rd ? 1 : 0, unpacked.wr ? 1 : 0,
+                     unpacked.row_addr, words[n]);
+    }
+}
+
+} // namespace pim
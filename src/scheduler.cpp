@@ -0,0 +1,100 @@
+#include "scheduler.hpp"
+#include "instruction.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace pim {
+
+namespace {
+
+size_t ceil_div(size_t a, size_t b) {
+    return (a + b - 1) / b;
+}
+
+} // namespace
+
+uint32_t lane_count(uint32_t num_cores) {
+    if (num_cores < 2 || num_cores > NUM_CORES || num_cores % 2 != 0) {
+        throw std::runtime_error("Core count must be an even number between 2 and " +
+                                 std::to_string(NUM_CORES) + ", got " + std::to_string(num_cores) + ".");
+    }
+    return num_cores / 2;
+}
+
+std::vector<std::pair<size_t, size_t>> automatic_tile_sizes(size_t rows, size_t cols, uint32_t num_cores) {
+    uint32_t lanes = lane_count(num_cores);
+    std::vector<std::pair<size_t, size_t>> sizes;
+    for (size_t grid_rows = 1; grid_rows <= std::min<size_t>(lanes, rows); ++grid_rows) {
+        size_t grid_cols = std::min<size_t>(lanes / grid_rows, cols);
+        std::pair<size_t, size_t> size(ceil_div(rows, grid_rows), ceil_div(cols, grid_cols));
+        if (std::find(sizes.begin(), sizes.end(), size) == sizes.end()) sizes.push_back(size);
+    }
+    // Prefer the smallest tile; break ties towards wider tiles (row-major C stores)
+    std::stable_sort(sizes.begin(), sizes.end(), [](const auto& x, const auto& y) {
+        size_t x_area = x.first * x.second;
+        size_t y_area = y.first * y.second;
+        return x_area != y_area ? x_area < y_area : x.second > y.second;
+    });
+    return sizes;
+}
+
+TilePlan plan_tiles(size_t rows, size_t cols, uint32_t num_cores, size_t tile_rows, size_t tile_cols) {
+    uint32_t lanes = lane_count(num_cores);
+    if (rows == 0 || cols == 0) {
+        throw std::runtime_error("Cannot tile an empty matrix.");
+    }
+
+    TilePlan plan;
+    plan.lanes = lanes;
+
+    if (tile_rows == 0 || tile_cols == 0) {
+        // --- Automatic tiling: an r x c grid of tiles with r * c <= lanes ---
+        std::pair<size_t, size_t> best = automatic_tile_sizes(rows, cols, num_cores).front();
+        plan.tile_rows = best.first;
+        plan.tile_cols = best.second;
+        if (tile_rows != 0) plan.tile_rows = tile_rows;
+        if (tile_cols != 0) plan.tile_cols = tile_cols;
+    } else {
+        plan.tile_rows = tile_rows;
+        plan.tile_cols = tile_cols;
+    }
+    plan.tile_rows = std::min(plan.tile_rows, rows);
+    plan.tile_cols = std::min(plan.tile_cols, cols);
+
+    // --- Cut C into tiles, row-major over the tile grid ---
+    std::vector<Tile> tiles;
+    for (size_t r = 0; r < rows; r += plan.tile_rows) {
+        for (size_t c = 0; c < cols; c += plan.tile_cols) {
+            Tile tile;
+            tile.row_begin = r;
+            tile.row_end = std::min(rows, r + plan.tile_rows);
+            tile.col_begin = c;
+            tile.col_end = std::min(cols, c + plan.tile_cols);
+            tiles.push_back(tile);
+        }
+    }
+
+    // --- Balance: largest tile first onto the least loaded lane ---
+    std::vector<size_t> order(tiles.size());
+    for (size_t t = 0; t < order.size(); ++t) order[t] = t;
+    std::stable_sort(order.begin(), order.end(), [&](size_t x, size_t y) {
+        return tiles[x].rows() * tiles[x].cols() > tiles[y].rows() * tiles[y].cols();
+    });
+
+    std::vector<size_t> load(plan.lanes, 0);
+    for (size_t t : order) {
+        uint32_t lane = static_cast<uint32_t>(std::min_element(load.begin(), load.end()) - load.begin());
+        tiles[t].lane = lane;
+        load[lane] += tiles[t].rows() * tiles[t].cols();
+    }
+
+    // Each lane runs its tiles in grid order
+    plan.lane_tiles.assign(plan.lanes, {});
+    for (const Tile& tile : tiles) {
+        plan.lane_tiles[tile.lane].push_back(tile);
+    }
+    return plan;
+}
+
+} // namespace pim
@@ -0,0 +1,78 @@
+#include "cli.hpp"
+#include "compile_server.hpp"
+#include <csignal>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+
+using namespace pim;
+
+int main(int argc, char* argv[]) {
+    CompileServerOptions server_options;
+    std::string socket_path; // Listen here instead of serving stdin (--socket)
+    bool usage = false;
+
+    try {
+        for (int arg = 1; arg < argc; ++arg) {
+            if (parse_compile_option(argc, argv, arg, server_options.defaults)) continue;
+            if (std::string(argv[arg]) == "--socket" && arg + 1 < argc) {
+                socket_path = argv[++arg];
+                continue;
+            }
+            if (std::string(argv[arg]) == "--workers" && arg + 1 < argc) {
+                server_options.workers = parse_number<unsigned>(argv[++arg], "--workers");
+                if (server_options.workers > MAX_SERVER_WORKERS) {
+                    throw std::runtime_error("--workers must be at most " + std::to_string(MAX_SERVER_WORKERS));
+                }
+                continue;
+            }
+            if (std::string(argv[arg]) == "--cache" && arg + 1 < argc) {
+                server_options.cache_directory = argv[++arg];
+                continue;
+            }
+            throw std::runtime_error(std::string("Unexpected argument: ") + argv[arg]);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        usage = true;
+    }
+    if (usage) {
+        std::cerr << "Usage: " << argv[0] << " [--socket PATH] [--workers N] [--cache DIR] [options]\n"
+                  << "Reads compile requests from stdin and answers on stdout, or serves them on a Unix socket.\n"
+                  << "  --socket PATH   Listen on a Unix domain socket; runs until a shutdown request\n"
+                  << "  --workers N     Requests compiled at once, at most 1024 (0 = all hardware threads)\n"
+                  << "  --cache DIR     Keep dense programs in this directory as well as in memory\n"
+                  << "The options below are the defaults every request starts from:\n"
+                  << compile_options_usage();
+        return 1;
+    }
+
+    // A client that disconnects early must not kill the server; its answers are dropped
+    std::signal(SIGPIPE, SIG_IGN);
+
+    try {
+        CompileServer server(server_options);
+        if (socket_path.empty()) {
+            server.serve(STDIN_FILENO, STDOUT_FILENO);
+        } else {
+            std::cerr << "Listening on " << socket_path << "\n";
+            server.listen(socket_path);
+        }
+
+        CompileServerStats stats = server.stats();
+        const LatencySummary& latency = stats.latency;
+        std::cerr << "Served " << stats.requests << " requests (" << stats.errors << " errors, "
+                  << stats.cache_hits << " cache hits, " << stats.cache_misses << " cache misses)\n";
+        if (latency.count > 0) {
+            std::cerr << std::fixed << std::setprecision(3) << "Latency (ms): p50 " << latency.p50 * 1e3
+                      << ", p90 " << latency.p90 * 1e3 << ", p99 " << latency.p99 * 1e3 << ", max "
+                      << latency.max * 1e3 << ", mean " << latency.mean * 1e3 << "\n";
+        }
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+}
@@ -0,0 +1,298 @@
+#include "simulator.hpp"
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+
+namespace pim {
+
+namespace {
+
+// Instructions decoded per batch; keeps the decode buffer cache-resident
+constexpr size_t DECODE_BATCH = 1 << 16;
+
+// Decoded kinds beyond the four opcodes
+constexpr uint8_t KIND_SET_BANK = 4;
+constexpr uint8_t KIND_SET_SEGMENT = 5;
+constexpr uint8_t KIND_LOAD_LATCH1 = 6; // MEM_LOAD into the core's second latch
+constexpr uint8_t KIND_FENCE = 7;
+
+} // namespace
+
+Simulator::Simulator(const MachineConfig& config, const MemoryGeometry& geometry)
+    : config_(config), geometry_(geometry)
+{
+    geometry_.validate();
+    reset();
+}
+
+void Simulator::reset() {
+    memory_.assign(geometry_.total_rows(), 0);
+    bank_free_.assign(geometry_.num_banks, 0);
+    row_ready_.assign(geometry_.total_rows(), 0);
+    stores_done_ = 0;
+    cores_.assign(NUM_CORES, CoreState());
+    last_cycle_ = 0;
+}
+
+void Simulator::load_matrices(const MemoryPlan& memory_plan, const Matrix& matrix_a, const Matrix& matrix_b) {
+    if (memory_plan.rows_used() > memory_.size()) {
+        throw std::runtime_error("Memory plan needs " + std::to_string(memory_plan.rows_used()) +
+                                 " rows but the simulator has " + std::to_string(memory_.size()) + ".");
+    }
+    MemoryImage image(geometry_);
+    image.add(memory_plan, matrix_a, matrix_b);
+    load_image(image);
+}
+
+void Simulator::load_image(const MemoryImage& image) {
+    for (const MemoryImage::Segment& segment : image.segments()) {
+        if (segment.first_row > memory_.size() || segment.rows.size() > memory_.size() - segment.first_row) {
+            throw std::runtime_error("Memory image rows lie outside simulated memory.");
+        }
+        std::copy(segment.rows.begin(), segment.rows.end(), memory_.begin() + segment.first_row);
+    }
+}
+
+Matrix Simulator::read_matrix_c(const MemoryPlan& memory_plan) const {
+    if (memory_plan.rows_used() > memory_.size()) {
+        throw std::runtime_error("Matrix C lies outside simulated memory.");
+    }
+    std::vector<int32_t> elements;
+    elements.reserve(memory_plan.rows_a() * memory_plan.cols_b());
+    for (size_t i = 0; i < memory_plan.rows_a(); ++i) {
+        for (size_t j = 0; j < memory_plan.cols_b(); ++j) {
+            elements.push_back(memory_[memory_plan.address_c(i, j)]);
+        }
+    }
+    return Matrix(memory_plan.rows_a(), memory_plan.cols_b(), std::move(elements));
+}
+
+SimStats Simulator::run(const std::vector<InstructionWord>& program) {
+    return run_batches(program.size(), [&](size_t base, size_t) { return program.data() + base; });
+}
+
+SimStats Simulator::run(const ProgramImage& program) {
+    std::vector<InstructionWord> words(std::min(program.size(), DECODE_BATCH));
+    return run_batches(program.size(), [&](size_t base, size_t count) {
+        program.decode(base, count, words.data());
+        return words.data();
+    });
+}
+
+SimStats Simulator::run(const CompressedProgram& program) {
+    std::vector<InstructionWord> words(std::min(program.size(), DECODE_BATCH));
+    CompressedProgram::Reader reader(program);
+    return run_batches(program.size(), [&](size_t, size_t count) {
+        reader.read(words.data(), count);
+        return words.data();
+    });
+}
+
+template <typename Fetch>
+SimStats Simulator::run_batches(size_t program_size, Fetch fetch) {
+    SimStats stats;
+    stats.core_instructions.assign(NUM_CORES, 0);
+    auto start_time = std::chrono::steady_clock::now();
+
+    std::vector<DecodedInstr> decoded(std::min(program_size, DECODE_BATCH));
+    for (size_t base = 0; base < program_size; base += DECODE_BATCH) {
+        size_t count = std::min(DECODE_BATCH, program_size - base);
+        const InstructionWord* words = fetch(base, count);
+
+        // --- Decode once: unpack the bit fields of the whole batch ---
+        for (size_t n = 0; n < count; ++n) {
+            instr_format::UnpackedInstr unpacked = instr_format::unpack(words[n]);
+            decoded[n].kind = static_cast<uint8_t>(unpacked.opcode);
+            if (instr_format::is_bank_select(unpacked)) {
+                decoded[n].kind = unpacked.wr ? KIND_SET_SEGMENT : KIND_SET_BANK;
+            } else if (unpacked.opcode == Opcode::MEM_LOAD && unpacked.wr) {
+                decoded[n].kind = KIND_LOAD_LATCH1;
+            } else if (instr_format::is_fence(unpacked)) {
+                decoded[n].kind = KIND_FENCE;
+            }
+            decoded[n].core = static_cast<uint8_t>(unpacked.core_ptr);
+            decoded[n].row_addr = static_cast<uint16_t>(unpacked.row_addr);
+            if (unpacked.opcode == Opcode::COMPUTE_EXEC) {
+                if (unpacked.row_addr > static_cast<uint32_t>(ElementType::INT8)) {
+                    throw std::runtime_error("Instruction " + std::to_string(base + n) +
+                                             " multiplies an unknown element type " +
+                                             std::to_string(unpacked.row_addr) + ".");
+                }
+                decoded[n].row_addr = static_cast<uint16_t>((unpacked.rd ? 1 : 0) | (unpacked.wr ? 2 : 0) |
+                                                            (unpacked.row_addr << 2));
+            }
+        }
+
+        // --- Dispatch: run the decoded batch ---
+        if (config_.timing) {
+            execute<true>(decoded.data(), decoded.data() + count, base, stats);
+        } else {
+            execute<false>(decoded.data(), decoded.data() + count, base, stats);
+        }
+    }
+
+    stats.instructions = program_size;
+    stats.cycles = last_cycle_;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    return stats;
+}
+
+template <bool Timing>
+void Simulator::execute(const DecodedInstr* begin, const DecodedInstr* end, uint64_t first_index, SimStats& stats) {
+    uint64_t index = first_index;
+    uint64_t last_cycle = last_cycle_;
+    const uint32_t issue_width = config_.issue_width;
+    const uint32_t rows_per_bank = geometry_.rows_per_bank;
+
+    // Global row of a load/store; the bank register was range-checked when written
+    auto global_row = [&](const CoreState& core, const DecodedInstr* instr) {
+        if (instr->row_addr >= rows_per_bank) {
+            throw std::runtime_error("Instruction " + std::to_string(index) + " addresses row " +
+                                     std::to_string(instr->row_addr) + " of a " +
+                                     std::to_string(rows_per_bank) + "-row bank.");
+        }
+        return static_cast<uint64_t>(core.bank) * rows_per_bank + instr->row_addr;
+    };
+    // Waits for the bank to accept another access and occupies it
+    auto claim_bank = [&](const CoreState& core, uint64_t start) {
+        uint64_t& free_at = bank_free_[core.bank];
+        if (free_at > start) {
+            stats.bank_stall_cycles += free_at - start;
+            start = free_at;
+        }
+        free_at = start + config_.bank_cycles;
+        return start;
+    };
+    auto set_bank = [&](CoreState& core, uint32_t bank) {
+        if (bank >= geometry_.num_banks) {
+            throw std::runtime_error("Instruction " + std::to_string(index) + " selects bank " +
+                                     std::to_string(bank) + " of " + std::to_string(geometry_.num_banks) + ".");
+        }
+        core.bank = bank;
+    };
+
+    for (const DecodedInstr* instr = begin; instr != end; ++instr, ++index) {
+        CoreState& core = cores_[instr->core];
+        uint64_t start = 0;
+        uint64_t finish = 0;
+        if (Timing) {
+            start = core.next_issue;
+            if (issue_width != 0) {
+                start = std::max<uint64_t>(start, index / issue_width);
+            }
+        }
+
+        switch (instr->kind) {
+            case static_cast<uint8_t>(Opcode::MEM_LOAD):
+            case KIND_LOAD_LATCH1: {
+                size_t latch = (instr->kind == KIND_LOAD_LATCH1) ? 1 : 0;
+                uint64_t row = global_row(core, instr);
+                core.latch[latch] = memory_[row];
+                ++stats.loads;
+                if (Timing) {
+                    start = std::max(start, core.latch_read[latch]); // WAR: pending readers of the old value
+                    // RAW: a store to the row still in flight, beyond what the bank imposes
+                    uint64_t bank_ready = std::max(start, bank_free_[core.bank]);
+                    if (row_ready_[row] > bank_ready) {
+                        stats.row_stall_cycles += row_ready_[row] - bank_ready;
+                        start = row_ready_[row];
+                    }
+                    start = claim_bank(core, start);
+                    finish = start + config_.load_latency;
+                    core.latch_ready[latch] = finish;
+                }
+                break;
+            }
+
+            case static_cast<uint8_t>(Opcode::MEM_STORE): {
+                uint64_t row = global_row(core, instr);
+                memory_[row] = static_cast<int32_t>(core.acc);
+                ++stats.stores;
+                if (Timing) {
+                    start = std::max(start, core.acc_ready);
+                    start = claim_bank(core, start);
+                    finish = start + config_.store_latency;
+                    core.acc_read = start;
+                    row_ready_[row] = finish;
+                    stores_done_ = std::max(stores_done_, finish);
+                }
+                break;
+            }
+
+            case KIND_FENCE:
+                ++stats.fences;
+                if (Timing) {
+                    start = std::max(start, stores_done_);
+                    finish = start + 1;
+                }
+                break;
+
+            case static_cast<uint8_t>(Opcode::COMPUTE_SETUP):
+                core.acc = 0;
+                ++stats.setups;
+                if (Timing) {
+                    start = std::max(start, core.acc_read);
+                    finish = start + config_.setup_latency;
+                    core.acc_ready = finish;
+                }
+                break;
+
+            case static_cast<uint8_t>(Opcode::COMPUTE_EXEC): {
+                CoreState& op0 = cores_[instr->core & ~1u];
+                CoreState& op1 = cores_[instr->core | 1u];
+                size_t latch0 = instr->row_addr & 1;
+                size_t latch1 = (instr->row_addr >> 1) & 1;
+                int32_t x = op0.latch[latch0];
+                int32_t y = op1.latch[latch1];
+                switch (static_cast<ElementType>(instr->row_addr >> 2)) {
+                    case ElementType::INT32:
+                        core.acc += static_cast<int64_t>(x) * y;
+                        break;
+                    case ElementType::INT16:
+                        core.acc += static_cast<int64_t>(static_cast<int16_t>(x)) * static_cast<int16_t>(y) +
+                                    static_cast<int64_t>(static_cast<int16_t>(x >> 16)) * static_cast<int16_t>(y >> 16);
+                        break;
+                    case ElementType::INT8:
+                        for (int t = 0; t < 32; t += 8) {
+                            core.acc += static_cast<int64_t>(static_cast<int8_t>(x >> t)) * static_cast<int8_t>(y >> t);
+                        }
+                        break;
+                }
+                ++stats.macs;
+                if (Timing) {
+                    start = std::max({start, op0.latch_ready[latch0], op1.latch_ready[latch1],
+                                      core.acc_ready, core.acc_read});
+                    finish = start + config_.mac_latency;
+                    core.acc_ready = finish;
+                    op0.latch_read[latch0] = std::max(op0.latch_read[latch0], start);
+                    op1.latch_read[latch1] = std::max(op1.latch_read[latch1], start);
+                }
+                break;
+            }
+
+            case KIND_SET_BANK:
+                set_bank(core, (core.bank & ~BANK_SELECT_MASK) | instr->row_addr);
+                ++stats.bank_selects;
+                finish = start + 1;
+                break;
+
+            case KIND_SET_SEGMENT:
+                set_bank(core, (static_cast<uint32_t>(instr->row_addr) << BANK_SELECT_BITS) |
+                               (core.bank & BANK_SELECT_MASK));
+                ++stats.bank_selects;
+                finish = start + 1;
+                break;
+        }
+
+        ++stats.core_instructions[instr->core];
+        if (Timing) {
+            core.next_issue = start + 1;
+            last_cycle = std::max(last_cycle, finish);
+        }
+    }
+
+    last_cycle_ = last_cycle;
+}
+
+} // namespace pim
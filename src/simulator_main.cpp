@@ -0,0 +1,248 @@
+#include "autotune.hpp"
+#include "cli.hpp"
+#include "compiler.hpp"
+#include "matrix_io.hpp"
+#include "memory_image.hpp"
+#include "program_cache.hpp"
+#include "program_file.hpp"
+#include "simulator.hpp"
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <tuple>
+#include <vector>
+#include <string>
+#include <stdexcept>
+
+using namespace pim;
+
+// Host-side reference result used to check the simulated output
+static Matrix reference_matmul(const Matrix& matrix_a, const Matrix& matrix_b) {
+    size_t rows = matrix_a.rows();
+    size_t inner = matrix_b.rows();
+    size_t cols = matrix_b.cols();
+    std::vector<int32_t> matrix_c(rows * cols, 0);
+    for (size_t i = 0; i < rows; ++i) {
+        int32_t* c_row = matrix_c.data() + i * cols;
+        for (size_t k = 0; k < inner; ++k) {
+            int32_t a = matrix_a(i, k);
+            const int32_t* b_row = matrix_b.row(k);
+            for (size_t j = 0; j < cols; ++j) {
+                c_row[j] += a * b_row[j];
+            }
+        }
+    }
+    return Matrix(rows, cols, std::move(matrix_c));
+}
+
+static void print_matrix(const std::string& name, const Matrix& matrix) {
+    std::cout << name << ":\n";
+    for (size_t i = 0; i < matrix.rows(); ++i) {
+        for (size_t j = 0; j < matrix.cols(); ++j) {
+            std::cout << std::setw(8) << matrix(i, j);
+        }
+        std::cout << "\n";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> inputs; // One C++ source file, or two .npy or .mtx files
+    std::string program_filename; // Run this container instead of compiling
+    std::string image_filename;   // Initial memory for the container (--image)
+    std::string cache_directory;  // Take the program from this cache
+    std::string batch_manifest;   // Compile and run every problem listed here (--batch)
+    CompileOptions options;
+    MachineConfig config;
+
+    try {
+        for (int arg = 1; arg < argc; ++arg) {
+            if (parse_compile_option(argc, argv, arg, options)) continue;
+            if (std::string(argv[arg]) == "--functional") {
+                config.timing = false;
+                continue;
+            }
+            if (std::string(argv[arg]) == "--program" && arg + 1 < argc) {
+                program_filename = argv[++arg];
+                continue;
+            }
+            if (std::string(argv[arg]) == "--image" && arg + 1 < argc) {
+                image_filename = argv[++arg];
+                continue;
+            }
+            if (std::string(argv[arg]) == "--cache" && arg + 1 < argc) {
+                cache_directory = argv[++arg];
+                continue;
+            }
+            if (std::string(argv[arg]) == "--batch" && arg + 1 < argc) {
+                batch_manifest = argv[++arg];
+                continue;
+            }
+            if (argv[arg][0] == '-' || inputs.size() == 2) {
+                throw std::runtime_error(std::string("Unexpected argument: ") + argv[arg]);
+            }
+            inputs.push_back(argv[arg]);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        inputs.clear();
+    }
+    static_cast<MachineModel&>(config) = options.machine; // Time with the latencies the scheduler assumed
+    if (options.autotune && (!batch_manifest.empty() || !program_filename.empty())) {
+        std::cerr << "Error: --tune picks a configuration per shape; it cannot tune a batch or a --program\n";
+        inputs.clear();
+        batch_manifest.clear();
+        program_filename.clear();
+        image_filename.clear();
+    }
+    if (!batch_manifest.empty() && (!inputs.empty() || !program_filename.empty() || !cache_directory.empty())) {
+        std::cerr << "Error: --batch cannot be combined with input files, --program or --cache\n";
+        inputs.clear();
+        batch_manifest.clear();
+    }
+    if (!image_filename.empty() && program_filename.empty()) {
+        std::cerr << "Error: --image initializes memory for --program\n";
+        inputs.clear();
+        image_filename.clear();
+        batch_manifest.clear();
+    }
+    // A program with its memory image runs on its own; input files then only check the result
+    bool standalone = !program_filename.empty() && !image_filename.empty();
+    if (inputs.empty() && batch_manifest.empty() && !standalone) {
+        std::cerr << "Usage: " << argv[0] << " <input_cpp_file | a.npy b.npy | a.mtx b.mtx | --batch FILE> [--functional] [--program FILE [--image FILE]] [--cache DIR] [options]\n"
+                  << "  --batch FILE    Compile every problem listed in FILE into one program and run it\n"
+                  << "  --program FILE  Run a compiled program container (.pimb or .pimz) instead of compiling\n"
+                  << "  --image FILE    Load memory from an image (.pimi) instead of the inputs, which become optional\n"
+                  << "  --cache DIR     Reuse programs compiled for the same shape and options\n"
+                  << compile_options_usage();
+        return 1;
+    }
+
+    try {
+        SimStats stats;
+        bool matches = true;
+        if (!batch_manifest.empty()) {
+            // One program for the whole batch; every problem is loaded into its own region
+            std::vector<std::pair<Matrix, Matrix>> problems = read_batch_inputs(batch_manifest);
+            std::vector<GemmShape> shapes;
+            for (const auto& problem : problems) shapes.push_back(gemm_shape(problem.first, problem.second));
+            Compiler compiler(options);
+            std::vector<InstructionWord> instructions = compiler.compile_batch(shapes);
+
+            Simulator simulator(config, options.memory);
+            for (size_t p = 0; p < problems.size(); ++p) {
+                simulator.load_matrices(compiler.report().batch[p].memory, problems[p].first, problems[p].second);
+            }
+            stats = simulator.run(instructions);
+            size_t mismatches = 0;
+            for (size_t p = 0; p < problems.size(); ++p) {
+                Matrix matrix_c = simulator.read_matrix_c(compiler.report().batch[p].memory);
+                if (matrix_c != reference_matmul(problems[p].first, problems[p].second)) {
+                    std::cout << "Problem " << p << " (" << shapes[p].rows_a << "x" << shapes[p].cols_a << "x"
+                              << shapes[p].cols_b << ") does not match the host reference\n";
+                    ++mismatches;
+                }
+            }
+            matches = (mismatches == 0);
+            std::cout << "Batch of " << problems.size() << " problems, " << problems.size() - mismatches
+                      << " match the host reference: " << (matches ? "yes" : "NO") << "\n";
+        } else {
+            Matrix matrix_a;
+            Matrix matrix_b;
+            if (!inputs.empty()) {
+                std::tie(matrix_a, matrix_b) = read_matrix_inputs(inputs);
+            }
+            if (options.autotune) {
+                TuningDatabase database(options.tuning_database);
+                TuneResult tuned = autotune(gemm_shape(matrix_a, matrix_b), options, &database);
+                std::cout << "Autotune: " << tune_summary(tuned) << "\n";
+            }
+            Matrix matrix_c;
+
+            std::unique_ptr<MemoryImage> image;
+            if (!image_filename.empty()) {
+                image.reset(new MemoryImage(MemoryImage::read(image_filename)));
+            }
+            // Initial memory: the image when there is one, otherwise A and B as the plan places them
+            auto load = [&](Simulator& simulator, const ProgramHeader& header, const MemoryPlan& plan) {
+                if (!image) {
+                    simulator.load_matrices(plan, matrix_a, matrix_b);
+                    return;
+                }
+                if (image->geometry().rows_per_bank != header.memory.rows_per_bank ||
+                    image->geometry().num_banks != header.memory.num_banks) {
+                    throw std::runtime_error("Memory image " + image_filename +
+                                             " was built for a different memory geometry than the program.");
+                }
+                simulator.load_image(*image);
+            };
+
+            MemoryPlan memory_plan;
+            auto run_image = [&](const ProgramImage& program) {
+                memory_plan = program.memory_plan();
+                Simulator simulator(config, program.header().memory);
+                load(simulator, program.header(), memory_plan);
+                stats = simulator.run(program);
+                matrix_c = simulator.read_matrix_c(memory_plan);
+            };
+            if (!program_filename.empty() && is_compressed_program_file(program_filename)) {
+                ProgramHeader header;
+                CompressedProgram program = read_compressed_program(program_filename, header);
+                if (program.checksum() != header.checksum) {
+                    throw std::runtime_error("Checksum mismatch in " + program_filename + ".");
+                }
+                memory_plan = program_memory_plan(header);
+                Simulator simulator(config, header.memory);
+                load(simulator, header, memory_plan);
+                stats = simulator.run(program);
+                matrix_c = simulator.read_matrix_c(memory_plan);
+            } else if (!program_filename.empty()) {
+                ProgramImage program(program_filename);
+                if (!program.verify()) {
+                    throw std::runtime_error("Checksum mismatch in " + program_filename + ".");
+                }
+                run_image(program);
+            } else if (!cache_directory.empty()) {
+                ProgramCache cache(cache_directory);
+                std::shared_ptr<const ProgramImage> program = cache.get(gemm_shape(matrix_a, matrix_b), options);
+                std::cout << "Program cache: " << (cache.stats().misses ? "miss, compiled" : "hit") << "\n";
+                run_image(*program);
+            } else {
+                Compiler compiler(options);
+                std::vector<InstructionWord> instructions = compiler.compile_matrix_mult(matrix_a, matrix_b);
+
+                memory_plan = compiler.report().memory;
+                Simulator simulator(config, options.memory);
+                simulator.load_matrices(memory_plan, matrix_a, matrix_b);
+                stats = simulator.run(instructions);
+                matrix_c = simulator.read_matrix_c(memory_plan);
+            }
+
+            print_matrix("Matrix C", matrix_c);
+
+            if (inputs.empty()) {
+                std::cout << "\nResult not checked: no input matrices given\n";
+            } else {
+                matches = (matrix_c == reference_matmul(matrix_a, matrix_b));
+                std::cout << "\nResult matches host reference: " << (matches ? "yes" : "NO") << "\n";
+            }
+        }
+        std::cout << "Instructions: " << stats.instructions << "\n";
+        if (config.timing) {
+            std::cout << "Cycles:       " << stats.cycles << "\n"
+                      << "Bank stalls:  " << stats.bank_stall_cycles << " cycles\n"
+                      << "Row stalls:   " << stats.row_stall_cycles << " cycles\n";
+        }
+        std::cout << "Loads:        " << stats.loads << "\n"
+                  << "Stores:       " << stats.stores << "\n"
+                  << "MACs:         " << stats.macs << "\n"
+                  << "Bank selects: " << stats.bank_selects << "\n"
+                  << "Fences:       " << stats.fences << "\n"
+                  << "Throughput:   " << std::fixed << std::setprecision(1)
+                  << stats.instructions_per_second() / 1e6 << " M instr/s\n";
+
+        return matches ? 0 : 2;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+}
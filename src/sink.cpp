@@ -0,0 +1,61 @@
+#include "sink.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace pim {
+
+namespace {
+
+constexpr size_t FILE_BUFFER_BYTES = 1 << 20;
+
+} // namespace
+
+FileSink::FileSink(const std::string& path) {
+    if (path == "-") {
+        // stdout outlives the sink, so it keeps its own stdio buffer;
+        // write() already hands it whole blocks.
+        file_ = stdout;
+        return;
+    }
+    file_ = std::fopen(path.c_str(), "wb");
+    owns_file_ = true;
+    if (!file_) {
+        throw std::runtime_error("Could not open output file: " + path);
+    }
+    buffer_.resize(FILE_BUFFER_BYTES);
+    std::setvbuf(file_, buffer_.data(), _IOFBF, buffer_.size());
+}
+
+FileSink::~FileSink() {
+    if (file_) {
+        std::fflush(file_);
+        if (owns_file_) std::fclose(file_);
+    }
+}
+
+void FileSink::write(const InstructionWord* words, size_t count) {
+    unsigned char bytes[4096];
+    size_t n = 0;
+    while (n < count) {
+        size_t batch = std::min(count - n, sizeof(bytes) / 4);
+        for (size_t w = 0; w < batch; ++w) {
+            InstructionWord word = words[n + w];
+            bytes[4 * w + 0] = static_cast<unsigned char>(word);
+            bytes[4 * w + 1] = static_cast<unsigned char>(word >> 8);
+            bytes[4 * w + 2] = static_cast<unsigned char>(word >> 16);
+            bytes[4 * w + 3] = static_cast<unsigned char>(word >> 24);
+        }
+        if (std::fwrite(bytes, 4, batch, file_) != batch) {
+            throw std::runtime_error("Failed to write instruction words.");
+        }
+        n += batch;
+    }
+}
+
+void FileSink::finish() {
+    if (std::fflush(file_) != 0) {
+        throw std::runtime_error("Failed to flush instruction words.");
+    }
+}
+
+} // namespace pim
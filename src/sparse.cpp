@@ -0,0 +1,270 @@
+#include "sparse.hpp"
+#include "mapped_file.hpp"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+namespace pim {
+
+namespace {
+
+// Shared by CSR and CSC: offsets over the major dimension, indices over the minor one
+void validate_compressed(const std::vector<size_t>& begin, const std::vector<uint32_t>& index,
+                         size_t values, size_t major, size_t minor, const char* name)
+{
+    if (begin.size() != major + 1 || begin.front() != 0 || begin.back() != index.size() ||
+        index.size() != values) {
+        throw std::runtime_error(std::string(name) + " offsets do not match the stored entries.");
+    }
+    for (size_t m = 0; m < major; ++m) {
+        if (begin[m] > begin[m + 1]) {
+            throw std::runtime_error(std::string(name) + " offsets must not decrease.");
+        }
+        for (size_t e = begin[m]; e < begin[m + 1]; ++e) {
+            if (index[e] >= minor || (e > begin[m] && index[e] <= index[e - 1])) {
+                throw std::runtime_error(std::string(name) + " indices must ascend and stay below " +
+                                         std::to_string(minor) + ".");
+            }
+        }
+    }
+}
+
+} // namespace
+
+void CsrMatrix::validate() const {
+    validate_compressed(row_begin, col_index, values.size(), rows, cols, "CSR");
+}
+
+void CscMatrix::validate() const {
+    validate_compressed(col_begin, row_index, values.size(), cols, rows, "CSC");
+}
+
+CsrMatrix to_csr(const Matrix& matrix) {
+    CsrMatrix csr;
+    csr.rows = matrix.rows();
+    csr.cols = matrix.cols();
+    csr.row_begin.reserve(csr.rows + 1);
+    csr.row_begin.push_back(0);
+    for (size_t i = 0; i < csr.rows; ++i) {
+        const int32_t* row = matrix.row(i);
+        for (size_t j = 0; j < csr.cols; ++j) {
+            if (row[j] != 0) {
+                csr.col_index.push_back(static_cast<uint32_t>(j));
+                csr.values.push_back(row[j]);
+            }
+        }
+        csr.row_begin.push_back(csr.values.size());
+    }
+    return csr;
+}
+
+CscMatrix to_csc(const Matrix& matrix) {
+    CscMatrix csc;
+    csc.rows = matrix.rows();
+    csc.cols = matrix.cols();
+    csc.col_begin.reserve(csc.cols + 1);
+    csc.col_begin.push_back(0);
+    for (size_t j = 0; j < csc.cols; ++j) {
+        for (size_t i = 0; i < csc.rows; ++i) {
+            if (matrix(i, j) != 0) {
+                csc.row_index.push_back(static_cast<uint32_t>(i));
+                csc.values.push_back(matrix(i, j));
+            }
+        }
+        csc.col_begin.push_back(csc.values.size());
+    }
+    return csc;
+}
+
+CscMatrix to_csc(const CsrMatrix& matrix) {
+    // Counting sort of the entries by column; rows stay ascending within each column
+    CscMatrix csc;
+    csc.rows = matrix.rows;
+    csc.cols = matrix.cols;
+    csc.col_begin.assign(csc.cols + 1, 0);
+    for (uint32_t j : matrix.col_index) ++csc.col_begin[j + 1];
+    for (size_t j = 0; j < csc.cols; ++j) csc.col_begin[j + 1] += csc.col_begin[j];
+    csc.row_index.resize(matrix.stored());
+    csc.values.resize(matrix.stored());
+    std::vector<size_t> next(csc.col_begin.begin(), csc.col_begin.end() - 1);
+    for (size_t i = 0; i < matrix.rows; ++i) {
+        for (size_t e = matrix.row_begin[i]; e < matrix.row_begin[i + 1]; ++e) {
+            size_t slot = next[matrix.col_index[e]]++;
+            csc.row_index[slot] = static_cast<uint32_t>(i);
+            csc.values[slot] = matrix.values[e];
+        }
+    }
+    return csc;
+}
+
+Matrix to_dense(const CsrMatrix& matrix) {
+    std::vector<int32_t> elements(matrix.rows * matrix.cols, 0);
+    for (size_t i = 0; i < matrix.rows; ++i) {
+        for (size_t e = matrix.row_begin[i]; e < matrix.row_begin[i + 1]; ++e) {
+            elements[i * matrix.cols + matrix.col_index[e]] = matrix.values[e];
+        }
+    }
+    return Matrix(matrix.rows, matrix.cols, std::move(elements));
+}
+
+Matrix to_dense(const CscMatrix& matrix) {
+    std::vector<int32_t> elements(matrix.rows * matrix.cols, 0);
+    for (size_t j = 0; j < matrix.cols; ++j) {
+        for (size_t e = matrix.col_begin[j]; e < matrix.col_begin[j + 1]; ++e) {
+            elements[matrix.row_index[e] * matrix.cols + j] = matrix.values[e];
+        }
+    }
+    return Matrix(matrix.rows, matrix.cols, std::move(elements));
+}
+
+double SparseOperands::product_density(const Tile& tile) const {
+    // Products with both operands nonzero: per k, nonzeros of A's column k in
+    // the tile's rows times nonzeros of B's row k in the tile's columns
+    std::vector<uint64_t> a_count(a->cols, 0);
+    std::vector<uint64_t> b_count(a->cols, 0);
+    for (size_t i = tile.row_begin; i < tile.row_end; ++i) {
+        for (size_t e = a->row_begin[i]; e < a->row_begin[i + 1]; ++e) {
+            if (a->values[e] != 0) ++a_count[a->col_index[e]];
+        }
+    }
+    for (size_t j = tile.col_begin; j < tile.col_end; ++j) {
+        for (size_t e = b->col_begin[j]; e < b->col_begin[j + 1]; ++e) {
+            if (b->values[e] != 0) ++b_count[b->row_index[e]];
+        }
+    }
+    uint64_t products = 0;
+    for (size_t k = 0; k < a_count.size(); ++k) products += a_count[k] * b_count[k];
+    double total = static_cast<double>(tile.rows()) * tile.cols() * a->cols;
+    return total > 0 ? products / total : 0.0;
+}
+
+void SparseOperands::common_k(size_t i, size_t j, std::vector<uint32_t>& out) const {
+    // Merge of two ascending index lists
+    size_t x = a->row_begin[i], x_end = a->row_begin[i + 1];
+    size_t y = b->col_begin[j], y_end = b->col_begin[j + 1];
+    while (x < x_end && y < y_end) {
+        uint32_t ka = a->col_index[x];
+        uint32_t kb = b->row_index[y];
+        if (ka < kb) {
+            ++x;
+        } else if (kb < ka) {
+            ++y;
+        } else {
+            if (a->values[x] != 0 && b->values[y] != 0) out.push_back(ka);
+            ++x;
+            ++y;
+        }
+    }
+}
+
+CsrMatrix read_matrix_market(const std::string& filename) {
+    MappedFile file(filename);
+    const char* p = reinterpret_cast<const char*>(file.data());
+    const char* end = p + file.size();
+    size_t line = 1;
+    auto fail = [&](const std::string& what) -> void {
+        throw std::runtime_error(filename + ":" + std::to_string(line) + ": " + what + ".");
+    };
+    auto next_line = [&]() {
+        const char* newline = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        p = newline ? newline + 1 : end;
+        ++line;
+    };
+    auto skip_blanks = [&]() {
+        while (p != end && (*p == ' ' || *p == '\t' || *p == '\r')) ++p;
+    };
+    auto read_number = [&](auto& value) {
+        skip_blanks();
+        std::from_chars_result result = std::from_chars(p, end, value);
+        if (result.ec != std::errc()) fail("expected an integer");
+        p = result.ptr;
+    };
+
+    // --- Banner: only integer general coordinate matrices ---
+    const char* banner_end = static_cast<const char*>(std::memchr(p, '\n', end - p));
+    std::string banner(p, banner_end ? banner_end : end);
+    std::transform(banner.begin(), banner.end(), banner.begin(), [](unsigned char c) { return std::tolower(c); });
+    while (!banner.empty() && (banner.back() == '\r' || banner.back() == ' ')) banner.pop_back();
+    if (banner.compare(0, 14, "%%matrixmarket") != 0) fail("not a Matrix Market file");
+    if (banner.find(" coordinate") == std::string::npos || banner.find(" integer") == std::string::npos ||
+        banner.find(" general") == std::string::npos) {
+        fail("expected \"matrix coordinate integer general\"");
+    }
+    next_line();
+    while (p != end && (*p == '%' || *p == '\n' || *p == '\r')) next_line();
+
+    // --- Size line, then one "i j value" line per entry (1-based) ---
+    size_t rows = 0, cols = 0, entries = 0;
+    read_number(rows);
+    read_number(cols);
+    read_number(entries);
+    if (rows == 0 || cols == 0) fail("matrix is empty");
+    if (cols > UINT32_MAX || rows > UINT32_MAX) fail("matrix is too large");
+    next_line();
+
+    struct Entry {
+        uint32_t i;
+        uint32_t j;
+        int32_t value;
+    };
+    std::vector<Entry> triples;
+    triples.reserve(entries);
+    while (triples.size() < entries) {
+        skip_blanks();
+        if (p == end) fail("expected " + std::to_string(entries) + " entries, found " + std::to_string(triples.size()));
+        if (*p == '\n' || *p == '\r' || *p == '%') {
+            next_line();
+            continue;
+        }
+        size_t i = 0, j = 0;
+        int32_t value = 0;
+        read_number(i);
+        read_number(j);
+        read_number(value);
+        if (i == 0 || j == 0 || i > rows || j > cols) fail("entry outside the declared size");
+        triples.push_back(Entry{static_cast<uint32_t>(i - 1), static_cast<uint32_t>(j - 1), value});
+        next_line();
+    }
+
+    std::sort(triples.begin(), triples.end(),
+              [](const Entry& x, const Entry& y) { return x.i != y.i ? x.i < y.i : x.j < y.j; });
+    CsrMatrix csr;
+    csr.rows = rows;
+    csr.cols = cols;
+    csr.row_begin.assign(rows + 1, 0);
+    csr.col_index.reserve(triples.size());
+    csr.values.reserve(triples.size());
+    for (size_t e = 0; e < triples.size(); ++e) {
+        if (e > 0 && triples[e].i == triples[e - 1].i && triples[e].j == triples[e - 1].j) {
+            throw std::runtime_error(filename + ": duplicate entry (" + std::to_string(triples[e].i + 1) + ", " +
+                                     std::to_string(triples[e].j + 1) + ").");
+        }
+        ++csr.row_begin[triples[e].i + 1];
+        csr.col_index.push_back(triples[e].j);
+        csr.values.push_back(triples[e].value);
+    }
+    for (size_t i = 0; i < rows; ++i) csr.row_begin[i + 1] += csr.row_begin[i];
+    return csr;
+}
+
+void write_matrix_market(const std::string& filename, const CsrMatrix& matrix) {
+    std::FILE* file = std::fopen(filename.c_str(), "w");
+    if (!file) {
+        throw std::runtime_error("Could not open output file: " + filename);
+    }
+    bool ok = std::fprintf(file, "%%%%MatrixMarket matrix coordinate integer general\n%zu %zu %zu\n",
+                           matrix.rows, matrix.cols, matrix.stored()) > 0;
+    for (size_t i = 0; ok && i < matrix.rows; ++i) {
+        for (size_t e = matrix.row_begin[i]; ok && e < matrix.row_begin[i + 1]; ++e) {
+            ok = std::fprintf(file, "%zu %u %d\n", i + 1, matrix.col_index[e] + 1, matrix.values[e]) > 0;
+        }
+    }
+    if (std::fclose(file) != 0 || !ok) {
+        throw std::runtime_error("Failed to write " + filename + ".");
+    }
+}
+
+} // namespace pim
@@ -0,0 +1,36 @@
+#include "compiler.hpp"
+#include "static_program.hpp"
+
+namespace pim {
+
+namespace {
+
+// Shapes built into the compiler at C++ compile time (the bundled example inputs)
+constexpr SpecializedProgram SPECIALIZED_PROGRAMS[] = {
+    specialize<3, 3, 3>(),
+    specialize<10, 10, 10>(),
+    specialize<20, 20, 20>(),
+};
+
+} // namespace
+
+const SpecializedProgram* find_specialized_program(const GemmShape& shape, const CompileOptions& options) {
+    // Static programs are generated with automatic tiling, operand reuse, the
+    // default geometry, 32-bit elements, no scheduling and the dense MAC lowering;
+    // any other setting needs the runtime pipeline, and so does the Strassen lowering
+    MemoryGeometry defaults;
+    if (!options.specialized || options.element_type != ElementType::INT32 ||
+        strassen_depth(shape, options) > 0 || options.schedule || options.sparse_density > 0 || options.lut_values > 0 || !options.operand_reuse || options.tile_rows != 0 || options.tile_cols != 0 ||
+        options.memory.num_banks != defaults.num_banks || options.memory.rows_per_bank != defaults.rows_per_bank) {
+        return nullptr;
+    }
+    for (const SpecializedProgram& program : SPECIALIZED_PROGRAMS) {
+        if (program.rows_a == shape.rows_a && program.cols_a == shape.cols_a &&
+            program.cols_b == shape.cols_b && program.num_cores == options.num_cores) {
+            return &program;
+        }
+    }
+    return nullptr;
+}
+
+} // namespace pim
@@ -0,0 +1,288 @@
+#include "strassen.hpp"
+#include "autotune.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+namespace pim {
+
+namespace {
+
+struct BlockTerm {
+    uint8_t row;
+    uint8_t col;
+    bool negate;
+};
+struct ProductTerm {
+    uint8_t product;
+    bool negate;
+};
+
+// One level of the scheme: the quadrants of A and of B each product sums,
+// and the products each quadrant of C sums
+//   M1 = (A11 + A22)(B11 + B22)   M5 = (A11 + A12) B22
+//   M2 = (A21 + A22) B11          M6 = (A21 - A11)(B11 + B12)
+//   M3 = A11 (B12 - B22)          M7 = (A12 - A22)(B21 + B22)
+//   M4 = A22 (B21 - B11)
+//   C11 = M1 + M4 - M5 + M7   C12 = M3 + M5   C21 = M2 + M4   C22 = M1 - M2 + M3 + M6
+const std::vector<BlockTerm> A_TERMS[7] = {
+    {{0, 0, false}, {1, 1, false}}, {{1, 0, false}, {1, 1, false}}, {{0, 0, false}},
+    {{1, 1, false}}, {{0, 0, false}, {0, 1, false}}, {{1, 0, false}, {0, 0, true}},
+    {{0, 1, false}, {1, 1, true}},
+};
+const std::vector<BlockTerm> B_TERMS[7] = {
+    {{0, 0, false}, {1, 1, false}}, {{0, 0, false}}, {{0, 1, false}, {1, 1, true}},
+    {{1, 0, false}, {0, 0, true}}, {{1, 1, false}}, {{0, 0, false}, {0, 1, false}},
+    {{1, 0, false}, {1, 1, false}},
+};
+const std::vector<ProductTerm> C_TERMS[2][2] = {
+    {{{0, false}, {3, false}, {4, true}, {6, false}}, {{2, false}, {4, false}}},
+    {{{1, false}, {3, false}}, {{0, false}, {1, true}, {2, false}, {5, false}}},
+};
+
+size_t ceil_div(size_t value, size_t divisor) { return (value + divisor - 1) / divisor; }
+
+size_t leaf_products(uint32_t levels) {
+    size_t count = 1;
+    for (uint32_t level = 0; level < levels; ++level) count *= 7;
+    return count;
+}
+
+// Block of an operand, in units of the leaf block size
+struct SignedBlock {
+    size_t row;
+    size_t col;
+    bool negate;
+};
+
+// Blocks the given leaf's operand sums; table is A_TERMS or B_TERMS. Leaf
+// indices are base 7 with the outermost level as the leading digit.
+std::vector<SignedBlock> leaf_operand(size_t leaf, uint32_t levels, const std::vector<BlockTerm>* table) {
+    std::vector<uint8_t> digits(levels);
+    for (uint32_t level = levels; level-- > 0; leaf /= 7) digits[level] = static_cast<uint8_t>(leaf % 7);
+
+    std::vector<SignedBlock> blocks{SignedBlock{0, 0, false}};
+    std::vector<SignedBlock> next;
+    for (uint32_t level = 0; level < levels; ++level) {
+        next.clear();
+        for (const SignedBlock& block : blocks) {
+            for (const BlockTerm& term : table[digits[level]]) {
+                next.push_back(SignedBlock{2 * block.row + term.row, 2 * block.col + term.col,
+                                           block.negate != term.negate});
+            }
+        }
+        blocks.swap(next);
+    }
+    // Positive terms first, so a chain changes sign at most once
+    std::stable_partition(blocks.begin(), blocks.end(), [](const SignedBlock& block) { return !block.negate; });
+    return blocks;
+}
+
+struct SignedLeaf {
+    size_t leaf;
+    bool negate;
+};
+
+// Leaf results the C block at (row, col) sums
+std::vector<SignedLeaf> c_block_leaves(size_t row, size_t col, uint32_t levels) {
+    std::vector<SignedLeaf> leaves{SignedLeaf{0, false}};
+    std::vector<SignedLeaf> next;
+    for (uint32_t level = 0; level < levels; ++level) {
+        uint32_t shift = levels - 1 - level;
+        next.clear();
+        for (const SignedLeaf& leaf : leaves) {
+            for (const ProductTerm& term : C_TERMS[(row >> shift) & 1][(col >> shift) & 1]) {
+                next.push_back(SignedLeaf{7 * leaf.leaf + term.product, leaf.negate != term.negate});
+            }
+        }
+        leaves.swap(next);
+    }
+    std::stable_partition(leaves.begin(), leaves.end(), [](const SignedLeaf& leaf) { return !leaf.negate; });
+    return leaves;
+}
+
+// Window onto block (row, col) of a rows x cols operand cut into
+// block_rows x block_cols blocks; empty when the block lies past the edge
+MatrixView block_view(const MemoryPlan& plan, char operand, size_t row, size_t col,
+                      size_t block_rows, size_t block_cols, size_t rows, size_t cols) {
+    MatrixView view;
+    view.plan = &plan;
+    view.operand = operand;
+    view.row_offset = row * block_rows;
+    view.col_offset = col * block_cols;
+    view.rows = std::min(block_rows, rows - std::min(rows, view.row_offset));
+    view.cols = std::min(block_cols, cols - std::min(cols, view.col_offset));
+    return view;
+}
+
+} // namespace
+
+uint64_t strassen_cost(const GemmShape& shape, uint32_t levels, const CompileOptions& options) {
+    if (levels == 0) return estimate_cost(shape, options).cycles;
+
+    // The plan the compiler builds for the lowering
+    TilePlan tiling = plan_replicable_tiles(options.memory, shape.rows_a, shape.cols_a, shape.cols_b,
+                                            options.num_cores, options.tile_rows, options.tile_cols,
+                                            options.element_type);
+    MemoryPlan top = MemoryPlan::build(options.memory, shape.rows_a, shape.cols_a, shape.cols_b, tiling, 0,
+                                       PlacementMode::SPREAD);
+    StrassenLowering lowering(top, levels, options.num_cores);
+
+    const MachineModel& machine = options.machine;
+    double term_cycles = (options.schedule ? machine.load_latency / 2.0 : machine.load_latency) + machine.bank_cycles;
+    uint64_t cycles = 0;
+    for (const ProgramPhase& phase : lowering.phases()) {
+        if (phase.fence) cycles += machine.store_latency;
+        if (!phase.jobs) {
+            PlacementMode placement = PlacementMode::REPLICATED;
+            for (const MemoryPlan* plan : phase.plans) placement = std::max(placement, plan->mode());
+            cycles += tiling_cost(*phase.tiling, phase.plans.front()->k_rows(), placement, options).cycles;
+            continue;
+        }
+        // Outputs wait for their last MAC, and their stores collide on the
+        // banks of the lanes around them
+        uint32_t lanes_used = 0;
+        for (const auto& lane_tiles : phase.tiling->lane_tiles) lanes_used += lane_tiles.empty() ? 0 : 1;
+        double chain_cycles = machine.mac_latency + machine.bank_cycles * (1 + lanes_used / 4.0);
+        double busiest = 0;
+        for (const auto& lane_tiles : phase.tiling->lane_tiles) {
+            double lane = 0;
+            for (const Tile& tile : lane_tiles) {
+                double chains = static_cast<double>(tile.rows() * tile.cols());
+                lane += chains * ((*phase.jobs)[tile.problem].terms.size() * term_cycles + chain_cycles);
+            }
+            busiest = std::max(busiest, lane);
+        }
+        cycles += static_cast<uint64_t>(std::ceil(busiest));
+    }
+    return cycles;
+}
+
+uint32_t choose_strassen_levels(const GemmShape& shape, const CompileOptions& options) {
+    uint32_t best = 0;
+    uint64_t best_cost = 0;
+    for (uint32_t levels = 1; levels <= MAX_STRASSEN_LEVELS; ++levels) {
+        size_t scale = size_t(1) << levels;
+        size_t smallest = std::min({ceil_div(shape.rows_a, scale), ceil_div(shape.cols_a, scale),
+                                    ceil_div(shape.cols_b, scale)});
+        if (smallest < std::max<size_t>(options.strassen_cutoff, 1)) break;
+        uint64_t cost = 0;
+        try {
+            // The triple loop only needs costing once some depth qualifies
+            if (best_cost == 0) best_cost = strassen_cost(shape, 0, options);
+            cost = strassen_cost(shape, levels, options);
+        } catch (const std::runtime_error&) {
+            break; // Deeper recursion needs still more scratch space
+        }
+        if (cost < best_cost) {
+            best = levels;
+            best_cost = cost;
+        }
+    }
+    return best;
+}
+
+StrassenLowering::StrassenLowering(MemoryPlan& top, uint32_t levels, uint32_t num_cores)
+    : levels_(levels)
+{
+    if (levels == 0 || levels > MAX_STRASSEN_LEVELS) {
+        throw std::runtime_error("Strassen depth must be between 1 and " + std::to_string(MAX_STRASSEN_LEVELS) + ".");
+    }
+    if (top.mode() == PlacementMode::REPLICATED) {
+        throw std::runtime_error("The Strassen lowering needs a memory plan without replicated blocks.");
+    }
+    size_t rows_a = top.rows_a();
+    size_t cols_a = top.cols_a();
+    size_t cols_b = top.cols_b();
+    size_t scale = size_t(1) << levels;
+    size_t m = ceil_div(rows_a, scale);
+    size_t k = ceil_div(cols_a, scale);
+    size_t n = ceil_div(cols_b, scale);
+    size_t leaf_count = leaf_products(levels);
+    uint32_t lanes = lane_count(num_cores);
+
+    // --- Leaf operands, tiled and placed like a batch, in scratch space after top ---
+    std::vector<TilePlan> leaf_tiling;
+    product_tiling_ = plan_batch_tiles(std::vector<GemmShape>(leaf_count, GemmShape{m, k, n}), num_cores, 0, 0,
+                                       leaf_tiling);
+    uint64_t bank_rows = top.geometry().rows_per_bank;
+    uint64_t first_row = (top.rows_used() + bank_rows - 1) / bank_rows * bank_rows;
+    uint64_t next_row = first_row;
+    leaves_.reserve(leaf_count);
+    for (size_t leaf = 0; leaf < leaf_count; ++leaf) {
+        leaves_.push_back(MemoryPlan::build(top.geometry(), m, k, n, leaf_tiling[leaf], next_row));
+        next_row = leaves_.back().rows_used();
+    }
+    top.append_scratch(next_row - first_row);
+
+    // A +1 and a -1 for every lane to multiply the terms of the sums with
+    uint64_t constants = top.append_scratch(2 * lanes);
+    for (uint32_t lane = 0; lane < lanes; ++lane) {
+        top.add_constant(constants + 2 * lane, 1);
+        top.add_constant(constants + 2 * lane + 1, -1);
+    }
+
+    // --- Operand sums: every leaf's A, then every leaf's B ---
+    for (char operand : {'A', 'B'}) {
+        size_t block_rows = (operand == 'A') ? m : k;
+        size_t block_cols = (operand == 'A') ? k : n;
+        for (size_t leaf = 0; leaf < leaf_count; ++leaf) {
+            ElementwiseJob job;
+            job.out = MatrixView{&leaves_[leaf], operand, 0, 0, block_rows, block_cols};
+            job.rows = block_rows;
+            job.cols = block_cols;
+            job.constants = constants;
+            for (const SignedBlock& block : leaf_operand(leaf, levels, operand == 'A' ? A_TERMS : B_TERMS)) {
+                MatrixView source = (operand == 'A')
+                    ? block_view(top, 'A', block.row, block.col, m, k, rows_a, cols_a)
+                    : block_view(top, 'B', block.row, block.col, k, n, cols_a, cols_b);
+                if (source.rows > 0 && source.cols > 0) {
+                    job.terms.push_back(ElementwiseJob::Term{source, block.negate});
+                }
+            }
+            operand_jobs_.push_back(std::move(job));
+        }
+    }
+
+    // --- Leaf results summed into every C block that lies inside C ---
+    for (size_t row = 0; row < scale; ++row) {
+        for (size_t col = 0; col < scale; ++col) {
+            MatrixView out = block_view(top, 'C', row, col, m, n, rows_a, cols_b);
+            if (out.rows == 0 || out.cols == 0) continue;
+            ElementwiseJob job;
+            job.out = out;
+            job.rows = out.rows;
+            job.cols = out.cols;
+            job.constants = constants;
+            for (const SignedLeaf& leaf : c_block_leaves(row, col, levels)) {
+                job.terms.push_back(ElementwiseJob::Term{MatrixView{&leaves_[leaf.leaf], 'C', 0, 0, m, n}, leaf.negate});
+            }
+            combine_jobs_.push_back(std::move(job));
+        }
+    }
+
+    // Elementwise tiles are weighted by their term count, like products by k
+    auto job_tiling = [&](const std::vector<ElementwiseJob>& jobs, std::vector<const MemoryPlan*>& plans) {
+        std::vector<GemmShape> shapes;
+        for (const ElementwiseJob& job : jobs) {
+            shapes.push_back(GemmShape{job.rows, std::max<size_t>(job.terms.size(), 1), job.cols});
+        }
+        plans.assign(jobs.size(), &top);
+        std::vector<TilePlan> job_views;
+        return plan_batch_tiles(shapes, num_cores, 0, 0, job_views);
+    };
+    operand_tiling_ = job_tiling(operand_jobs_, operand_plans_);
+    combine_tiling_ = job_tiling(combine_jobs_, combine_plans_);
+    for (const MemoryPlan& leaf : leaves_) product_plans_.push_back(&leaf);
+}
+
+std::vector<ProgramPhase> StrassenLowering::phases() const {
+    return {
+        ProgramPhase{&operand_tiling_, operand_plans_, &operand_jobs_},
+        ProgramPhase{&product_tiling_, product_plans_, nullptr, nullptr, true},
+        ProgramPhase{&combine_tiling_, combine_plans_, &combine_jobs_, nullptr, true},
+    };
+}
+
+} // namespace pim
@@ -0,0 +1,141 @@
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace pim {
+
+namespace {
+
+constexpr uint64_t pack_bounds(uint64_t begin, uint64_t end) { return (begin << 32) | end; }
+constexpr uint64_t bounds_begin(uint64_t bounds) { return bounds >> 32; }
+constexpr uint64_t bounds_end(uint64_t bounds) { return bounds & 0xFFFFFFFFull; }
+
+} // namespace
+
+ThreadPool::ThreadPool(unsigned threads) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    slices_.reset(new Slice[threads]);
+    for (unsigned index = 1; index < threads; ++index) {
+        workers_.emplace_back(&ThreadPool::worker_loop, this, index);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (std::thread& worker : workers_) worker.join();
+}
+
+void ThreadPool::parallel_for(size_t count, const std::function<void(size_t)>& body) {
+    if (count == 0) return;
+    if (workers_.empty() || count == 1) {
+        for (size_t i = 0; i < count; ++i) body(i);
+        return;
+    }
+    if (count > 0xFFFFFFFFull) {
+        throw std::runtime_error("parallel_for supports at most 2^32 - 1 items.");
+    }
+
+    // Equal slices to start with; stealing evens out the rest
+    unsigned participants = size();
+    for (unsigned index = 0; index < participants; ++index) {
+        uint64_t begin = count * index / participants;
+        uint64_t end = count * (index + 1) / participants;
+        slices_[index].bounds.store(pack_bounds(begin, end), std::memory_order_relaxed);
+    }
+    failed_.store(false, std::memory_order_relaxed);
+    error_ = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        body_ = &body;
+        running_ = static_cast<unsigned>(workers_.size());
+        ++generation_;
+    }
+    wake_.notify_all();
+
+    run_slices(0);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return running_ == 0; });
+    body_ = nullptr;
+    if (error_) {
+        std::exception_ptr error = error_;
+        error_ = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+void ThreadPool::worker_loop(unsigned index) {
+    uint64_t seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [&] { return stop_ || generation_ != seen; });
+            if (stop_) return;
+            seen = generation_;
+        }
+        run_slices(index);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--running_ == 0) done_.notify_one();
+        }
+    }
+}
+
+void ThreadPool::run_slices(unsigned index) {
+    size_t item;
+    do {
+        while (take(index, item)) {
+            if (failed_.load(std::memory_order_relaxed)) continue; // Drain without running
+            try {
+                (*body_)(item);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (!error_) error_ = std::current_exception();
+                failed_.store(true, std::memory_order_relaxed);
+            }
+        }
+    } while (steal(index));
+}
+
+// Pops the front of the participant's own slice
+bool ThreadPool::take(unsigned index, size_t& item) {
+    std::atomic<uint64_t>& bounds = slices_[index].bounds;
+    uint64_t current = bounds.load(std::memory_order_acquire);
+    for (;;) {
+        uint64_t begin = bounds_begin(current);
+        uint64_t end = bounds_end(current);
+        if (begin >= end) return false;
+        if (bounds.compare_exchange_weak(current, pack_bounds(begin + 1, end), std::memory_order_acq_rel)) {
+            item = static_cast<size_t>(begin);
+            return true;
+        }
+    }
+}
+
+// Moves the back half of some other slice into the (empty) own slice
+bool ThreadPool::steal(unsigned index) {
+    unsigned participants = size();
+    for (unsigned offset = 1; offset < participants; ++offset) {
+        std::atomic<uint64_t>& victim = slices_[(index + offset) % participants].bounds;
+        uint64_t current = victim.load(std::memory_order_acquire);
+        for (;;) {
+            uint64_t begin = bounds_begin(current);
+            uint64_t end = bounds_end(current);
+            if (begin >= end) break;
+            uint64_t middle = begin + (end - begin) / 2; // The victim keeps [begin, middle)
+            if (victim.compare_exchange_weak(current, pack_bounds(begin, middle), std::memory_order_acq_rel)) {
+                slices_[index].bounds.store(pack_bounds(middle, end), std::memory_order_release);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+} // namespace pim